@@ -0,0 +1,187 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2014 Jonathan Craig Whitlock
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+ */
+
+
+
+#include <string>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include "database_client.hpp"
+#include "wire_protocol.hpp"
+
+namespace db_client
+{
+    bool client_class::connect_tcp(const std::string& address, std::string& error)
+    {
+        std::string::size_type colon(address.rfind(':'));
+        std::string host("localhost"), port(address);
+        addrinfo hints, *found(nullptr);
+        int fd(-1), result(0), on(1);
+        
+        if(colon != std::string::npos)
+        {
+            host = address.substr(0, colon);
+            port = address.substr(colon + 1);
+        }
+        std::memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        result = getaddrinfo(host.c_str(), port.c_str(), &hints, &found);
+        if(result != 0)
+        {
+            error = ("can't connect to " + address + ": " + gai_strerror(result));
+            return false;
+        }
+        for(addrinfo* a = found; ((a != nullptr) && (fd < 0)); a = a->ai_next)
+        {
+            fd = socket(a->ai_family, (a->ai_socktype | SOCK_CLOEXEC), a->ai_protocol);
+            if((fd >= 0) && (connect(fd, a->ai_addr, a->ai_addrlen) != 0))
+            {
+                result = errno;
+                close(fd);
+                fd = -1;
+                errno = result;
+            }
+        }
+        freeaddrinfo(found);
+        if(fd < 0)
+        {
+            error = ("can't connect to " + address + ": " + std::strerror(errno));
+            return false;
+        }
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+        return this->start(fd, error);
+    }
+    
+    bool client_class::connect_unix(const std::string& path, std::string& error)
+    {
+        sockaddr_un a;
+        int fd(-1);
+        
+        std::memset(&a, 0, sizeof(a));
+        a.sun_family = AF_UNIX;
+        if(path.size() >= sizeof(a.sun_path))
+        {
+            error = ("can't connect to " + path + ": the path is too long");
+            return false;
+        }
+        std::memcpy(a.sun_path, path.data(), path.size());
+        fd = socket(AF_UNIX, (SOCK_STREAM | SOCK_CLOEXEC), 0);
+        if((fd < 0) || (connect(fd, (sockaddr*)&a, sizeof(a)) != 0))
+        {
+            error = ("can't connect to " + path + ": " + std::strerror(errno));
+            if(fd >= 0) close(fd);
+            return false;
+        }
+        return this->start(fd, error);
+    }
+    
+    void client_class::disconnect()
+    {
+        if(this->fd >= 0) close(this->fd);
+        this->fd = -1;
+        this->requests.clear();
+        this->begin = 0;
+        this->end = 0;
+    }
+    
+    bool client_class::flush(std::string& error)
+    {
+        std::size_t sent(0);
+        while(sent < this->requests.size())
+        {
+            ssize_t count(send(this->fd, (this->requests.data() + sent), (this->requests.size() - sent), 
+                    MSG_NOSIGNAL));
+            if((count < 0) && (errno == EINTR)) continue;
+            if(count <= 0)
+            {
+                error = (std::string("can't send: ") + std::strerror(errno));
+                return false;
+            }
+            sent += count;
+        }
+        this->requests.clear();
+        return true;
+    }
+    
+    bool client_class::next_response(wire::response_data& r, std::string& error)
+    {
+        if(!this->receive(wire::response_size, error)) return false;
+        wire::decode_response((this->input.data() + this->begin), r);
+        this->begin += wire::response_size;
+        
+        r.text.clear();
+        if(r.status == wire::status_text)
+        {
+            if((r.value < 0) || ((std::size_t)r.value > this->input.size()))
+            {
+                error = "the server sent a malformed response";
+                return false;
+            }
+            if(!this->receive((std::size_t)r.value, error)) return false;
+            r.text.assign((this->input.data() + this->begin), (std::size_t)r.value);
+            this->begin += (std::size_t)r.value;
+        }
+        return true;
+    }
+    
+    bool client_class::receive(const std::size_t& size, std::string& error)
+    {
+        while((this->end - this->begin) < size)
+        {
+            /* What's left of a response goes to the front to be finished. */
+            std::memmove(this->input.data(), (this->input.data() + this->begin), (this->end - this->begin));
+            this->end -= this->begin;
+            this->begin = 0;
+            
+            ssize_t count(recv(this->fd, (this->input.data() + this->end), (this->input.size() - this->end), 0));
+            if((count < 0) && (errno == EINTR)) continue;
+            if(count <= 0)
+            {
+                error = ((count == 0) ? std::string("the server closed the connection") : 
+                        (std::string("can't receive: ") + std::strerror(errno)));
+                return false;
+            }
+            this->end += count;
+        }
+        return true;
+    }
+    
+    bool client_class::start(const int& f, std::string& error)
+    {
+        this->disconnect();
+        this->fd = f;
+        this->requests.push_back((char)wire::hello);
+        return this->flush(error);
+    }
+    
+    
+}
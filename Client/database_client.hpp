@@ -0,0 +1,118 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2014 Jonathan Craig Whitlock
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+ */
+
+
+
+#ifndef DATABASE_CLIENT_HPP_INCLUDED
+#define DATABASE_CLIENT_HPP_INCLUDED
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+#include "command_table.hpp"
+#include "wire_protocol.hpp"
+
+namespace db_client
+{
+    /**
+     * A client for the binary protocol.  Requests are queued and sent
+     * together by flush(), so any number of them can be in flight; their
+     * responses come back, in order, from next_response().
+     */
+    class client_class
+    {
+    public:
+        explicit client_class() : fd(-1), next_id(1), requests(), input(1 << 16), begin(0), end(0)
+        {
+        }
+        
+        ~client_class()
+        {
+            this->disconnect();
+        }
+        
+        /** Connects to "host:port", or to a Unix socket at [path]. */
+        bool connect_tcp(const std::string& address, std::string& error);
+        bool connect_unix(const std::string& path, std::string& error);
+        void disconnect();
+        
+        /** Queues a request, and returns the id its response will carry. */
+        std::uint32_t request(const db_command::command_type& op, const std::string& key = std::string(), 
+                const std::int32_t& value = 0)
+        {
+            std::uint32_t id(this->next_id++);
+            wire::encode_request(this->requests, (unsigned char)op, key.data(), key.size(), value, id);
+            return id;
+        }
+        
+        std::uint32_t set(const std::string& key, const std::int32_t& value)
+        {
+            return this->request(db_command::setvar, key, value);
+        }
+        
+        std::uint32_t get(const std::string& key)
+        {
+            return this->request(db_command::getvar, key);
+        }
+        
+        std::uint32_t unset(const std::string& key)
+        {
+            return this->request(db_command::unsetvar, key);
+        }
+        
+        std::uint32_t num_equal_to(const std::int32_t& value)
+        {
+            return this->request(db_command::numequaltovar, std::string(), value);
+        }
+        
+        /** Sends every queued request. */
+        bool flush(std::string& error);
+        
+        /** Waits for the next response, and the text it carries if it has
+         any. */
+        bool next_response(wire::response_data& r, std::string& error);
+        
+    private:
+        int fd;
+        std::uint32_t next_id;
+        std::string requests;
+        
+        /* Responses that have been read; [begin] to [end] is what hasn't
+         been handed out yet. */
+        std::vector<char> input;
+        std::size_t begin;
+        std::size_t end;
+        
+        bool start(const int&, std::string&);
+        
+        /** Waits until at least [size] bytes have been read and not handed
+         out. */
+        bool receive(const std::size_t&, std::string&);
+        
+    };
+    
+}
+
+#endif
@@ -0,0 +1,86 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2014 Jonathan Craig Whitlock
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+ */
+
+
+#include <vector>
+#include <cstdlib>
+#include <cstdint>
+#include <new>
+
+#include "allocation.hpp"
+
+namespace
+{
+}
+
+namespace allocation
+{
+    const std::size_t arena_class::ref_bits;
+    const std::size_t arena_class::block_size;
+    const std::size_t arena_class::max_ref_blocks;
+    const std::size_t pool_class::min_size;
+    const std::size_t pool_class::max_size;
+    const std::size_t pool_class::classes;
+    
+    void arena_class::clear()
+    {
+        for(std::size_t x = 0; x < this->blocks.size(); x++) std::free(this->blocks[x]);
+        this->blocks.clear();
+        this->next = nullptr;
+        this->end = nullptr;
+        this->current = 0;
+        this->reserved = 0;
+    }
+    
+    void* arena_class::allocate_block(const std::size_t& size, const std::size_t& align)
+    {
+        std::size_t needed(size + align);
+        
+        if(needed > (block_size / 4))
+        {
+            /* The current block keeps going after this one. */
+            char* own((char*)std::malloc(needed));
+            if(own == nullptr) throw std::bad_alloc();
+            this->blocks.push_back(own);
+            this->reserved += needed;
+            return (void*)(((std::uintptr_t)own + (align - 1)) & ~(std::uintptr_t)(align - 1));
+        }
+        
+        char* block((char*)std::malloc(block_size));
+        if(block == nullptr) throw std::bad_alloc();
+        this->current = this->blocks.size();
+        this->blocks.push_back(block);
+        this->reserved += block_size;
+        this->next = block;
+        this->end = (block + block_size);
+        return this->allocate(size, align);
+    }
+    
+    void pool_class::clear()
+    {
+        this->arena.clear();
+        for(std::size_t x = 0; x < classes; x++) this->free_lists[x] = nullptr;
+    }
+    
+}
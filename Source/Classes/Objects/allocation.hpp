@@ -0,0 +1,327 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2014 Jonathan Craig Whitlock
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+ */
+
+
+#ifndef ALLOCATION_HPP_INCLUDED
+#define ALLOCATION_HPP_INCLUDED
+#include <vector>
+#include <new>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+#include "chunk_vector.hpp"
+
+namespace allocation
+{
+    
+    /**
+     * Hands out memory from big blocks, one piece after another.  Nothing is
+     * given back on its own: clear() releases every block at once, so it
+     * suits things that are only ever added to (like interned keys), or that
+     * are all thrown away together.
+     * 
+     * Memory can also be named by a 32-bit ref instead of a pointer: the
+     * number of its block and where in the block it starts.  That leaves
+     * room for max_ref_blocks blocks (4 GiB, less for things big enough to
+     * get a block to themselves); ref_room says whether there is any left.
+     */
+    class arena_class
+    {
+    public:
+        static const std::size_t ref_bits = 16;
+        static const std::size_t block_size = (std::size_t(1) << ref_bits);
+        static const std::size_t max_ref_blocks = (std::size_t(1) << (32 - ref_bits));
+        
+        typedef std::uint32_t ref_type;
+        typedef chunk_vector::chunk_vector_class<char*, 8> block_list;
+        
+        /** Reads memory by its ref.  Blocks never move, so it stays valid
+         while more is allocated (even by another thread). */
+        class view_class
+        {
+        public:
+            explicit view_class(const block_list::view_class& b) : blocks(b)
+            {
+            }
+            
+            const char* at(const ref_type& ref) const
+            {
+                return (this->blocks[(ref >> ref_bits)] + (ref & (block_size - 1)));
+            }
+            
+        private:
+            block_list::view_class blocks;
+            
+        };
+        
+        explicit arena_class() : blocks(), next(nullptr), end(nullptr), current(0), reserved(0)
+        {
+        }
+        
+        ~arena_class()
+        {
+            this->clear();
+        }
+        
+        arena_class(const arena_class&) = delete;
+        arena_class& operator=(const arena_class&) = delete;
+        
+        /** Returns [size] bytes aligned to [align] (a power of two). */
+        void* allocate(const std::size_t& size, const std::size_t& align = alignof(std::max_align_t))
+        {
+            std::uintptr_t p(((std::uintptr_t)this->next + (align - 1)) & ~(std::uintptr_t)(align - 1));
+            if((this->next == nullptr) || ((p + size) > (std::uintptr_t)this->end)) return this->allocate_block(size, align);
+            this->next = (char*)(p + size);
+            return (void*)p;
+        }
+        
+        /** Returns [size] unaligned bytes, and puts their ref in [ref]. */
+        char* allocate_ref(const std::size_t& size, ref_type& ref)
+        {
+            char* p((char*)this->allocate(size, 1));
+            std::size_t block(this->current);
+            
+            /* Anything not in the current block got a block to itself, which
+             is always the last one. */
+            std::uintptr_t start((std::uintptr_t)this->blocks[block]);
+            if(((std::uintptr_t)p < start) || ((std::uintptr_t)p >= (start + block_size))) block = (this->blocks.size() - 1);
+            if(block >= max_ref_blocks) throw std::bad_alloc();
+            ref = (ref_type)((block << ref_bits) | (std::size_t)(p - this->blocks[block]));
+            return p;
+        }
+        
+        const char* at(const ref_type& ref) const
+        {
+            return (this->blocks[(ref >> ref_bits)] + (ref & (block_size - 1)));
+        }
+        
+        /** Returns true if [size] more bytes can be given a ref.  Until the
+         last block there can be is taken, anything can. */
+        bool ref_room(const std::size_t& size) const
+        {
+            return ((this->blocks.size() < max_ref_blocks) || 
+                    ((this->next != nullptr) && (size <= (std::size_t)(this->end - this->next))));
+        }
+        
+        view_class view() const
+        {
+            return view_class(this->blocks.view());
+        }
+        
+        /** Releases every block. */
+        void clear();
+        
+        /** Returns the number of bytes taken from the heap for blocks. */
+        std::size_t bytes() const
+        {
+            return this->reserved;
+        }
+        
+    private:
+        block_list blocks;
+        char* next;
+        char* end;
+        
+        /* the block [next] points into */
+        std::size_t current;
+        std::size_t reserved;
+        
+        /** Starts a new block, and takes [size] bytes from it.  Something
+         too big to share a block gets one to itself. */
+        void* allocate_block(const std::size_t& size, const std::size_t& align);
+        
+    };
+    
+    /**
+     * Keeps a free list for each size class (powers of two), carved out of
+     * an arena, so things that are freed and allocated again all the time
+     * (like growing lists) don't go to the heap each time.  Anything bigger
+     * than the largest class goes to the heap.  clear() gives all of it back
+     * at once, but only once nothing is using any of it.
+     */
+    class pool_class
+    {
+    public:
+        static const std::size_t min_size = 16;
+        static const std::size_t max_size = (arena_class::block_size / 8);
+        
+        explicit pool_class() : arena(), free_lists(), large(0)
+        {
+        }
+        
+        pool_class(const pool_class&) = delete;
+        pool_class& operator=(const pool_class&) = delete;
+        
+        void* allocate(const std::size_t& size)
+        {
+            if(size > max_size)
+            {
+                void* p(::operator new(size));
+                this->large += size;
+                return p;
+            }
+            
+            std::size_t c(size_class(size));
+            void* p(this->free_lists[c]);
+            if(p == nullptr) return this->arena.allocate((min_size << c), min_size);
+            this->free_lists[c] = *(void**)p;
+            return p;
+        }
+        
+        void deallocate(void* p, const std::size_t& size)
+        {
+            if(size > max_size)
+            {
+                ::operator delete(p);
+                this->large -= size;
+                return;
+            }
+            
+            std::size_t c(size_class(size));
+            *(void**)p = this->free_lists[c];
+            this->free_lists[c] = p;
+        }
+        
+        void clear();
+        
+        /** Returns the bytes taken from the heap: the arena's blocks, and
+         whatever is too big for a class and still allocated. */
+        std::size_t bytes() const
+        {
+            return (this->arena.bytes() + this->large);
+        }
+        
+    private:
+        static const std::size_t classes = 10;
+        
+        arena_class arena;
+        void* free_lists[classes];
+        std::size_t large;
+        
+        /** Returns the smallest class that [size] bytes fit in. */
+        static std::size_t size_class(const std::size_t& size)
+        {
+            if(size <= min_size) return 0;
+            return ((sizeof(unsigned long long) * 8) - __builtin_clzll(size - 1) - 4);
+        }
+        
+    };
+    
+    /** Allocates straight from the heap; clearing it does nothing. */
+    class heap_class
+    {
+    public:
+        void* allocate(const std::size_t& size)
+        {
+            return ::operator new(size);
+        }
+        
+        void deallocate(void* p, const std::size_t&)
+        {
+            ::operator delete(p);
+        }
+        
+        void clear()
+        {
+        }
+        
+        std::size_t bytes() const
+        {
+            return 0;
+        }
+        
+    };
+    
+    /**
+     * Where a container's memory comes from.  The stack owns one resource
+     * of its policy's type, and every allocator it hands out points at it.
+     * heap_policy is what the containers did before there were policies;
+     * pool_policy keeps small allocations off the heap.
+     */
+    struct heap_policy
+    {
+        typedef heap_class resource_type;
+    };
+    
+    struct pool_policy
+    {
+        typedef pool_class resource_type;
+    };
+    
+    /** An allocator for the standard containers that takes its memory
+     from a resource.  Copies of a container keep their own resource. */
+    template<class type, class resource_type>
+    class allocator_class
+    {
+    public:
+        typedef type value_type;
+        typedef std::false_type propagate_on_container_copy_assignment;
+        typedef std::true_type propagate_on_container_move_assignment;
+        typedef std::true_type propagate_on_container_swap;
+        
+        template<class other_type>
+        struct rebind
+        {
+            typedef allocator_class<other_type, resource_type> other;
+        };
+        
+        explicit allocator_class(resource_type* r) : resource(r)
+        {
+        }
+        
+        template<class other_type>
+        allocator_class(const allocator_class<other_type, resource_type>& a) : resource(a.resource)
+        {
+        }
+        
+        type* allocate(const std::size_t& n)
+        {
+            return (type*)this->resource->allocate(n * sizeof(type));
+        }
+        
+        void deallocate(type* p, const std::size_t& n)
+        {
+            this->resource->deallocate(p, (n * sizeof(type)));
+        }
+        
+        template<class other_type>
+        bool operator==(const allocator_class<other_type, resource_type>& a) const
+        {
+            return (this->resource == a.resource);
+        }
+        
+        template<class other_type>
+        bool operator!=(const allocator_class<other_type, resource_type>& a) const
+        {
+            return (this->resource != a.resource);
+        }
+        
+        resource_type* resource;
+        
+    };
+    
+}
+
+#endif
@@ -0,0 +1,187 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2014 Jonathan Craig Whitlock
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+ */
+
+
+#ifndef CHUNK_VECTOR_HPP_INCLUDED
+#define CHUNK_VECTOR_HPP_INCLUDED
+#include <vector>
+#include <memory>
+#include <new>
+#include <cstddef>
+
+namespace chunk_vector
+{
+
+    /**
+     * A vector that grows by adding fixed-size chunks instead of reallocating.
+     * Elements never move once they are added, so growing it never copies
+     * anything, and the cost of a push_back does not depend on the size.
+     */
+    template<class type, std::size_t chunk_bits = 12>
+    class chunk_vector_class
+    {
+    public:
+        static const std::size_t chunk_size = (std::size_t(1) << chunk_bits);
+        
+        /** A read-only view of the elements there were when it was made.
+         Elements never move, so it stays valid while more are added (even
+         by another thread): all it copies is the table of chunks. */
+        class view_class
+        {
+        public:
+            explicit view_class(const std::vector<type*>& c, const std::size_t& n) : chunks(c), count(n)
+            {
+            }
+            
+            const type& operator[](const std::size_t& x) const
+            {
+                return this->chunks[(x >> chunk_bits)][(x & (chunk_size - 1))];
+            }
+            
+            std::size_t size() const
+            {
+                return this->count;
+            }
+            
+        private:
+            std::vector<type*> chunks;
+            std::size_t count;
+            
+        };
+
+        explicit chunk_vector_class() : chunks(), count(0)
+        {
+        }
+
+        chunk_vector_class(const chunk_vector_class<type, chunk_bits>& v) : chunks(), count(0)
+        {
+            this->operator=(v);
+        }
+
+        ~chunk_vector_class()
+        {
+            this->clear();
+        }
+
+        const chunk_vector_class<type, chunk_bits>& operator=(const chunk_vector_class<type, chunk_bits>& v)
+        {
+            if(this != &v)
+            {
+                this->clear();
+                for(std::size_t x = 0; x < v.size(); x++) this->push_back(v[x]);
+            }
+            return *this;
+        }
+
+        type& operator[](const std::size_t& x)
+        {
+            return this->chunks[(x >> chunk_bits)][(x & (chunk_size - 1))];
+        }
+
+        const type& operator[](const std::size_t& x) const
+        {
+            return this->chunks[(x >> chunk_bits)][(x & (chunk_size - 1))];
+        }
+
+        type& back()
+        {
+            return this->operator[](this->count - 1);
+        }
+
+        type& front()
+        {
+            return this->operator[](0);
+        }
+
+        const type& front() const
+        {
+            return this->operator[](0);
+        }
+
+        std::size_t size() const
+        {
+            return this->count;
+        }
+
+        bool empty() const
+        {
+            return (this->count == 0);
+        }
+
+        void push_back(const type& t)
+        {
+            if((this->count >> chunk_bits) == this->chunks.size())
+            {
+                this->chunks.push_back(std::allocator<type>().allocate(chunk_size));
+            }
+            new(&this->operator[](this->count)) type(t);
+            this->count++;
+        }
+
+        /** Removes the last element.  One empty chunk is kept spare, so
+         popping and pushing across a chunk boundary does not thrash. */
+        void pop_back()
+        {
+            this->count--;
+            this->operator[](this->count).~type();
+            if(this->chunks.size() > ((this->count >> chunk_bits) + 1))
+            {
+                std::allocator<type>().deallocate(this->chunks.back(), chunk_size);
+                this->chunks.pop_back();
+            }
+        }
+
+        /** Returns the number of bytes the chunks (and the table of them)
+         take up. */
+        std::size_t bytes() const
+        {
+            return ((this->chunks.size() * chunk_size * sizeof(type)) + (this->chunks.capacity() * sizeof(type*)));
+        }
+        
+        view_class view() const
+        {
+            return view_class(this->chunks, this->count);
+        }
+        
+        /** Destroys every element and releases all of the chunks. */
+        void clear()
+        {
+            for(std::size_t x = 0; x < this->count; x++) this->operator[](x).~type();
+            for(std::size_t x = 0; x < this->chunks.size(); x++)
+            {
+                std::allocator<type>().deallocate(this->chunks[x], chunk_size);
+            }
+            std::vector<type*>().swap(this->chunks);
+            this->count = 0;
+        }
+
+    private:
+        std::vector<type*> chunks;
+        std::size_t count;
+
+    };
+
+}
+
+#endif
@@ -0,0 +1,118 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2014 Jonathan Craig Whitlock
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+ */
+
+
+
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+
+#include "command_reader.hpp"
+
+namespace
+{
+    inline bool is_space(const char& ch)
+    {
+        return ((ch == ' ') || (ch == '\t') || (ch == '\r') || (ch == '\v') || (ch == '\f'));
+    }
+}
+
+namespace command_reader
+{
+    const std::size_t reader_class::default_block;
+    
+    bool reader_class::next_line(std::vector<token_data>& tokens)
+    {
+        const char* newline(nullptr);
+        
+        tokens.clear();
+        this->blocked = false;
+        while(true)
+        {
+            newline = (const char*)std::memchr((this->buffer.data() + this->begin + this->scanned), '\n', 
+                    (this->end - this->begin - this->scanned));
+            if(newline != nullptr) break;
+            this->scanned = (this->end - this->begin);
+            if(!this->fill())
+            {
+                /* The last line does not have to end with a newline. */
+                if(this->blocked || (this->begin == this->end)) return false;
+                newline = (this->buffer.data() + this->end);
+                break;
+            }
+        }
+        
+        const char* pos(this->buffer.data() + this->begin);
+        while(pos < newline)
+        {
+            while((pos < newline) && is_space(*pos)) pos++;
+            if(pos == newline) break;
+            tokens.push_back(token_data());
+            tokens.back().data = pos;
+            while((pos < newline) && !is_space(*pos)) pos++;
+            tokens.back().size = (pos - tokens.back().data);
+        }
+        
+        this->begin = std::min(this->end, (std::size_t)((newline + 1) - this->buffer.data()));
+        this->scanned = 0;
+        return true;
+    }
+    
+    bool reader_class::fill()
+    {
+        if(this->eof) return false;
+        
+        /* Move the unfinished line to the front, and if it fills the whole
+         buffer, make the buffer bigger. */
+        if(this->begin > 0)
+        {
+            std::memmove(this->buffer.data(), (this->buffer.data() + this->begin), (this->end - this->begin));
+            this->end -= this->begin;
+            this->begin = 0;
+        }
+        if(this->end == this->buffer.size()) this->buffer.resize(this->buffer.size() * 2);
+        
+        ssize_t count(0);
+        do
+        {
+            count = ::read(this->fd, (this->buffer.data() + this->end), (this->buffer.size() - this->end));
+        }
+        while((count < 0) && (errno == EINTR));
+        if((count < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK)))
+        {
+            this->blocked = true;
+            return false;
+        }
+        if(count <= 0)
+        {
+            this->eof = true;
+            return false;
+        }
+        this->end += count;
+        return true;
+    }
+    
+}
@@ -0,0 +1,146 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2014 Jonathan Craig Whitlock
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+ */
+
+
+
+#ifndef COMMAND_READER_HPP_INCLUDED
+#define COMMAND_READER_HPP_INCLUDED
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstring>
+
+namespace command_reader
+{
+    
+    /** A word of input.  It points into the reader's buffer instead of
+     owning a copy, so it is only valid until the next line is read. */
+    struct token_data
+    {
+        const char* data = nullptr;
+        std::size_t size = 0;
+        
+        bool operator==(const char* s) const
+        {
+            return ((std::strlen(s) == this->size) && (std::memcmp(s, this->data, this->size) == 0));
+        }
+        
+        bool operator!=(const char* s) const
+        {
+            return !(this->operator==(s));
+        }
+        
+        std::string str() const
+        {
+            return std::string(this->data, this->size);
+        }
+    };
+    
+    /**
+     * Reads commands a line at a time from a file descriptor.  Input is
+     * pulled in large blocks with read(), and each line is split into
+     * tokens in place, so reading a command allocates nothing.  A line that
+     * is cut off by the end of a block is moved to the front of the buffer
+     * and finished by the next read.  The descriptor may be non-blocking, in
+     * which case running out of input is not the end of it (see waiting()).
+     */
+    class reader_class
+    {
+    public:
+        static const std::size_t default_block = (1 << 16);
+        
+        explicit reader_class(const int& f, const std::size_t& block = default_block) : fd(f), 
+                buffer(block), begin(0), end(0), scanned(0), eof(false), 
+                blocked(false)
+        {
+        }
+        
+        /** Reads the next line and splits it into [tokens].  Returns false
+         once the input is exhausted, or if the descriptor is non-blocking and
+         the rest of the line hasn't arrived yet.  Blank lines come back with
+         no tokens. */
+        bool next_line(std::vector<token_data>& tokens);
+        
+        /** Returns true if the last next_line returned false because the input
+         would block, rather than because it ended. */
+        bool waiting() const
+        {
+            return this->blocked;
+        }
+        
+        /** Points [data] at what has been read but not handed out yet, and
+         returns its size.  For input that isn't made of lines. */
+        std::size_t buffered(const char*& data) const
+        {
+            data = (this->buffer.data() + this->begin);
+            return (this->end - this->begin);
+        }
+        
+        /** Reads until at least [n] bytes are buffered.  Returns false if the
+         input ends, or would block, first. */
+        bool need(const std::size_t& n)
+        {
+            this->blocked = false;
+            while((this->end - this->begin) < n)
+            {
+                if(!this->fill()) return false;
+            }
+            return true;
+        }
+        
+        /** Hands out [n] of the buffered bytes. */
+        void skip(const std::size_t& n)
+        {
+            this->begin += n;
+            this->scanned = 0;
+        }
+        
+        /** Returns true if every line that has been read so far has been
+         handed out, meaning the next line will have to wait for input. */
+        bool drained() const
+        {
+            return (std::memchr((this->buffer.data() + this->begin), '\n', (this->end - this->begin)) == nullptr);
+        }
+        
+    private:
+        int fd;
+        std::vector<char> buffer;
+        
+        /* [begin] to [end] is what has been read but not handed out yet;
+         [scanned] is how far past [begin] we know there is no newline. */
+        std::size_t begin;
+        std::size_t end;
+        std::size_t scanned;
+        bool eof;
+        bool blocked;
+        
+        /** Reads another block, making room for it first.  Returns false at
+         the end of the input, or if it would block. */
+        bool fill();
+        
+    };
+    
+}
+
+#endif
@@ -0,0 +1,118 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2014 Jonathan Craig Whitlock
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+ */
+
+
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include "crc32c.hpp"
+
+namespace
+{
+    const std::uint32_t polynomial = 0x82f63b78U;
+    
+    /** Eight tables, so the software version can do eight bytes a step. */
+    struct table_data
+    {
+        std::uint32_t t[8][256];
+        
+        table_data()
+        {
+            for(unsigned int x = 0; x < 256; x++)
+            {
+                std::uint32_t c(x);
+                for(unsigned int y = 0; y < 8; y++) c = ((c & 1) ? ((c >> 1) ^ polynomial) : (c >> 1));
+                this->t[0][x] = c;
+            }
+            for(unsigned int x = 0; x < 256; x++)
+            {
+                for(unsigned int y = 1; y < 8; y++)
+                {
+                    this->t[y][x] = ((this->t[(y - 1)][x] >> 8) ^ this->t[0][(this->t[(y - 1)][x] & 0xff)]);
+                }
+            }
+        }
+    };
+    
+    std::uint32_t software_crc(const unsigned char* p, std::size_t size, std::uint32_t crc)
+    {
+        static const table_data table;
+        const std::uint32_t (*t)[256](table.t);
+        
+        while(size >= 8)
+        {
+            std::uint32_t low(0), high(0);
+            std::memcpy(&low, p, 4);
+            std::memcpy(&high, (p + 4), 4);
+            low ^= crc;
+            crc = (t[7][(low & 0xff)] ^ t[6][((low >> 8) & 0xff)] ^ t[5][((low >> 16) & 0xff)] ^ t[4][(low >> 24)] ^ 
+                    t[3][(high & 0xff)] ^ t[2][((high >> 8) & 0xff)] ^ t[1][((high >> 16) & 0xff)] ^ t[0][(high >> 24)]);
+            p += 8;
+            size -= 8;
+        }
+        while(size-- > 0) crc = ((crc >> 8) ^ t[0][((crc ^ *p++) & 0xff)]);
+        return crc;
+    }
+    
+#if defined(__GNUC__) && defined(__x86_64__)
+    __attribute__((target("sse4.2"))) std::uint32_t hardware_crc(const unsigned char* p, std::size_t size, 
+            std::uint32_t crc)
+    {
+        std::uint64_t c(crc);
+        while(size >= 8)
+        {
+            std::uint64_t word(0);
+            std::memcpy(&word, p, 8);
+            c = __builtin_ia32_crc32di(c, word);
+            p += 8;
+            size -= 8;
+        }
+        crc = (std::uint32_t)c;
+        while(size-- > 0) crc = __builtin_ia32_crc32qi(crc, *p++);
+        return crc;
+    }
+    
+    bool has_hardware_crc()
+    {
+        static const bool has(__builtin_cpu_supports("sse4.2"));
+        return has;
+    }
+#endif
+}
+
+namespace checksum
+{
+    std::uint32_t crc32c(const void* data, std::size_t size, std::uint32_t crc)
+    {
+        const unsigned char* p((const unsigned char*)data);
+        
+        crc = ~crc;
+#if defined(__GNUC__) && defined(__x86_64__)
+        if(has_hardware_crc()) return ~hardware_crc(p, size, crc);
+#endif
+        return ~software_crc(p, size, crc);
+    }
+}
@@ -0,0 +1,210 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2014 Jonathan Craig Whitlock
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+ */
+
+
+#ifndef EPOCH_HPP_INCLUDED
+#define EPOCH_HPP_INCLUDED
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <cstddef>
+
+namespace epoch
+{
+    /**
+     * Epoch-based reclamation.  A thread that reads shared memory without a
+     * lock announces the epoch it started in; memory such a reader could be
+     * looking at is retired instead of freed, and only freed once every
+     * reader that was running when it was retired has finished.
+     */
+    class domain_class
+    {
+    public:
+        static const std::size_t max_readers = 1024;
+        static const std::size_t no_slot = max_readers;
+        
+        explicit domain_class() : epoch(1), slots(), taken(), readers(0), lock(), retired(), pending(0)
+        {
+        }
+        
+        domain_class(const domain_class&) = delete;
+        domain_class& operator=(const domain_class&) = delete;
+        
+        /** Takes a reader slot for a thread.  Returns no_slot if they are
+         all taken. */
+        std::size_t acquire_slot()
+        {
+            for(std::size_t x = 0; x < max_readers; x++)
+            {
+                bool expected(false);
+                if(!this->taken[x].load(std::memory_order_relaxed) && this->taken[x].compare_exchange_strong(expected, true))
+                {
+                    std::size_t seen(this->readers.load());
+                    while((seen < (x + 1)) && !this->readers.compare_exchange_weak(seen, (x + 1)));
+                    return x;
+                }
+            }
+            return no_slot;
+        }
+        
+        void release_slot(const std::size_t& x)
+        {
+            this->taken[x].store(false, std::memory_order_release);
+        }
+        
+        /** Marks the reader in slot [x] as reading.  Whatever it loads after
+         this is safe to look at until it calls leave(). */
+        void enter(const std::size_t& x)
+        {
+            this->slots[x].store(this->epoch.load());
+        }
+        
+        void leave(const std::size_t& x)
+        {
+            this->slots[x].store(0, std::memory_order_release);
+        }
+        
+        /** Frees [memory] with [release] once no reader can be looking at it.
+         Readers that start from now on must not be able to reach it. */
+        void retire(void* memory, void (*release)(void*))
+        {
+            std::lock_guard<std::mutex> hold(this->lock);
+            this->retired.push_back(retired_data{this->epoch.fetch_add(1), memory, release});
+            this->collect_locked();
+        }
+        
+        /** Frees whatever has been retired that no reader can still see. */
+        void collect()
+        {
+            if(this->pending.load(std::memory_order_relaxed) == 0) return;
+            std::lock_guard<std::mutex> hold(this->lock);
+            this->collect_locked();
+        }
+        
+    private:
+        struct retired_data
+        {
+            unsigned long long epoch;
+            void* memory;
+            void (*release)(void*);
+        };
+        
+        /* Each slot holds the epoch its reader started in, or 0 while it is
+         not reading.  [readers] is one past the highest slot ever taken. */
+        std::atomic<unsigned long long> epoch;
+        std::atomic<unsigned long long> slots[max_readers];
+        std::atomic<bool> taken[max_readers];
+        std::atomic<std::size_t> readers;
+        
+        std::mutex lock;
+        std::vector<retired_data> retired;
+        std::atomic<std::size_t> pending;
+        
+        /** Memory retired in epoch e can only be seen by readers that
+         started in e or before. */
+        void collect_locked()
+        {
+            unsigned long long oldest(~0ULL);
+            std::size_t kept(0);
+            
+            for(std::size_t x = 0; x < this->readers.load(); x++)
+            {
+                unsigned long long e(this->slots[x].load());
+                if((e != 0) && (e < oldest)) oldest = e;
+            }
+            for(std::size_t x = 0; x < this->retired.size(); x++)
+            {
+                if(this->retired[x].epoch < oldest) this->retired[x].release(this->retired[x].memory);
+                else this->retired[kept++] = this->retired[x];
+            }
+            this->retired.resize(kept);
+            this->pending.store(kept, std::memory_order_relaxed);
+        }
+        
+    };
+    
+    /** Returns the domain every lock-free reader in the program uses.  It is
+     never destroyed, so objects that outlive main can still retire memory. */
+    inline domain_class& domain()
+    {
+        static domain_class* d(new domain_class());
+        return *d;
+    }
+    
+    /** A thread's reader slot, taken the first time it reads and given back
+     when it exits. */
+    struct reader_data
+    {
+        reader_data() : slot(domain().acquire_slot()), depth(0)
+        {
+        }
+        
+        ~reader_data()
+        {
+            if(this->slot != domain_class::no_slot) domain().release_slot(this->slot);
+        }
+        
+        std::size_t slot;
+        unsigned int depth;
+    };
+    
+    inline reader_data& this_reader()
+    {
+        static thread_local reader_data r;
+        return r;
+    }
+    
+    /** Marks the calling thread as reading for as long as it exists.
+     Guards may be nested. */
+    class guard_class
+    {
+    public:
+        explicit guard_class() : reader(this_reader())
+        {
+            if(this->entered() && (this->reader.depth++ == 0)) domain().enter(this->reader.slot);
+        }
+        
+        ~guard_class()
+        {
+            if(this->entered() && (--this->reader.depth == 0)) domain().leave(this->reader.slot);
+        }
+        
+        guard_class(const guard_class&) = delete;
+        guard_class& operator=(const guard_class&) = delete;
+        
+        /** Returns false if there was no slot left for this thread, in which
+         case it must not read anything without a lock. */
+        bool entered() const
+        {
+            return (this->reader.slot != domain_class::no_slot);
+        }
+        
+    private:
+        reader_data& reader;
+        
+    };
+    
+}
+
+#endif
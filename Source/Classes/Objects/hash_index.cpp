@@ -0,0 +1,164 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2014 Jonathan Craig Whitlock
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+ */
+
+
+#include <utility>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#include "hash_index.hpp"
+
+namespace
+{
+}
+
+namespace hash_index
+{
+    const std::uint32_t index_class::npos;
+    const std::size_t index_class::default_step;
+    const std::size_t index_class::min_capacity;
+    const std::size_t index_class::max_load_num;
+    const std::size_t index_class::max_load_den;
+    const unsigned int index_class::max_distance;
+    const std::size_t index_class::slot_size;
+
+    void index_class::clear()
+    {
+        this->current.release();
+        this->previous.release();
+        this->cursor = 0;
+    }
+
+    index_stats_data index_class::stats() const
+    {
+        index_stats_data data;
+        data.size = this->size();
+        data.capacity = this->capacity();
+        if(this->migrating())
+        {
+            data.migrating = this->previous.cap;
+            data.migrated = this->cursor;
+        }
+        data.step = this->step;
+        data.migrations = this->migrations;
+        return data;
+    }
+
+    const index_class::table_data& index_class::table_data::operator=(const table_data& t)
+    {
+        if(this != &t)
+        {
+            this->allocate(t.cap);
+            if(t.cap > 0)
+            {
+                std::memcpy(this->meta, t.meta, (t.cap * sizeof(std::uint16_t)));
+                std::memcpy(this->pos, t.pos, (t.cap * sizeof(std::uint32_t)));
+            }
+            this->count = t.count;
+        }
+        return *this;
+    }
+
+    void index_class::table_data::swap(table_data& t)
+    {
+        std::swap(this->meta, t.meta);
+        std::swap(this->pos, t.pos);
+        std::swap(this->cap, t.cap);
+        std::swap(this->mask, t.mask);
+        std::swap(this->count, t.count);
+    }
+
+    void index_class::table_data::allocate(const std::size_t& cap)
+    {
+        this->release();
+        if(cap > 0)
+        {
+            this->meta = (std::uint16_t*)std::calloc(cap, sizeof(std::uint16_t));
+            this->pos = (std::uint32_t*)std::calloc(cap, sizeof(std::uint32_t));
+            if((this->meta == nullptr) || (this->pos == nullptr))
+            {
+                this->release();
+                throw std::bad_alloc();
+            }
+        }
+        this->cap = cap;
+        this->mask = (cap - 1);
+        this->count = 0;
+    }
+
+    void index_class::table_data::release()
+    {
+        std::free(this->meta);
+        std::free(this->pos);
+        this->meta = nullptr;
+        this->pos = nullptr;
+        this->cap = 0;
+        this->mask = 0;
+        this->count = 0;
+    }
+
+    void index_class::table_data::remove_slot(std::size_t loc)
+    {
+        std::size_t next((loc + 1) & this->mask);
+
+        if(this->pos[loc] != npos) this->count--;
+        while(this->distance(next) > 1)
+        {
+            this->meta[loc] = (std::uint16_t)(this->meta[next] - 1);
+            this->pos[loc] = this->pos[next];
+            loc = next;
+            next = ((next + 1) & this->mask);
+        }
+        this->meta[loc] = 0;
+    }
+
+    void index_class::table_data::bury(const std::size_t& loc)
+    {
+        this->pos[loc] = npos;
+        this->count--;
+    }
+
+    bool index_class::table_data::relocate(const std::uint64_t& hash, const std::uint32_t& from,
+            const std::uint32_t& to)
+    {
+        if(this->cap == 0) return false;
+
+        std::uint16_t tag(tag_of(hash));
+        std::size_t loc(hash & this->mask);
+        for(unsigned int dist = 1; dist <= this->distance(loc); dist++)
+        {
+            if((this->pos[loc] == from) && (this->meta[loc] == (tag | dist)))
+            {
+                this->pos[loc] = to;
+                return true;
+            }
+            loc = ((loc + 1) & this->mask);
+        }
+        return false;
+    }
+
+
+}
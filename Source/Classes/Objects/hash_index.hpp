@@ -0,0 +1,523 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2014 Jonathan Craig Whitlock
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+ */
+
+
+#ifndef HASH_INDEX_HPP_INCLUDED
+#define HASH_INDEX_HPP_INCLUDED
+#include <string>
+#include <cstddef>
+#include <cstring>
+#include <cstdint>
+#include <utility>
+
+namespace hash_index
+{
+    /** Hashes a run of bytes.  Eight bytes are mixed at a time, so long
+     keys cost about a multiply per word. */
+    inline std::uint64_t hash_bytes(const char* data, const std::size_t& size)
+    {
+        const std::uint64_t mul(0x9e3779b97f4a7c15ULL);
+        std::uint64_t h(0xcbf29ce484222325ULL ^ (size * mul));
+        std::uint64_t word(0);
+        std::size_t x(0);
+        for(; (x + 8) <= size; x += 8)
+        {
+            std::memcpy(&word, (data + x), 8);
+            h = ((h ^ word) * mul);
+            h ^= (h >> 29);
+        }
+        word = 0;
+        if(x < size) std::memcpy(&word, (data + x), (size - x));
+        h = ((h ^ word) * mul);
+        h ^= (h >> 32);
+        h *= 0xd6e8feb86659fd93ULL;
+        h ^= (h >> 32);
+        return h;
+    }
+
+    inline std::uint64_t hash_bytes(const std::string& s)
+    {
+        return hash_bytes(s.data(), s.size());
+    }
+
+    /** Mixes an integer so that sequential values spread over the table. */
+    inline std::uint64_t hash_int(const std::uint64_t& i)
+    {
+        std::uint64_t h(i);
+        h ^= (h >> 33);
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= (h >> 33);
+        h *= 0xc4ceb9fe1a85ec53ULL;
+        h ^= (h >> 33);
+        return h;
+    }
+
+    /** Hashes a value stored in the database. */
+    inline std::uint64_t hash_value(const int& i)
+    {
+        return hash_int((std::uint64_t)(long long)i);
+    }
+    
+    inline std::uint64_t hash_value(const long long& i)
+    {
+        return hash_int((std::uint64_t)i);
+    }
+    
+    inline std::uint64_t hash_value(const std::string& s)
+    {
+        return hash_bytes(s);
+    }
+    
+    /** Anything else hashes itself. */
+    template<class type>
+    inline std::uint64_t hash_value(const type& t)
+    {
+        return t.hash();
+    }
+
+    /** Describes the state of an index, for reporting. */
+    struct index_stats_data
+    {
+        std::size_t size = 0;
+        std::size_t capacity = 0;
+        
+        /* While the index is growing, [migrated] of the [migrating] slots in
+         the old table have been moved into the new one. */
+        std::size_t migrating = 0;
+        std::size_t migrated = 0;
+        std::size_t step = 0;
+        unsigned long long migrations = 0;
+    };
+    
+    /**
+     * Open-addressing (Robin Hood) index.  It does not own any keys: it maps
+     * a hash to the position of an entry that is stored somewhere else (usually
+     * a dense vector), and asks the caller to compare keys through a functor
+     * that takes that position.  A slot is six bytes: the position, and two
+     * bytes of metadata holding the probe distance + 1 (0 meaning empty) and
+     * an 8-bit tag from the top of the hash, so most mismatches are rejected
+     * without touching the entry at all.
+     * 
+     * The full hash is not kept, so anything that moves keys to another table
+     * asks for it again through a [rehash] functor that takes a position.
+     * Its prefetch(position) starts fetching whatever hashing will need, so
+     * migrating a batch of keys waits on memory once instead of per key.
+     * 
+     * The index grows incrementally: when it fills up a table twice the size
+     * is allocated, and every insert or erase afterwards moves at most
+     * [step] slots of the old table into it.  Until that's done, lookups
+     * check both tables.
+     */
+    class index_class
+    {
+    public:
+        static const std::uint32_t npos = 0xffffffffU;
+        
+        /** The default maximum number of old slots migrated per operation. */
+        static const std::size_t default_step = 64;
+
+        explicit index_class() : current(), previous(), cursor(0), step(default_step),
+                migrations(0)
+        {
+        }
+
+        /** Returns the position stored for the key, or npos. */
+        template<class equal_type>
+        std::uint32_t find(const std::uint64_t& hash, const equal_type& equal) const
+        {
+            std::size_t loc(0);
+            if(this->current.find(hash, equal, loc)) return this->current.pos[loc];
+            if(this->migrating() && this->previous.find(hash, equal, loc))
+            {
+                return this->previous.pos[loc];
+            }
+            return npos;
+        }
+
+        /** Returns the position stored for the key.  If the key is not in the
+         index, [pos] is stored for it and npos is returned.  This only probes
+         each table once. */
+        template<class equal_type, class rehash_type>
+        std::uint32_t find_or_insert(const std::uint64_t& hash, const equal_type& equal,
+                const std::uint32_t& pos, const rehash_type& rehash)
+        {
+            std::size_t loc(0);
+            unsigned int dist(0);
+            
+            if((this->current.cap == 0)) this->current.allocate(min_capacity);
+            if(this->migrating())
+            {
+                if(this->previous.find(hash, equal, loc)) return this->previous.pos[loc];
+                this->migrate(this->step, rehash);
+            }
+            if(this->current.find(hash, equal, loc, dist)) return this->current.pos[loc];
+
+            /* The key is missing, and [loc] is where it belongs.  If the table
+             is full we start growing first, which means probing again. */
+            if(this->current.over_loaded(this->current.count + 1))
+            {
+                this->grow(rehash);
+                this->current.insert(hash, pos, rehash);
+            }
+            else this->current.place(loc, dist, tag_of(hash), pos, rehash);
+            return npos;
+        }
+
+        /** Adds a position to the index.  The key must not already exist. */
+        template<class rehash_type>
+        void insert(const std::uint64_t& hash, const std::uint32_t& pos, const rehash_type& rehash)
+        {
+            if((this->current.cap == 0)) this->current.allocate(min_capacity);
+            if(this->migrating()) this->migrate(this->step, rehash);
+            if(this->current.over_loaded(this->current.count + 1)) this->grow(rehash);
+            this->current.insert(hash, pos, rehash);
+        }
+
+        /** Removes a key from the index, and returns the position that was
+         stored for it (npos if it was not found). */
+        template<class equal_type, class rehash_type>
+        std::uint32_t erase(const std::uint64_t& hash, const equal_type& equal, const rehash_type& rehash)
+        {
+            std::size_t loc(0);
+            std::uint32_t pos(npos);
+            
+            if(this->current.find(hash, equal, loc))
+            {
+                pos = this->current.pos[loc];
+                this->current.remove_slot(loc);
+            }
+            else if(this->migrating() && this->previous.find(hash, equal, loc))
+            {
+                /* Slots in the old table are never moved while it is being
+                 migrated, so the slot becomes a tombstone instead. */
+                pos = this->previous.pos[loc];
+                this->previous.bury(loc);
+            }
+            if(this->migrating()) this->migrate(this->step, rehash);
+            return pos;
+        }
+
+        /** Changes the position stored for a key from [from] to [to].  Used
+         when an entry is moved inside the storage the index points into. */
+        void relocate(const std::uint64_t& hash, const std::uint32_t& from, const std::uint32_t& to)
+        {
+            if(!this->current.relocate(hash, from, to) && this->migrating())
+            {
+                this->previous.relocate(hash, from, to);
+            }
+        }
+
+        /** Starts fetching the slots a key with this hash would be looked for
+         in, so a batch of keys can wait on memory together. */
+        void prefetch(const std::uint64_t& hash) const
+        {
+            if(this->current.cap == 0) return;
+            __builtin_prefetch(&this->current.meta[(hash & this->current.mask)]);
+            __builtin_prefetch(&this->current.pos[(hash & this->current.mask)]);
+        }
+        
+        /** Makes room for [n] keys without growing. */
+        template<class rehash_type>
+        void reserve(const std::size_t& n, const rehash_type& rehash)
+        {
+            std::size_t cap(min_capacity);
+            while(((cap * max_load_num) / max_load_den) < n) cap *= 2;
+            if(cap > this->current.cap)
+            {
+                /* Reserving is done up front, so it is allowed to rehash in one go. */
+                this->migrate(0, rehash);
+                table_data old;
+                old.swap(this->current);
+                this->current.allocate(cap);
+                this->current.insert_all(old, rehash);
+            }
+        }
+
+        /** Removes everything and releases the table's memory. */
+        void clear();
+
+        /** Returns the number of keys in the index. */
+        std::size_t size() const
+        {
+            return (this->current.count + this->previous.count);
+        }
+
+        /** Returns the number of slots in the table. */
+        std::size_t capacity() const
+        {
+            return this->current.cap;
+        }
+        
+        /** Returns the number of bytes the tables take up. */
+        std::size_t bytes() const
+        {
+            return ((this->current.cap + this->previous.cap) * slot_size);
+        }
+        
+        /** Sets the maximum number of old slots an operation migrates while
+         the index is growing.  0 means "finish the migration in one go". */
+        void set_step(const std::size_t& n)
+        {
+            this->step = n;
+        }
+        
+        std::size_t get_step() const
+        {
+            return this->step;
+        }
+        
+        index_stats_data stats() const;
+
+    private:
+        static const std::size_t slot_size = (sizeof(std::uint16_t) + sizeof(std::uint32_t));
+        
+        /** Returns the tag for a hash, already shifted into the high byte of
+         the metadata. */
+        static std::uint16_t tag_of(const std::uint64_t& hash)
+        {
+            return (std::uint16_t)((hash >> 48) & 0xff00);
+        }
+        
+        /** One open-addressing table.  The arrays come from calloc, so a big
+         new table costs nothing until its pages are actually used. */
+        struct table_data
+        {
+            std::uint16_t* meta = nullptr;
+            std::uint32_t* pos = nullptr;
+            std::size_t cap = 0;
+            std::size_t mask = 0;
+            
+            /* live slots; tombstones are not counted. */
+            std::size_t count = 0;
+            
+            table_data()
+            {
+            }
+            
+            table_data(const table_data& t)
+            {
+                this->operator=(t);
+            }
+            
+            ~table_data()
+            {
+                this->release();
+            }
+            
+            const table_data& operator=(const table_data&);
+            void swap(table_data&);
+            
+            unsigned int distance(const std::size_t& loc) const
+            {
+                return (this->meta[loc] & 0xff);
+            }
+            
+            /** Looks for a key.  If it is found, [loc] is its slot; otherwise
+             [loc] and [dist] are where it would have to be placed. */
+            template<class equal_type>
+            bool find(const std::uint64_t& hash, const equal_type& equal, std::size_t& loc,
+                    unsigned int& dist) const
+            {
+                std::uint16_t tag(tag_of(hash));
+                
+                dist = 1;
+                loc = (hash & this->mask);
+                if(this->cap == 0) return false;
+                for(; dist <= this->distance(loc); dist++)
+                {
+                    if((this->meta[loc] == (tag | dist)) && (this->pos[loc] != npos) &&
+                            equal(this->pos[loc]))
+                    {
+                        return true;
+                    }
+                    loc = ((loc + 1) & this->mask);
+                }
+                return false;
+            }
+            
+            template<class equal_type>
+            bool find(const std::uint64_t& hash, const equal_type& equal, std::size_t& loc) const
+            {
+                unsigned int dist(0);
+                return this->find(hash, equal, loc, dist);
+            }
+            
+            bool over_loaded(const std::size_t& n) const
+            {
+                return ((n * max_load_den) > (this->cap * max_load_num));
+            }
+            
+            template<class rehash_type>
+            void insert(const std::uint64_t& hash, const std::uint32_t& p, const rehash_type& rehash)
+            {
+                std::size_t loc(hash & this->mask);
+                unsigned int dist(1);
+                while(dist <= this->distance(loc))
+                {
+                    loc = ((loc + 1) & this->mask);
+                    dist++;
+                }
+                this->place(loc, dist, tag_of(hash), p, rehash);
+            }
+            
+            /** Inserts every live slot of another table. */
+            template<class rehash_type>
+            void insert_all(const table_data& old, const rehash_type& rehash)
+            {
+                for(std::size_t x = 0; x < old.cap; x++)
+                {
+                    if((old.meta[x] != 0) && (old.pos[x] != npos))
+                    {
+                        this->insert(rehash(old.pos[x]), old.pos[x], rehash);
+                    }
+                }
+            }
+            
+            template<class rehash_type>
+            void place(std::size_t loc, unsigned int dist, std::uint16_t tag, std::uint32_t p,
+                    const rehash_type& rehash)
+            {
+                while(this->meta[loc] != 0)
+                {
+                    if(this->distance(loc) < dist)
+                    {
+                        /* Robin Hood: the resident is closer to home than we are, so
+                         it gives up the slot and we carry it forward instead. */
+                        unsigned int tempd(this->distance(loc));
+                        std::uint16_t tempt(this->meta[loc] & 0xff00);
+                        std::swap(this->pos[loc], p);
+                        this->meta[loc] = (std::uint16_t)(tag | dist);
+                        dist = tempd;
+                        tag = tempt;
+                    }
+                    loc = ((loc + 1) & this->mask);
+                    dist++;
+                    if(dist >= max_distance)
+                    {
+                        /* Only a terrible run of hashes gets here, so this table is
+                         simply rebuilt at twice the size, in one go. */
+                        table_data old;
+                        old.swap(*this);
+                        this->allocate(old.cap * 2);
+                        this->insert_all(old, rehash);
+                        if(p != npos) this->insert(rehash(p), p, rehash);
+                        return;
+                    }
+                }
+                this->meta[loc] = (std::uint16_t)(tag | dist);
+                this->pos[loc] = p;
+                if(p != npos) this->count++;
+            }
+            
+            void allocate(const std::size_t& cap);
+            void release();
+            void remove_slot(std::size_t loc);
+            void bury(const std::size_t& loc);
+            bool relocate(const std::uint64_t& hash, const std::uint32_t& from, const std::uint32_t& to);
+        };
+
+        static const std::size_t min_capacity = 16;
+        static const std::size_t max_load_num = 7;
+        static const std::size_t max_load_den = 8;
+
+        /* Probe distances are stored in a byte, so a probe sequence that gets
+         this long forces the table to grow no matter the load. */
+        static const unsigned int max_distance = 255;
+
+        /* [previous] is the table being migrated away from; [cursor] is the
+         first of its slots that has not been moved yet. */
+        table_data current;
+        table_data previous;
+        std::size_t cursor;
+        std::size_t step;
+        unsigned long long migrations;
+        
+        bool migrating() const
+        {
+            return (this->previous.cap != 0);
+        }
+        
+        /** Starts moving everything into a table twice the size. */
+        template<class rehash_type>
+        void grow(const rehash_type& rehash)
+        {
+            /* If the last migration has not finished yet (which only happens with
+             a very small step), it has to be finished now. */
+            if(this->migrating()) this->migrate(0, rehash);
+
+            this->previous.swap(this->current);
+            this->current.allocate(this->previous.cap * 2);
+            this->cursor = 0;
+            this->migrations++;
+        }
+        
+        /** Moves up to [n] slots of the old table into the current one. */
+        template<class rehash_type>
+        void migrate(std::size_t n, const rehash_type& rehash)
+        {
+            std::size_t size(this->previous.cap);
+
+            if((n == 0) || (n > (size - this->cursor))) n = (size - this->cursor);
+            
+            /* The keys are hashed a batch at a time before any is inserted, so
+             that the cache misses of fetching them overlap. */
+            const std::size_t batch(16);
+            std::uint64_t hashes[batch];
+            for(std::size_t end = (this->cursor + n); this->cursor < end;)
+            {
+                std::size_t first(this->cursor), last(((end - first) < batch) ? end : (first + batch));
+                for(std::size_t x = first; x < last; x++)
+                {
+                    if((this->previous.meta[x] != 0) && (this->previous.pos[x] != npos))
+                    {
+                        rehash.prefetch(this->previous.pos[x]);
+                    }
+                }
+                for(std::size_t x = first; x < last; x++)
+                {
+                    if((this->previous.meta[x] != 0) && (this->previous.pos[x] != npos))
+                    {
+                        hashes[(x - first)] = rehash(this->previous.pos[x]);
+                    }
+                }
+                for(; this->cursor < last; this->cursor++)
+                {
+                    if((this->previous.meta[this->cursor] != 0) && (this->previous.pos[this->cursor] != npos))
+                    {
+                        this->current.insert(hashes[(this->cursor - first)], this->previous.pos[this->cursor], rehash);
+                        this->previous.bury(this->cursor);
+                    }
+                }
+            }
+            if(this->cursor == size)
+            {
+                this->previous.release();
+                this->cursor = 0;
+            }
+        }
+
+    };
+}
+
+#endif
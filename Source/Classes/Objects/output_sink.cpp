@@ -0,0 +1,130 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2014 Jonathan Craig Whitlock
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+ */
+
+
+
+#include <cerrno>
+#include <unistd.h>
+
+#include "output_sink.hpp"
+
+namespace
+{
+}
+
+namespace output_sink
+{
+    const std::size_t sink_class::default_size;
+    
+    void sink_class::put(const unsigned long long& n)
+    {
+        char digits[20];
+        unsigned int count(0);
+        unsigned long long temp(n);
+        
+        do
+        {
+            digits[(sizeof(digits) - 1) - count++] = (char)('0' + (temp % 10));
+            temp /= 10;
+        }
+        while(temp > 0);
+        this->put((digits + (sizeof(digits) - count)), count);
+    }
+    
+    void sink_class::put(const long long& n)
+    {
+        if(n < 0)
+        {
+            this->put('-');
+            
+            /* Negated as unsigned, so the smallest long long works too. */
+            this->put((unsigned long long)(0ULL - (unsigned long long)n));
+        }
+        else this->put((unsigned long long)n);
+    }
+    
+    void sink_class::flush()
+    {
+        if(this->used > 0)
+        {
+            this->write_out(this->buffer.data(), this->used);
+            this->used = 0;
+        }
+    }
+    
+    void sink_class::write_out(const char* data, std::size_t size)
+    {
+        if(this->before_write) this->before_write();
+        if(this->backed_up())
+        {
+            /* This has to go out after what is already waiting. */
+            this->backlog.insert(this->backlog.end(), data, (data + size));
+            this->retry();
+            return;
+        }
+        
+        std::size_t sent(this->send(data, size));
+        if(sent < size)
+        {
+            this->backlog.assign((data + sent), (data + size));
+            this->backlog_start = 0;
+        }
+    }
+    
+    bool sink_class::retry()
+    {
+        if(this->backed_up())
+        {
+            this->backlog_start += this->send((this->backlog.data() + this->backlog_start), this->backlog_size());
+            if(!this->backed_up())
+            {
+                this->backlog.clear();
+                this->backlog_start = 0;
+            }
+        }
+        return !this->backed_up();
+    }
+    
+    std::size_t sink_class::send(const char* data, std::size_t size)
+    {
+        std::size_t sent(0);
+        while(sent < size)
+        {
+            ssize_t count(::write(this->fd, (data + sent), (size - sent)));
+            if(count < 0)
+            {
+                if(errno == EINTR) continue;
+                if((errno == EAGAIN) || (errno == EWOULDBLOCK)) break;
+                
+                /* Nobody is reading the output anymore; there's nothing
+                 useful to do with it. */
+                this->failed = true;
+                return size;
+            }
+            sent += count;
+        }
+        return sent;
+    }
+    
+}
@@ -0,0 +1,194 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2014 Jonathan Craig Whitlock
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+ */
+
+
+
+#ifndef OUTPUT_SINK_HPP_INCLUDED
+#define OUTPUT_SINK_HPP_INCLUDED
+#include <string>
+#include <vector>
+#include <functional>
+#include <cstddef>
+#include <cstring>
+
+namespace output_sink
+{
+    
+    /** When the output that has been collected gets written. */
+    enum flush_policy
+    {
+        /* after every command. */
+        interactive = 0,
+        
+        /* when there are no more commands waiting to be read, so a batch
+         of piped commands gets one write, but whoever sent it still gets
+         the answers before we wait for more. */
+        pipelined = 1,
+        
+        /* only when the buffer is full (and at exit). */
+        bulk = 2
+    };
+    
+    /**
+     * Collects output in a buffer that is re-used, and writes it to a file
+     * descriptor with one write() per batch.  Numbers are formatted straight
+     * into the buffer, so producing a result allocates nothing.  If the
+     * descriptor is non-blocking, whatever it won't take is kept in a
+     * backlog until retry() gets it out.
+     */
+    class sink_class
+    {
+    public:
+        static const std::size_t default_size = (1 << 16);
+        
+        explicit sink_class(const int& f, const flush_policy& p = pipelined, 
+                const std::size_t& size = default_size) : fd(f), policy(p), buffer(size), used(0), 
+                failed(false), before_write(), 
+                backlog(), backlog_start(0)
+        {
+        }
+        
+        ~sink_class()
+        {
+            this->flush();
+        }
+        
+        void put(const char* data, const std::size_t& size)
+        {
+            if((this->used + size) > this->buffer.size())
+            {
+                this->flush();
+                if(size > this->buffer.size())
+                {
+                    this->write_out(data, size);
+                    return;
+                }
+            }
+            std::memcpy((this->buffer.data() + this->used), data, size);
+            this->used += size;
+        }
+        
+        void put(const char& ch)
+        {
+            if(this->used == this->buffer.size()) this->flush();
+            this->buffer[this->used++] = ch;
+        }
+        
+        void put(const char* s)
+        {
+            this->put(s, std::strlen(s));
+        }
+        
+        void put(const std::string& s)
+        {
+            this->put(s.data(), s.size());
+        }
+        
+        void put(const unsigned long long& n);
+        void put(const long long& n);
+        
+        void put(const int& n)
+        {
+            this->put((long long)n);
+        }
+        
+        void put(const unsigned int& n)
+        {
+            this->put((unsigned long long)n);
+        }
+        
+        void put(const unsigned long& n)
+        {
+            this->put((unsigned long long)n);
+        }
+        
+        /** Writes out everything that has been collected. */
+        void flush();
+        
+        /** Called after every command, with whether the input has run dry;
+         flushes if the policy says so. */
+        void command_done(const bool& drained)
+        {
+            if((this->policy == interactive) || ((this->policy == pipelined) && drained)) this->flush();
+        }
+        
+        void set_policy(const flush_policy& p)
+        {
+            this->policy = p;
+        }
+        
+        flush_policy get_policy() const
+        {
+            return this->policy;
+        }
+        
+        /** Sets a function that is called before anything is written, so
+         whatever the output acknowledges can be made durable first. */
+        void set_before_write(const std::function<void()>& f)
+        {
+            this->before_write = f;
+        }
+        
+        /** Writes as much of the backlog as the descriptor takes.  Returns
+         true once there is none left. */
+        bool retry();
+        
+        /** Returns true if there is output the descriptor would not take yet. */
+        bool backed_up() const
+        {
+            return (this->backlog_start < this->backlog.size());
+        }
+        
+        std::size_t backlog_size() const
+        {
+            return (this->backlog.size() - this->backlog_start);
+        }
+        
+        /** Returns false if a write has failed. */
+        bool good() const
+        {
+            return !this->failed;
+        }
+        
+    private:
+        int fd;
+        flush_policy policy;
+        std::vector<char> buffer;
+        std::size_t used;
+        bool failed;
+        std::function<void()> before_write;
+        
+        /* Output that was not written yet because the descriptor would have
+         blocked; it starts at [backlog_start]. */
+        std::vector<char> backlog;
+        std::size_t backlog_start;
+        
+        void write_out(const char*, std::size_t);
+        std::size_t send(const char*, std::size_t);
+        
+    };
+    
+}
+
+#endif
@@ -0,0 +1,424 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2014 Jonathan Craig Whitlock
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+ */
+
+
+
+#ifndef PERSISTENT_MAP_HPP_INCLUDED
+#define PERSISTENT_MAP_HPP_INCLUDED
+#include <atomic>
+#include <new>
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+
+namespace persistent_map
+{
+    /**
+     * A node of the trie.  The entries follow it in the same allocation:
+     * child pointers in an inner node, values in a leaf.  Only the entries
+     * whose bit is set in [bitmap] are stored, in order.  [refs] counts the
+     * maps and snapshots (or parent nodes) that share the node; while it is
+     * 1 the node belongs to one map, which may change it in place.
+     */
+    struct alignas(8) node_data
+    {
+        std::atomic<std::uint32_t> refs;
+        std::uint32_t bitmap;
+        std::uint32_t capacity;
+        bool leaf;
+    };
+    
+    /** A consistent, read-only view of a map as it was when it was taken.
+     It can be read from any thread while the map goes on changing. */
+    template<class type>
+    class snapshot_class
+    {
+    public:
+        explicit snapshot_class() : root(nullptr), shift(0), count(0)
+        {
+        }
+        
+        snapshot_class(node_data* r, const unsigned int& s, const std::size_t& c) : root(r), shift(s), count(c)
+        {
+            if(this->root != nullptr) this->root->refs.fetch_add(1, std::memory_order_relaxed);
+        }
+        
+        snapshot_class(const snapshot_class<type>& s) : snapshot_class(s.root, s.shift, s.count)
+        {
+        }
+        
+        ~snapshot_class()
+        {
+            release(this->root);
+        }
+        
+        const snapshot_class<type>& operator=(const snapshot_class<type>& s)
+        {
+            if(this != &s)
+            {
+                if(s.root != nullptr) s.root->refs.fetch_add(1, std::memory_order_relaxed);
+                release(this->root);
+                this->root = s.root;
+                this->shift = s.shift;
+                this->count = s.count;
+            }
+            return *this;
+        }
+        
+        std::size_t size() const
+        {
+            return this->count;
+        }
+        
+        /** Calls [f] with the id and value of every entry, in id order. */
+        template<class function_type>
+        void for_each(const function_type& f) const
+        {
+            if(this->root != nullptr) scan(this->root, this->shift, 0, f);
+        }
+        
+        static node_data** children(node_data* n)
+        {
+            return (node_data**)(n + 1);
+        }
+        
+        static type* values(node_data* n)
+        {
+            return (type*)(n + 1);
+        }
+        
+        /** Drops a reference to a node, freeing it (and dropping its
+         children) if it was the last. */
+        static void release(node_data* n)
+        {
+            if((n == nullptr) || (n->refs.fetch_sub(1, std::memory_order_acq_rel) != 1)) return;
+            if(!n->leaf)
+            {
+                for(unsigned int x = 0; x < popcount(n->bitmap); x++) release(children(n)[x]);
+            }
+            n->~node_data();
+            ::operator delete(n);
+        }
+        
+        static unsigned int popcount(const std::uint32_t& bits)
+        {
+            return __builtin_popcount(bits);
+        }
+        
+    private:
+        node_data* root;
+        unsigned int shift;
+        std::size_t count;
+        
+        template<class function_type>
+        static void scan(node_data* n, const unsigned int& shift, const std::uint32_t& base, const function_type& f)
+        {
+            unsigned int x(0);
+            for(std::uint32_t bits = n->bitmap; bits != 0; bits &= (bits - 1), x++)
+            {
+                std::uint32_t id(base | ((std::uint32_t)__builtin_ctz(bits) << shift));
+                if(n->leaf) f(id, values(n)[x]);
+                else scan(children(n)[x], (shift - bits_per_level), id, f);
+            }
+        }
+        
+        static const unsigned int bits_per_level = 5;
+        
+    };
+    
+    /**
+     * A map from key ids to values, kept as a hash array mapped trie that
+     * is indexed by the id's bits (ids are small and dense, so they need no
+     * hashing): 5 bits per level, each node storing only the children it
+     * has.  Taking a snapshot just shares the root.  After that, a change
+     * copies the nodes on its path that are still shared (and only those),
+     * so the snapshot never sees it and the memory it costs is proportional
+     * to what changed while the snapshot is held.  Values are copied with
+     * memcpy, so [type] has to be trivially copyable.
+     */
+    template<class type>
+    class map_class
+    {
+    public:
+        typedef snapshot_class<type> snapshot_type;
+        
+        explicit map_class() : root(nullptr), shift(0), count(0), copies(0), node_bytes(0)
+        {
+        }
+        
+        map_class(const map_class<type>& m) : root(nullptr), shift(0), count(0), copies(0), node_bytes(0)
+        {
+            this->operator=(m);
+        }
+        
+        ~map_class()
+        {
+            this->clear();
+        }
+        
+        /** Makes this map share [m]'s nodes; either copies them as it changes. */
+        const map_class<type>& operator=(const map_class<type>& m)
+        {
+            if(this != &m)
+            {
+                if(m.root != nullptr) m.root->refs.fetch_add(1, std::memory_order_relaxed);
+                this->clear();
+                this->root = m.root;
+                this->shift = m.shift;
+                this->count = m.count;
+                this->node_bytes = m.node_bytes;
+            }
+            return *this;
+        }
+        
+        /** Returns the value stored for [id], or nullptr. */
+        const type* find(const std::uint32_t& id) const
+        {
+            if((this->root == nullptr) || ((this->shift < top_shift) && ((id >> (this->shift + bits)) != 0)))
+            {
+                return nullptr;
+            }
+            node_data* n(this->root);
+            for(unsigned int s = this->shift;; s -= bits)
+            {
+                std::uint32_t bit(1U << ((id >> s) & mask));
+                if((n->bitmap & bit) == 0) return nullptr;
+                unsigned int pos(snapshot_type::popcount(n->bitmap & (bit - 1)));
+                if(n->leaf) return &snapshot_type::values(n)[pos];
+                n = snapshot_type::children(n)[pos];
+            }
+        }
+        
+        void set(const std::uint32_t& id, const type& value)
+        {
+            if(this->root == nullptr) this->root = this->make_node(true, 1);
+            while((this->shift < top_shift) && ((id >> (this->shift + bits)) != 0))
+            {
+                /* The id is past what the trie can hold, so it gets another
+                 level on top, with the old root as its first child. */
+                node_data* top(this->make_node(false, 1));
+                if(this->root->bitmap != 0)
+                {
+                    top->bitmap = 1;
+                    snapshot_type::children(top)[0] = this->root;
+                }
+                else this->release(this->root);
+                this->root = top;
+                this->shift += bits;
+            }
+            
+            node_data** slot(&this->root);
+            for(unsigned int s = this->shift;; s -= bits)
+            {
+                node_data* n(this->own(*slot));
+                std::uint32_t bit(1U << ((id >> s) & mask));
+                unsigned int pos(snapshot_type::popcount(n->bitmap & (bit - 1)));
+                
+                *slot = n;
+                if(n->leaf)
+                {
+                    if((n->bitmap & bit) == 0)
+                    {
+                        *slot = n = this->insert_entry(n, bit, pos);
+                        this->count++;
+                    }
+                    std::memcpy(&snapshot_type::values(n)[pos], &value, sizeof(type));
+                    return;
+                }
+                if((n->bitmap & bit) == 0)
+                {
+                    *slot = n = this->insert_entry(n, bit, pos);
+                    snapshot_type::children(n)[pos] = this->make_node(((s - bits) == 0), 1);
+                }
+                slot = &snapshot_type::children(n)[pos];
+            }
+        }
+        
+        /** Removes [id].  Returns false if it was not there. */
+        bool erase(const std::uint32_t& id)
+        {
+            if(this->find(id) == nullptr) return false;
+            if(this->erase(this->root, this->shift, id))
+            {
+                this->release(this->root);
+                this->root = nullptr;
+                this->shift = 0;
+            }
+            this->count--;
+            return true;
+        }
+        
+        /** Removes everything.  Snapshots that share the nodes keep them. */
+        void clear()
+        {
+            snapshot_type::release(this->root);
+            this->root = nullptr;
+            this->shift = 0;
+            this->count = 0;
+            this->node_bytes = 0;
+        }
+        
+        std::size_t size() const
+        {
+            return this->count;
+        }
+        
+        /** Returns the number of nodes that had to be copied because a
+         snapshot (or another map) shared them. */
+        unsigned long long copied() const
+        {
+            return this->copies;
+        }
+        
+        /** Returns the number of bytes taken up by the nodes the map is
+         made of, including the ones it still shares with snapshots. */
+        std::size_t bytes() const
+        {
+            return this->node_bytes;
+        }
+        
+        /** Returns a snapshot of the map as it is now.  This costs the same
+         no matter how big the map is. */
+        snapshot_type snapshot() const
+        {
+            return snapshot_type(this->root, this->shift, this->count);
+        }
+        
+    private:
+        static const unsigned int bits = 5;
+        static const std::uint32_t mask = ((1U << bits) - 1);
+        
+        /* The shift of the highest level a 32 bit id needs. */
+        static const unsigned int top_shift = 30;
+        
+        node_data* root;
+        unsigned int shift;
+        std::size_t count;
+        unsigned long long copies;
+        std::size_t node_bytes;
+        
+        static std::size_t entry_size(const bool& leaf)
+        {
+            return (leaf ? sizeof(type) : sizeof(node_data*));
+        }
+        
+        static std::size_t node_size(const bool& leaf, const std::uint32_t& capacity)
+        {
+            return (sizeof(node_data) + (capacity * entry_size(leaf)));
+        }
+        
+        node_data* make_node(const bool& leaf, const std::uint32_t& capacity)
+        {
+            node_data* n((node_data*)::operator new(node_size(leaf, capacity)));
+            this->node_bytes += node_size(leaf, capacity);
+            new(n) node_data();
+            n->refs.store(1, std::memory_order_relaxed);
+            n->bitmap = 0;
+            n->capacity = capacity;
+            n->leaf = leaf;
+            return n;
+        }
+        
+        /** Returns [n] if nothing else shares it; otherwise a copy of it that
+         does not share it (and drops the reference to the original). */
+        node_data* own(node_data* n)
+        {
+            if(n->refs.load(std::memory_order_acquire) == 1) return n;
+            
+            unsigned int size(snapshot_type::popcount(n->bitmap));
+            node_data* copy(this->make_node(n->leaf, n->capacity));
+            copy->bitmap = n->bitmap;
+            std::memcpy((char*)(copy + 1), (const char*)(n + 1), (size * entry_size(n->leaf)));
+            if(!n->leaf)
+            {
+                for(unsigned int x = 0; x < size; x++)
+                {
+                    snapshot_type::children(copy)[x]->refs.fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+            this->release(n);
+            this->copies++;
+            return copy;
+        }
+        
+        /** Takes a node out of the map, and drops the map's reference to it
+         (a snapshot may still hold one). */
+        void release(node_data* n)
+        {
+            this->node_bytes -= node_size(n->leaf, n->capacity);
+            snapshot_type::release(n);
+        }
+        
+        /** Makes room for a new entry at [pos] in a node this map owns, and
+         sets its bit.  Returns the node, which moves if it had to grow. */
+        node_data* insert_entry(node_data* n, const std::uint32_t& bit, const unsigned int& pos)
+        {
+            std::size_t esize(entry_size(n->leaf));
+            unsigned int size(snapshot_type::popcount(n->bitmap));
+            char* entries((char*)(n + 1));
+            
+            if(size == n->capacity)
+            {
+                node_data* bigger(this->make_node(n->leaf, (n->capacity * 2)));
+                bigger->bitmap = n->bitmap;
+                std::memcpy((char*)(bigger + 1), entries, (size * esize));
+                this->node_bytes -= node_size(n->leaf, n->capacity);
+                n->~node_data();
+                ::operator delete(n);
+                n = bigger;
+                entries = (char*)(n + 1);
+            }
+            std::memmove((entries + ((pos + 1) * esize)), (entries + (pos * esize)), ((size - pos) * esize));
+            n->bitmap |= bit;
+            return n;
+        }
+        
+        /** Removes [id] (which is there) under [slot].  Returns true if that
+         leaves the node empty. */
+        bool erase(node_data*& slot, const unsigned int& s, const std::uint32_t& id)
+        {
+            node_data* n(this->own(slot));
+            std::uint32_t bit(1U << ((id >> s) & mask));
+            unsigned int pos(snapshot_type::popcount(n->bitmap & (bit - 1)));
+            
+            slot = n;
+            if(!n->leaf)
+            {
+                if(!this->erase(snapshot_type::children(n)[pos], (s - bits), id)) return false;
+                this->release(snapshot_type::children(n)[pos]);
+            }
+            
+            std::size_t esize(entry_size(n->leaf));
+            unsigned int size(snapshot_type::popcount(n->bitmap));
+            char* entries((char*)(n + 1));
+            std::memmove((entries + (pos * esize)), (entries + ((pos + 1) * esize)), ((size - pos - 1) * esize));
+            n->bitmap &= ~bit;
+            return (n->bitmap == 0);
+        }
+        
+    };
+    
+}
+
+#endif
@@ -0,0 +1,776 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2014 Jonathan Craig Whitlock
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+ */
+
+
+
+#ifndef SHARD_STORE_HPP_INCLUDED
+#define SHARD_STORE_HPP_INCLUDED
+#include <string>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <new>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+
+#include "variable_stack.hpp"
+#include "symbol_table.hpp"
+#include "hash_index.hpp"
+#include "typed_value.hpp"
+#include "epoch.hpp"
+
+namespace shard_store
+{
+    
+    /**
+     * Remembers which commit last changed each variable of a shard, and
+     * roughly which last changed the set of variables equal to each value, so
+     * a transaction can tell at COMMIT whether anything it read has changed
+     * since it began.  Values are kept in a fixed number of stripes: two
+     * values that share one can cause a needless conflict, but never a
+     * missed one.
+     */
+    template<class type>
+    class version_table_class
+    {
+    public:
+        
+        explicit version_table_class() : keys(), values(), last(0), everything(0)
+        {
+        }
+        
+        void key_changed(const symbols::id_type& id, const unsigned long long& commit)
+        {
+            if(id >= this->keys.size()) this->keys.resize((id + 1), 0);
+            this->keys[id] = commit;
+            this->last = commit;
+        }
+        
+        void value_changed(const type& t, const unsigned long long& commit)
+        {
+            if(this->values.empty()) this->values.resize(value_stripes, 0);
+            this->values[stripe(t)] = commit;
+            this->last = commit;
+        }
+        
+        /** Records a change to every variable at once (a clear or a load). */
+        void all_changed(const unsigned long long& commit)
+        {
+            this->everything = commit;
+            this->last = commit;
+        }
+        
+        /** Forgets which commit changed each variable, for when their ids
+         have been given out again (no transaction can be open then). */
+        void reset_keys()
+        {
+            std::vector<unsigned long long>().swap(this->keys);
+        }
+        
+        bool key_changed_since(const symbols::id_type& id, const unsigned long long& commit) const
+        {
+            return ((this->everything > commit) || ((id < this->keys.size()) && (this->keys[id] > commit)));
+        }
+        
+        bool value_changed_since(const type& t, const unsigned long long& commit) const
+        {
+            return ((this->everything > commit) || 
+                    (!this->values.empty() && (this->values[stripe(t)] > commit)));
+        }
+        
+        bool anything_changed_since(const unsigned long long& commit) const
+        {
+            return (this->last > commit);
+        }
+        
+        std::size_t bytes() const
+        {
+            return ((this->keys.capacity() + this->values.capacity()) * sizeof(unsigned long long));
+        }
+        
+    private:
+        static const std::size_t value_stripes = 4096;
+        
+        /* The last commit to change each variable, by key id.  Nothing is
+         allocated until a commit is stamped. */
+        std::vector<unsigned long long> keys;
+        std::vector<unsigned long long> values;
+        unsigned long long last;
+        unsigned long long everything;
+        
+        static std::size_t stripe(const type& t)
+        {
+            return (hash_index::hash_value(t) & (value_stripes - 1));
+        }
+        
+    };
+    
+    template<class type>
+    const std::size_t version_table_class<type>::value_stripes;
+    
+    /**
+     * The variables, split by the hash of their keys into a power of two
+     * shards.  Each shard is a stack and a symbol table of its own with its
+     * own lock, so commands on keys in different shards can run on different
+     * threads at once.  A key's id says where it is: its low bits are the
+     * shard, and the rest its id in that shard's symbol table (with one
+     * shard, that's all there is to it).
+     * 
+     * Locking is off until the store is made concurrent, so one thread pays
+     * nothing for it.  Once it is on, GET and NUMEQUALTO don't lock at all:
+     * every shard has a sequence number that writers make odd while they
+     * hold its lock, and readers look at lock-free copies of the variables
+     * and of the value counts (see shared_table), trying again if a sequence
+     * number changed under them.  A reader that keeps losing that race takes
+     * the locks instead.  Counting values checks every shard's number at
+     * once, so a commit is never seen half applied.
+     */
+    template<class type>
+    class store_class
+    {
+    public:
+        static const std::size_t max_shards = 256;
+        
+        /** One shard.  Shards are aligned to cache lines, so the locks (and
+         everything else) of two shards never share one. */
+        struct alignas(64) shard_data
+        {
+            mutable std::mutex lock;
+            std::atomic<unsigned long long> sequence;
+            symbols::symbol_table_class keys;
+            var_stack::stack_class<type> vars;
+            version_table_class<type> versions;
+        };
+        
+        /** What locks are taken for.  Writers also bump the sequence numbers
+         of the shards they hold, before and after changing them. */
+        enum access_type
+        {
+            reading,
+            writing
+        };
+        
+        /**
+         * Holds the locks of some shards for as long as it exists.  They are
+         * always taken in ascending order, so two holders never wait on each
+         * other.  It does nothing unless the store is concurrent.
+         */
+        class lock_class
+        {
+        public:
+            /** Locks every shard. */
+            explicit lock_class(const store_class<type>& s, const access_type& a = reading) : store(s), first(0), 
+                    last(s.count), listed(nullptr), held(s.concurrent), changing(a == writing)
+            {
+                this->lock();
+            }
+            
+            /** Locks the shard [x]. */
+            explicit lock_class(const store_class<type>& s, const std::size_t& x, const access_type& a = reading) : 
+                    store(s), first(x), last(x + 1), listed(nullptr), held(s.concurrent), changing(a == writing)
+            {
+                this->lock();
+            }
+            
+            /** Locks the shards in [x], which must be in ascending order (and
+             must not change while they are held). */
+            explicit lock_class(const store_class<type>& s, const std::vector<std::size_t>& x, 
+                    const access_type& a = reading) : store(s), first(0), last(0), listed(&x), held(s.concurrent), 
+                    changing(a == writing)
+            {
+                this->lock();
+            }
+            
+            ~lock_class()
+            {
+                if(!this->held) return;
+                for(std::size_t x = this->last; x > this->first; x--) this->unlock(x - 1);
+                for(std::size_t x = ((this->listed == nullptr) ? 0 : this->listed->size()); x > 0; x--)
+                {
+                    this->unlock((*this->listed)[(x - 1)]);
+                }
+                if(this->changing) epoch::domain().collect();
+            }
+            
+            lock_class(const lock_class&) = delete;
+            lock_class& operator=(const lock_class&) = delete;
+            
+        private:
+            const store_class<type>& store;
+            std::size_t first;
+            std::size_t last;
+            const std::vector<std::size_t>* listed;
+            bool held;
+            bool changing;
+            
+            /** Every shard is locked (and marked as changing) before any of
+             them is changed, and stays so until all of them are done. */
+            void lock()
+            {
+                if(!this->held) return;
+                for(std::size_t x = this->first; x < this->last; x++) this->lock(x);
+                for(std::size_t x = 0; ((this->listed != nullptr) && (x < this->listed->size())); x++)
+                {
+                    this->lock((*this->listed)[x]);
+                }
+                if(this->changing) std::atomic_thread_fence(std::memory_order_release);
+            }
+            
+            void lock(const std::size_t& x)
+            {
+                shard_data& shard(this->store.shards[x]);
+                shard.lock.lock();
+                if(this->changing) shard.sequence.store((shard.sequence.load(std::memory_order_relaxed) + 1), 
+                        std::memory_order_relaxed);
+            }
+            
+            void unlock(const std::size_t& x)
+            {
+                shard_data& shard(this->store.shards[x]);
+                if(this->changing) shard.sequence.store((shard.sequence.load(std::memory_order_relaxed) + 1), 
+                        std::memory_order_release);
+                shard.lock.unlock();
+            }
+            
+        };
+        
+        explicit store_class() : shards(nullptr), count(0), bits(0), concurrent(false), versioned(false), 
+                key_index(true), persistent(false), rehash_step(hash_index::index_class::default_step), commits(0), 
+                open_transactions(0), polls(0)
+        {
+            this->build(1);
+        }
+        
+        ~store_class()
+        {
+            this->release();
+        }
+        
+        store_class(const store_class<type>&) = delete;
+        store_class<type>& operator=(const store_class<type>&) = delete;
+        
+        /** Splits the store into [n] shards, a power of two up to
+         max_shards.  Key ids depend on it, so this is only possible before
+         any key has been interned.  Returns false if it could not be done. */
+        bool set_shards(const std::size_t& n)
+        {
+            if((n == 0) || (n > max_shards) || ((n & (n - 1)) != 0)) return false;
+            for(std::size_t x = 0; x < this->count; x++)
+            {
+                if(this->shards[x].keys.size() > 0) return false;
+            }
+            this->release();
+            this->build(n);
+            return true;
+        }
+        
+        std::size_t shard_count() const
+        {
+            return this->count;
+        }
+        
+        /** Turns locking (and lock-free reads) on or off.  It has to be on
+         while more than one thread uses the store, and may only be changed
+         while none does. */
+        void set_concurrent(const bool& b)
+        {
+            for(std::size_t x = 0; x < this->count; x++)
+            {
+                this->shards[x].keys.set_lock_free_reads(b);
+                this->shards[x].vars.set_lock_free_reads(b);
+            }
+            this->concurrent = b;
+        }
+        
+        bool is_concurrent() const
+        {
+            return this->concurrent;
+        }
+        
+        /** Turns commit stamps on or off: with them on, every change is
+         recorded in its shard's version table. */
+        void set_versioned(const bool& b)
+        {
+            this->versioned = b;
+        }
+        
+        bool is_versioned() const
+        {
+            return this->versioned;
+        }
+        
+        /** These work like the stack's own, on every shard.  They are only
+         possible while the store is empty. */
+        bool set_key_index(const bool& b)
+        {
+            if(this->size() > 0) return false;
+            for(std::size_t x = 0; x < this->count; x++) this->shards[x].vars.set_key_index(b);
+            this->key_index = b;
+            return true;
+        }
+        
+        bool key_index_enabled() const
+        {
+            return this->key_index;
+        }
+        
+        bool set_persistent(const bool& b)
+        {
+            if(this->size() > 0) return false;
+            for(std::size_t x = 0; x < this->count; x++) this->shards[x].vars.set_persistent(b);
+            this->persistent = b;
+            return true;
+        }
+        
+        bool persistent_enabled() const
+        {
+            return this->persistent;
+        }
+        
+        void set_rehash_step(const std::size_t& n)
+        {
+            for(std::size_t x = 0; x < this->count; x++) this->shards[x].keys.set_rehash_step(n);
+            this->rehash_step = n;
+        }
+        
+        /** Returns the shard a key with hash [h] belongs to.  The high bits
+         pick it, since the symbol tables index by the low ones. */
+        std::size_t shard_for(const std::uint64_t& h) const
+        {
+            return ((this->bits == 0) ? 0 : (std::size_t)(h >> (64 - this->bits)));
+        }
+        
+        std::size_t shard_of(const symbols::id_type& id) const
+        {
+            return (id & (this->count - 1));
+        }
+        
+        /** Returns a key's id in its shard's symbol table and stack. */
+        symbols::id_type local(const symbols::id_type& id) const
+        {
+            return (id >> this->bits);
+        }
+        
+        symbols::id_type global(const symbols::id_type& id, const std::size_t& shard) const
+        {
+            return ((id << this->bits) | (symbols::id_type)shard);
+        }
+        
+        /** Returns a shard, for callers that hold its lock. */
+        shard_data& shard(const std::size_t& x)
+        {
+            return this->shards[x];
+        }
+        
+        const shard_data& shard(const std::size_t& x) const
+        {
+            return this->shards[x];
+        }
+        
+        /** Returns the id of a key, giving it one if it has none yet.  Returns
+         no_id if the key is new and its shard has no room left for it. */
+        symbols::id_type intern(const char* data, const std::size_t& size)
+        {
+            std::uint64_t h(hash_index::hash_bytes(data, size));
+            std::size_t x(this->shard_for(h));
+            lock_class lock(*this, x);
+            symbols::id_type id(this->shards[x].keys.intern(data, size, h));
+            return ((id == symbols::no_id) ? id : this->global(id, x));
+        }
+        
+        /** Returns the id of a key, or no_id if it was never interned.  This
+         never waits for a lock: keys are only ever added, so the lock-free
+         table of them is always good to look at. */
+        symbols::id_type find(const char* data, const std::size_t& size) const
+        {
+            std::uint64_t h(hash_index::hash_bytes(data, size));
+            std::size_t x(this->shard_for(h));
+            symbols::id_type id(symbols::no_id);
+            if(this->concurrent)
+            {
+                epoch::guard_class guard;
+                if(guard.entered()) id = this->shards[x].keys.find_shared(data, size, h);
+                else
+                {
+                    lock_class lock(*this, x);
+                    id = this->shards[x].keys.find(data, size, h);
+                }
+            }
+            else id = this->shards[x].keys.find(data, size, h);
+            return ((id == symbols::no_id) ? id : this->global(id, x));
+        }
+        
+        /** Returns (a copy of) the text of a key. */
+        std::string name(const symbols::id_type& id) const
+        {
+            lock_class lock(*this, this->shard_of(id));
+            return this->shards[this->shard_of(id)].keys.name(this->local(id)).str();
+        }
+        
+        /** Copies the variable with key id [id] to [var].  Returns false if
+         there isn't one. */
+        bool get(const symbols::id_type& id, var_stack::variable_data<type>& var) const
+        {
+            if(id == symbols::no_id) return false;
+            var.id = id;
+            if(this->concurrent)
+            {
+                const shard_data& shard(this->shards[this->shard_of(id)]);
+                epoch::guard_class guard;
+                for(unsigned int x = 0; (guard.entered() && (x < read_attempts)); x++)
+                {
+                    unsigned long long sequence(shard.sequence.load(std::memory_order_acquire));
+                    bool found(shard.vars.read_var(this->local(id), var.value));
+                    if(unchanged(shard, sequence)) return found;
+                }
+            }
+            
+            lock_class lock(*this, this->shard_of(id));
+            const type* found(this->shards[this->shard_of(id)].vars.find_value(this->local(id)));
+            if(found == nullptr) return false;
+            var.value = *found;
+            return true;
+        }
+        
+        /** Changes a variable with nothing logged or stamped (for recovery). */
+        void set(const symbols::id_type& id, const type& val)
+        {
+            lock_class lock(*this, this->shard_of(id), writing);
+            this->shards[this->shard_of(id)].vars.set_var(this->local(id), val);
+        }
+        
+        void remove(const symbols::id_type& id)
+        {
+            if(id == symbols::no_id) return;
+            lock_class lock(*this, this->shard_of(id), writing);
+            this->shards[this->shard_of(id)].vars.remove_var(this->local(id));
+        }
+        
+        /** Each returns the number of variables that match, over every shard. */
+        unsigned long long count_equal(const type& t) const
+        {
+            if(this->concurrent)
+            {
+                unsigned long long sequences[max_shards];
+                epoch::guard_class guard;
+                for(unsigned int x = 0; (guard.entered() && (x < read_attempts)); x++)
+                {
+                    unsigned long long n(0);
+                    bool valid(true);
+                    for(std::size_t y = 0; y < this->count; y++)
+                    {
+                        sequences[y] = this->shards[y].sequence.load(std::memory_order_acquire);
+                    }
+                    for(std::size_t y = 0; y < this->count; y++) n += this->shards[y].vars.read_count(t);
+                    for(std::size_t y = 0; (valid && (y < this->count)); y++)
+                    {
+                        valid = unchanged(this->shards[y], sequences[y]);
+                    }
+                    if(valid) return n;
+                }
+            }
+            return this->sum([&t](const var_stack::stack_class<type>& s){ return s.find_values(t); });
+        }
+        
+        unsigned long long count_between(const type& low, const type& high) const
+        {
+            return this->sum([&low, &high](const var_stack::stack_class<type>& s)
+            {
+                return s.find_values_between(low, high);
+            });
+        }
+        
+        unsigned long long count_less(const type& t) const
+        {
+            return this->sum([&t](const var_stack::stack_class<type>& s){ return s.find_values_less(t); });
+        }
+        
+        unsigned long long count_greater(const type& t) const
+        {
+            return this->sum([&t](const var_stack::stack_class<type>& s){ return s.find_values_greater(t); });
+        }
+        
+        /** Calls [f] with the key id of every variable equal to [t].  The ids
+         are gathered first, so [f] is called with no lock held.  Returns
+         false (without calling it) if the key index is off. */
+        template<class function_type>
+        bool for_each_key(const type& t, const function_type& f) const
+        {
+            std::vector<symbols::id_type> ids;
+            
+            if(!this->key_index) return false;
+            {
+                lock_class lock(*this);
+                for(std::size_t x = 0; x < this->count; x++)
+                {
+                    this->shards[x].vars.for_each_key(t, [this, &ids, &x](const symbols::id_type& id)
+                    {
+                        ids.push_back(this->global(id, x));
+                    });
+                }
+            }
+            for(std::size_t x = 0; x < ids.size(); x++) f(ids[x]);
+            return true;
+        }
+        
+        /** Calls [f] with the name and value of every variable, shard by
+         shard.  The caller must hold every lock. */
+        template<class function_type>
+        void for_each_var(const function_type& f) const
+        {
+            for(std::size_t x = 0; x < this->count; x++)
+            {
+                const symbols::symbol_table_class& keys(this->shards[x].keys);
+                this->shards[x].vars.for_each_var([&f, &keys](const symbols::id_type& id, const type& value)
+                {
+                    f(keys.name(id), value);
+                });
+            }
+        }
+        
+        /** Returns the number of variables. */
+        unsigned int size() const
+        {
+            return this->sum([](const var_stack::stack_class<type>& s){ return s.size(); });
+        }
+        
+        /** Returns the state of the symbol tables' indexes, added up. */
+        hash_index::index_stats_data index_stats() const
+        {
+            hash_index::index_stats_data total;
+            lock_class lock(*this);
+            for(std::size_t x = 0; x < this->count; x++)
+            {
+                hash_index::index_stats_data index(this->shards[x].keys.index_stats());
+                total.size += index.size;
+                total.capacity += index.capacity;
+                total.migrating += index.migrating;
+                total.migrated += index.migrated;
+                total.migrations += index.migrations;
+                total.step = index.step;
+            }
+            return total;
+        }
+        
+        /** Returns the number of bytes the keys, the variables and all of
+         their indexes take up. */
+        std::size_t memory_bytes() const
+        {
+            std::size_t n(0);
+            lock_class lock(*this);
+            for(std::size_t x = 0; x < this->count; x++)
+            {
+                n += (this->shards[x].keys.memory_bytes() + this->shards[x].vars.memory_bytes() + 
+                        this->shards[x].versions.bytes());
+            }
+            return n;
+        }
+        
+        unsigned long long snapshot_copies() const
+        {
+            return this->sum([](const var_stack::stack_class<type>& s){ return s.snapshot_copies(); });
+        }
+        
+        /** Removes every variable.  The caller must hold every lock. */
+        void erase_all()
+        {
+            for(std::size_t x = 0; x < this->count; x++) this->shards[x].vars.erase_all();
+        }
+        
+        /** Returns the number of the last commit. */
+        unsigned long long now() const
+        {
+            return this->commits.load();
+        }
+        
+        /** Starts a commit, and returns its number.  It must be called with
+         the locks of the shards it changes held, so that the numbers given
+         to any one shard only go up. */
+        unsigned long long next()
+        {
+            return ++this->commits;
+        }
+        
+        /** Called by every transaction as it opens and as it closes, so the
+         store knows when no one is holding on to a key id. */
+        void transaction_opened()
+        {
+            this->open_transactions++;
+        }
+        
+        void transaction_closed()
+        {
+            this->open_transactions--;
+        }
+        
+        /** Gives back the ids, and the memory, of every key no variable has,
+         and numbers the rest again.  Ids are held from one command to the
+         next only by open transactions, and by other threads, so this does
+         nothing unless no transaction is open and the store isn't
+         concurrent.  The caller must make sure nothing else (a checkpoint's
+         thread, say) is reading the keys.  Returns the number dropped. */
+        std::size_t compact_keys()
+        {
+            std::size_t dropped(0);
+            if(this->concurrent || (this->open_transactions.load() > 0)) return 0;
+            for(std::size_t x = 0; x < this->count; x++)
+            {
+                shard_data& shard(this->shards[x]);
+                std::vector<type> values, count_values;
+                std::vector<unsigned long long> counts;
+                if(shard.keys.size() == shard.vars.size()) continue;
+                
+                /* The variables keep their order, so the x-th one gets id x. */
+                shard.vars.for_each_var([&values](const symbols::id_type&, const type& t){ values.push_back(t); });
+                shard.vars.for_each_count([&count_values, &counts](const type& t, const unsigned long long& n)
+                {
+                    count_values.push_back(t);
+                    counts.push_back(n);
+                });
+                dropped += shard.keys.compact([&shard](const symbols::id_type& id){ return shard.vars.var_exists(id); });
+                
+                std::vector<symbols::id_type> ids(values.size());
+                for(std::size_t y = 0; y < ids.size(); y++) ids[y] = y;
+                if(!shard.vars.bulk_load(ids.data(), values.data(), values.size(), count_values.data(), counts.data(), 
+                        count_values.size()))
+                {
+                    for(std::size_t y = 0; y < ids.size(); y++) shard.vars.set_var(ids[y], values[y]);
+                }
+                shard.versions.reset_keys();
+            }
+            return dropped;
+        }
+        
+        /** Called between commands.  Now and then, looks at how many keys no
+         variable has, and compacts them once there are at least as many as
+         there are variables (and a few thousand). */
+        void poll_keys()
+        {
+            std::size_t interned(0);
+            if(this->concurrent || (((++this->polls) & 1023) != 0)) return;
+            for(std::size_t x = 0; x < this->count; x++) interned += this->shards[x].keys.size();
+            if((interned - this->size()) >= std::max<std::size_t>(this->size(), min_unused)) this->compact_keys();
+        }
+        
+        /** Stamps every variable as changed.  The caller must hold every lock. */
+        void all_changed()
+        {
+            if(!this->versioned) return;
+            
+            unsigned long long commit(this->next());
+            for(std::size_t x = 0; x < this->count; x++) this->shards[x].versions.all_changed(commit);
+        }
+        
+    private:
+        shard_data* shards;
+        std::size_t count;
+        unsigned int bits;
+        bool concurrent;
+        bool versioned;
+        
+        /* Settings every shard is given when they are rebuilt. */
+        bool key_index;
+        bool persistent;
+        std::size_t rehash_step;
+        
+        std::atomic<unsigned long long> commits;
+        std::atomic<unsigned int> open_transactions;
+        unsigned long long polls;
+        
+        /* The fewest unused keys poll_keys bothers to compact. */
+        static const std::size_t min_unused = 4096;
+        
+        /* How many times a lock-free read is tried before taking locks. */
+        static const unsigned int read_attempts = 4;
+        
+        /** Returns true if [shard] was not being changed when its sequence
+         number was [sequence], and has not been changed since. */
+        static bool unchanged(const shard_data& shard, const unsigned long long& sequence)
+        {
+            std::atomic_thread_fence(std::memory_order_acquire);
+            return (((sequence & 1) == 0) && (shard.sequence.load(std::memory_order_relaxed) == sequence));
+        }
+        
+        /** Adds up what [f] returns for each shard's stack, with every
+         shard locked. */
+        template<class function_type>
+        unsigned long long sum(const function_type& f) const
+        {
+            unsigned long long n(0);
+            lock_class lock(*this);
+            for(std::size_t x = 0; x < this->count; x++) n += f(this->shards[x].vars);
+            return n;
+        }
+        
+        /** Allocates [n] empty shards.  new does not have to honor alignments
+         this big, so they are placed in memory that does. */
+        void build(const std::size_t& n)
+        {
+            void* memory(nullptr);
+            if(posix_memalign(&memory, alignof(shard_data), (n * sizeof(shard_data))) != 0) throw std::bad_alloc();
+            this->shards = (shard_data*)memory;
+            for(std::size_t x = 0; x < n; x++)
+            {
+                new(&this->shards[x]) shard_data();
+                this->shards[x].vars.set_key_index(this->key_index);
+                this->shards[x].vars.set_persistent(this->persistent);
+                this->shards[x].keys.set_rehash_step(this->rehash_step);
+                this->shards[x].keys.set_lock_free_reads(this->concurrent);
+                this->shards[x].vars.set_lock_free_reads(this->concurrent);
+            }
+            this->count = n;
+            this->bits = 0;
+            while((std::size_t(1) << this->bits) < n) this->bits++;
+        }
+        
+        void release()
+        {
+            for(std::size_t x = 0; x < this->count; x++) this->shards[x].~shard_data();
+            std::free(this->shards);
+            this->shards = nullptr;
+            this->count = 0;
+        }
+        
+    };
+    
+    template<class type>
+    const std::size_t store_class<type>::max_shards;
+    
+    template<class type>
+    const unsigned int store_class<type>::read_attempts;
+    
+    template<class type>
+    const std::size_t store_class<type>::min_unused;
+    
+    template class version_table_class<typed_value::value_class>;
+    template class store_class<typed_value::value_class>;
+    
+    /** The store the program keeps its variables in. */
+    typedef store_class<typed_value::value_class> value_store;
+    
+}
+
+#endif
@@ -0,0 +1,533 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2014 Jonathan Craig Whitlock
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+ */
+
+
+#ifndef SHARED_TABLE_HPP_INCLUDED
+#define SHARED_TABLE_HPP_INCLUDED
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+#include "epoch.hpp"
+
+namespace shared_table
+{
+    /**
+     * Holds a copy of something trivially copyable in relaxed atomic words,
+     * so things too big for a lock-free std::atomic can be read while they
+     * are written.  A read that races a write can see a mix of the two, so
+     * like everything else here it has to be checked by the reader.
+     */
+    template<class type>
+    struct relaxed_data
+    {
+        type load() const
+        {
+            std::uint64_t copy[word_count];
+            type t;
+            
+            for(std::size_t x = 0; x < word_count; x++) copy[x] = this->words[x].load(std::memory_order_relaxed);
+            std::memcpy(&t, copy, sizeof(type));
+            return t;
+        }
+        
+        void store(const type& t)
+        {
+            std::uint64_t copy[word_count] = {};
+            
+            std::memcpy(copy, &t, sizeof(type));
+            for(std::size_t x = 0; x < word_count; x++) this->words[x].store(copy[x], std::memory_order_relaxed);
+        }
+        
+        static const std::size_t word_count = ((sizeof(type) + sizeof(std::uint64_t) - 1) / sizeof(std::uint64_t));
+        
+        std::atomic<std::uint64_t> words[word_count];
+    };
+    
+    template<class type>
+    const std::size_t relaxed_data<type>::word_count;
+    
+    
+    /**
+     * An open-addressing table that one writer changes (holding a lock of
+     * its own) while any number of threads look keys up without locking.
+     * Every field is atomic, an entry never moves once it is placed, and a
+     * table that is replaced is retired through the epoch domain instead of
+     * freed, so a reader never sees freed memory.  It may see an entry in
+     * the middle of a change, though: readers that need a consistent answer
+     * check a sequence number around what they read.
+     * 
+     * It maps keys (anything trivially copyable) to numbers.  Keys
+     * can't be taken out, but unless [keep_empty] is set, a key whose number
+     * is 0 is left behind when the table is replaced.  Growing is incremental
+     * like hash_index: the new table is filled [step] old slots per change,
+     * and readers go on using the old one until it is complete.
+     */
+    template<class key_type>
+    class table_class
+    {
+    public:
+        static const std::size_t default_step = 64;
+        
+        explicit table_class(const bool& k) : current(nullptr), next(nullptr), cursor(0), live(0), 
+                step(default_step), keep_empty(k)
+        {
+        }
+        
+        ~table_class()
+        {
+            release(this->current.load(std::memory_order_relaxed));
+            release(this->next);
+        }
+        
+        table_class(const table_class<key_type>&) = delete;
+        table_class<key_type>& operator=(const table_class<key_type>&) = delete;
+        
+        /** Looks a key up, from any thread (inside an epoch guard).  Returns
+         false if it isn't there. */
+        template<class equal_type>
+        bool find(const std::uint64_t& hash, const equal_type& equal, std::uint64_t& number) const
+        {
+            const table_data* t(this->current.load());
+            if(t == nullptr) return false;
+            
+            std::uint64_t tag(hash | 1);
+            for(std::size_t x = home(t, hash);; x = ((x + 1) & t->mask))
+            {
+                std::uint64_t found(t->slots[x].tag.load(std::memory_order_acquire));
+                if(found == 0) return false;
+                if((found == tag) && equal(t->slots[x].key.load()))
+                {
+                    number = t->slots[x].number.load(std::memory_order_relaxed);
+                    return true;
+                }
+            }
+        }
+        
+        /** Adds a key that is not in the table yet. */
+        void insert(const std::uint64_t& hash, const key_type& key, const std::uint64_t& number)
+        {
+            table_data* t(this->writable());
+            std::size_t x(place(t, hash, key, number));
+            if((number != 0) || this->keep_empty) this->live++;
+            if((this->next != nullptr) && (x < this->cursor)) place(this->next, hash, key, number);
+        }
+        
+        /** Adds [n] to the number of a key (which starts at 0 if the key is
+         new), and returns what it is now. */
+        template<class equal_type>
+        std::uint64_t add(const std::uint64_t& hash, const key_type& key, const equal_type& equal, 
+                const std::int64_t& n)
+        {
+            table_data* t(this->writable());
+            std::uint64_t number(0);
+            std::size_t count(t->count), x(locate(t, hash, key, equal, n, number));
+            if(this->keep_empty && (t->count != count)) this->live++;
+            this->store(t, x, number, (number + n));
+            number += n;
+            
+            /* Slots before the cursor have already been copied, so the new
+             table has to be changed too. */
+            if((this->next != nullptr) && (x < this->cursor))
+            {
+                std::uint64_t old(0);
+                std::size_t y(locate(this->next, hash, key, equal, number, old));
+                this->next->slots[y].number.store(number, std::memory_order_relaxed);
+            }
+            return number;
+        }
+        
+        /** Empties the table. */
+        void clear()
+        {
+            table_data* t(this->current.load(std::memory_order_relaxed));
+            this->current.store(nullptr);
+            if(t != nullptr) epoch::domain().retire(t, retire_table);
+            release(this->next);
+            this->next = nullptr;
+            this->cursor = 0;
+            this->live = 0;
+        }
+        
+        /** Sets the maximum number of old slots a change copies while the
+         table is growing.  0 means "copy them all in one go". */
+        void set_step(const std::size_t& n)
+        {
+            this->step = n;
+        }
+        
+        /** Returns the number of bytes the tables take up.  Only the writer
+         may call it. */
+        std::size_t bytes() const
+        {
+            const table_data* t(this->current.load(std::memory_order_relaxed));
+            std::size_t slots((t == nullptr) ? 0 : t->capacity());
+            if(this->next != nullptr) slots += this->next->capacity();
+            return (slots * sizeof(slot_data));
+        }
+        
+    private:
+        
+        /* [tag] is the key's hash with the low bit set, or 0 if the slot is
+         empty.  It is stored last, so a reader that finds it can trust the
+         key.  The low bit is not used to pick a slot, so the tag is as good
+         as the hash for moving an entry to a new table. */
+        struct slot_data
+        {
+            std::atomic<std::uint64_t> tag;
+            relaxed_data<key_type> key;
+            std::atomic<std::uint64_t> number;
+        };
+        
+        struct table_data
+        {
+            explicit table_data(const std::size_t& cap) : mask(cap - 1), count(0), slots(new slot_data[cap]())
+            {
+            }
+            
+            ~table_data()
+            {
+                delete[] this->slots;
+            }
+            
+            std::size_t capacity() const
+            {
+                return (this->mask + 1);
+            }
+            
+            /* [count] is only used by the writer. */
+            std::size_t mask;
+            std::size_t count;
+            slot_data* slots;
+        };
+        
+        static const std::size_t min_capacity = 16;
+        
+        /* What readers use, and the table that will replace it once every
+         slot before [cursor] has been copied. */
+        std::atomic<table_data*> current;
+        table_data* next;
+        std::size_t cursor;
+        
+        /* The number of keys that would be copied to a new table. */
+        std::size_t live;
+        std::size_t step;
+        bool keep_empty;
+        
+        static std::size_t home(const table_data* t, const std::uint64_t& hash)
+        {
+            return ((hash >> 1) & t->mask);
+        }
+        
+        static void release(table_data* t)
+        {
+            delete t;
+        }
+        
+        static void retire_table(void* t)
+        {
+            release((table_data*)t);
+        }
+        
+        /** Puts a key in an empty slot (it must not be in [t] already), and
+         returns the slot. */
+        static std::size_t place(table_data* t, const std::uint64_t& hash, const key_type& key, 
+                const std::uint64_t& number)
+        {
+            std::size_t x(home(t, hash));
+            while(t->slots[x].tag.load(std::memory_order_relaxed) != 0) x = ((x + 1) & t->mask);
+            t->slots[x].key.store(key);
+            t->slots[x].number.store(number, std::memory_order_relaxed);
+            t->slots[x].tag.store((hash | 1), std::memory_order_release);
+            t->count++;
+            return x;
+        }
+        
+        /** Returns the slot of a key in [t], putting it there (with the
+         number [first]) if it is missing.  [number] is what it held before. */
+        template<class equal_type>
+        static std::size_t locate(table_data* t, const std::uint64_t& hash, const key_type& key, 
+                const equal_type& equal, const std::int64_t& first, std::uint64_t& number)
+        {
+            std::uint64_t tag(hash | 1);
+            for(std::size_t x = home(t, hash);; x = ((x + 1) & t->mask))
+            {
+                std::uint64_t found(t->slots[x].tag.load(std::memory_order_relaxed));
+                if(found == 0) break;
+                if((found == tag) && equal(t->slots[x].key.load()))
+                {
+                    number = t->slots[x].number.load(std::memory_order_relaxed);
+                    return x;
+                }
+            }
+            number = 0;
+            return place(t, hash, key, first);
+        }
+        
+        /** Changes the number in slot [x] of [t], keeping [live] up to date. */
+        void store(table_data* t, const std::size_t& x, const std::uint64_t& old, const std::uint64_t& number)
+        {
+            if(!this->keep_empty)
+            {
+                if((old == 0) && (number != 0)) this->live++;
+                else if((old != 0) && (number == 0)) this->live--;
+            }
+            t->slots[x].number.store(number, std::memory_order_relaxed);
+        }
+        
+        /** Returns the table to change, after doing this change's share of
+         growing it. */
+        table_data* writable()
+        {
+            table_data* t(this->current.load(std::memory_order_relaxed));
+            if(t == nullptr)
+            {
+                t = new table_data(min_capacity);
+                this->current.store(t);
+                return t;
+            }
+            if((this->next == nullptr) && ((t->count * 4) >= (t->capacity() * 3))) this->grow(t);
+            if(this->next != nullptr)
+            {
+                /* The old table has to stay sparse enough to probe, so if
+                 it fills up the copy is finished in one go. */
+                this->migrate(((t->count * 8) >= (t->capacity() * 7)) ? 0 : this->step);
+            }
+            return this->current.load(std::memory_order_relaxed);
+        }
+        
+        /** Starts copying [t] into a new table, with room for the keys that
+         are kept and for every key added before the copy is finished. */
+        void grow(table_data* t)
+        {
+            std::size_t cap(min_capacity), added((this->step == 0) ? 0 : ((t->capacity() / this->step) + 1));
+            while((cap / 2) < (this->live + added)) cap *= 2;
+            this->next = new table_data(cap);
+            this->cursor = 0;
+        }
+        
+        /** Copies up to [n] old slots into the new table (0 meaning all of
+         them), and switches readers over to it when they are all done. */
+        void migrate(std::size_t n)
+        {
+            table_data* t(this->current.load(std::memory_order_relaxed));
+            
+            if((n == 0) || (n > (t->capacity() - this->cursor))) n = (t->capacity() - this->cursor);
+            for(std::size_t end = (this->cursor + n); this->cursor < end; this->cursor++)
+            {
+                const slot_data& s(t->slots[this->cursor]);
+                std::uint64_t tag(s.tag.load(std::memory_order_relaxed)), 
+                        number(s.number.load(std::memory_order_relaxed));
+                if((tag != 0) && ((number != 0) || this->keep_empty))
+                {
+                    place(this->next, tag, s.key.load(), number);
+                }
+            }
+            if(this->cursor == t->capacity())
+            {
+                this->current.store(this->next);
+                this->next = nullptr;
+                this->cursor = 0;
+                epoch::domain().retire(t, retire_table);
+            }
+        }
+        
+    };
+    
+    template<class key_type>
+    const std::size_t table_class<key_type>::default_step;
+    
+    template<class key_type>
+    const std::size_t table_class<key_type>::min_capacity;
+    
+    /**
+     * An array of optional values, indexed by small ids, that one writer
+     * changes while other threads read it without locking.  It grows a
+     * chunk at a time; chunks never move, and when the directory of chunks
+     * fills up it is replaced and the old one retired.
+     */
+    template<class type>
+    class array_class
+    {
+    public:
+        static const std::size_t chunk_bits = 12;
+        static const std::size_t chunk_size = (std::size_t(1) << chunk_bits);
+        
+        explicit array_class() : directory(nullptr)
+        {
+        }
+        
+        ~array_class()
+        {
+            release_all(this->directory.load(std::memory_order_relaxed));
+        }
+        
+        array_class(const array_class<type>&) = delete;
+        array_class<type>& operator=(const array_class<type>&) = delete;
+        
+        /** Copies the value at [x] to [t], from any thread (inside an epoch
+         guard).  Returns false if there is none. */
+        bool get(const std::size_t& x, type& t) const
+        {
+            const directory_data* d(this->directory.load());
+            if((d == nullptr) || ((x >> chunk_bits) >= d->size)) return false;
+            
+            const chunk_data* c(d->chunks[(x >> chunk_bits)].load(std::memory_order_acquire));
+            if(c == nullptr) return false;
+            
+            const slot_data& s(c->slots[(x & (chunk_size - 1))]);
+            if(!s.set.load(std::memory_order_relaxed)) return false;
+            t = s.value.load();
+            return true;
+        }
+        
+        void set(const std::size_t& x, const type& t)
+        {
+            slot_data& s(this->at(x));
+            s.value.store(t);
+            s.set.store(true, std::memory_order_relaxed);
+        }
+        
+        void unset(const std::size_t& x)
+        {
+            this->at(x).set.store(false, std::memory_order_relaxed);
+        }
+        
+        /** Returns the number of bytes the chunks and the directory take up.
+         Only the writer may call it. */
+        std::size_t bytes() const
+        {
+            const directory_data* d(this->directory.load(std::memory_order_relaxed));
+            std::size_t n(0);
+            for(std::size_t x = 0; ((d != nullptr) && (x < d->size)); x++)
+            {
+                if(d->chunks[x].load(std::memory_order_relaxed) != nullptr) n += sizeof(chunk_data);
+            }
+            if(d != nullptr) n += (d->size * sizeof(std::atomic<chunk_data*>));
+            return n;
+        }
+        
+        void clear()
+        {
+            directory_data* d(this->directory.load(std::memory_order_relaxed));
+            this->directory.store(nullptr);
+            if(d != nullptr) epoch::domain().retire(d, retire_all);
+        }
+        
+    private:
+        struct slot_data
+        {
+            relaxed_data<type> value;
+            std::atomic<bool> set;
+        };
+        
+        struct chunk_data
+        {
+            slot_data slots[chunk_size];
+        };
+        
+        struct directory_data
+        {
+            explicit directory_data(const std::size_t& n) : size(n), chunks(new std::atomic<chunk_data*>[n]())
+            {
+            }
+            
+            ~directory_data()
+            {
+                delete[] this->chunks;
+            }
+            
+            std::size_t size;
+            std::atomic<chunk_data*>* chunks;
+        };
+        
+        static const std::size_t min_chunks = 16;
+        
+        std::atomic<directory_data*> directory;
+        
+        /** Returns the slot at [x], making room for it first if needed. */
+        slot_data& at(const std::size_t& x)
+        {
+            directory_data* d(this->directory.load(std::memory_order_relaxed));
+            std::size_t chunk(x >> chunk_bits);
+            
+            if((d == nullptr) || (chunk >= d->size))
+            {
+                std::size_t n((d == nullptr) ? min_chunks : d->size);
+                while(n <= chunk) n *= 2;
+                
+                directory_data* bigger(new directory_data(n));
+                for(std::size_t y = 0; ((d != nullptr) && (y < d->size)); y++)
+                {
+                    bigger->chunks[y].store(d->chunks[y].load(std::memory_order_relaxed), std::memory_order_relaxed);
+                }
+                this->directory.store(bigger);
+                if(d != nullptr) epoch::domain().retire(d, retire_directory);
+                d = bigger;
+            }
+            
+            chunk_data* c(d->chunks[chunk].load(std::memory_order_relaxed));
+            if(c == nullptr)
+            {
+                c = new chunk_data();
+                d->chunks[chunk].store(c, std::memory_order_release);
+            }
+            return c->slots[(x & (chunk_size - 1))];
+        }
+        
+        static void retire_directory(void* d)
+        {
+            delete (directory_data*)d;
+        }
+        
+        /** Frees a directory and every chunk in it. */
+        static void release_all(directory_data* d)
+        {
+            for(std::size_t x = 0; ((d != nullptr) && (x < d->size)); x++)
+            {
+                delete d->chunks[x].load(std::memory_order_relaxed);
+            }
+            delete d;
+        }
+        
+        static void retire_all(void* d)
+        {
+            release_all((directory_data*)d);
+        }
+        
+    };
+    
+    template<class type>
+    const std::size_t array_class<type>::chunk_bits;
+    
+    template<class type>
+    const std::size_t array_class<type>::chunk_size;
+    
+    template<class type>
+    const std::size_t array_class<type>::min_chunks;
+    
+}
+
+#endif
@@ -0,0 +1,375 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2014 Jonathan Craig Whitlock
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+ */
+
+
+
+#ifndef SYMBOL_TABLE_HPP_INCLUDED
+#define SYMBOL_TABLE_HPP_INCLUDED
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+#include "hash_index.hpp"
+#include "chunk_vector.hpp"
+#include "shared_table.hpp"
+#include "allocation.hpp"
+
+namespace symbols
+{
+    /** The stable id a key is known by once it has been interned. */
+    typedef std::uint32_t id_type;
+    
+    const id_type no_id = 0xffffffffU;
+    
+    /** The text of an interned key.  It is not null-terminated, and its
+     bytes belong to the symbol table, which never moves or frees them. */
+    struct name_data
+    {
+        const char* data;
+        std::uint32_t size;
+        
+        bool equals(const char* d, const std::size_t& s) const
+        {
+            return ((this->size == s) && (std::memcmp(this->data, d, s) == 0));
+        }
+        
+        std::string str() const
+        {
+            return std::string(this->data, this->size);
+        }
+        
+        /** Reads a key stored as a record: its size (seven bits a byte, low
+         bits first, the top bit set on all but the last byte) and then its
+         bytes. */
+        static name_data read(const char* record)
+        {
+            std::uint32_t size(0);
+            unsigned int shift(0);
+            while((*record & 0x80) != 0)
+            {
+                size |= ((std::uint32_t)(*record & 0x7f) << shift);
+                shift += 7;
+                record++;
+            }
+            size |= ((std::uint32_t)*record << shift);
+            return name_data{(record + 1), size};
+        }
+        
+        /** Returns the number of bytes a record of a key of [size] bytes takes. */
+        static std::size_t record_size(std::size_t size)
+        {
+            std::size_t n(size + 1);
+            for(; size >= 0x80; size >>= 7) n++;
+            return n;
+        }
+        
+        /** Stores a key as a record at [record], which must have room for it. */
+        static void write(char* record, const char* d, std::size_t size)
+        {
+            const char* start(d);
+            std::size_t total(size);
+            for(; size >= 0x80; size >>= 7) *(record++) = (char)((size & 0x7f) | 0x80);
+            *(record++) = (char)size;
+            std::memcpy(record, start, total);
+        }
+    };
+    
+    /**
+     * Maps every key the database has seen to a small id, once.  The stack,
+     * the transaction blocks and the commands all refer to keys by id, so a
+     * key is hashed only when a command naming it is read, and its text is
+     * stored only here.  Ids are handed out in order, so they can index
+     * arrays directly.  Keys are not taken out one at a time, so each one is
+     * stored once, as a record (its size, then its bytes) packed after the
+     * last in an arena, and an id only costs a 4-byte ref to its record and a
+     * 6-byte index slot on top of that.  Keys nothing uses any more are given
+     * back all at once, by compact.
+     */
+    class symbol_table_class
+    {
+    public:
+        typedef allocation::arena_class::ref_type ref_type;
+        typedef chunk_vector::chunk_vector_class<ref_type> ref_list;
+        
+        /** The keys interned when it was made.  It can be read from another
+         thread while more are interned. */
+        class names_view
+        {
+        public:
+            explicit names_view(const ref_list::view_class& r, const allocation::arena_class::view_class& b) : 
+                    refs(r), bytes(b)
+            {
+            }
+            
+            name_data operator[](const std::size_t& id) const
+            {
+                return name_data::read(this->bytes.at(this->refs[id]));
+            }
+            
+            std::size_t size() const
+            {
+                return this->refs.size();
+            }
+            
+        private:
+            ref_list::view_class refs;
+            allocation::arena_class::view_class bytes;
+            
+        };
+        
+        explicit symbol_table_class() : bytes(), names(), index(), published(true), lock_free(false)
+        {
+        }
+        
+        /** Returns the id of a key, giving it one if it has none yet (or
+         no_id if there's no room for it). */
+        id_type intern(const char* data, const std::size_t& size)
+        {
+            return this->intern(data, size, hash_index::hash_bytes(data, size));
+        }
+        
+        id_type intern(const std::string& s)
+        {
+            return this->intern(s.data(), s.size());
+        }
+        
+        /** Interns a key whose hash is already known.  Returns no_id if it is
+         new and there's no room left for its record (see arena_class). */
+        id_type intern(const char* data, const std::size_t& size, const std::uint64_t& h)
+        {
+            if(!this->bytes.ref_room(name_data::record_size(size))) return this->find(data, size, h);
+            
+            id_type id(this->index.find_or_insert(h, name_equal(*this, data, size), this->names.size(),
+                    name_hash(*this)));
+            if(id == hash_index::index_class::npos)
+            {
+                ref_type ref(0);
+                char* record(this->bytes.allocate_ref(name_data::record_size(size), ref));
+                name_data::write(record, data, size);
+                id = this->names.size();
+                this->names.push_back(ref);
+                if(this->lock_free) this->published.insert(h, record, id);
+            }
+            return id;
+        }
+        
+        /** Interns [count] keys stored back to back at [data], the size of
+         each in [sizes], and puts their ids in [ids] (no_id for any there
+         was no room for).  Used for loading lots
+         of keys at once: they are hashed a batch at a time, and the index is
+         asked for the whole batch before any of it is used, so the cache
+         misses overlap instead of coming one after another. */
+        void intern_all(const char* data, const std::uint32_t* sizes, const std::size_t& count, id_type* ids)
+        {
+            const std::size_t batch(16);
+            std::uint64_t hashes[batch];
+            const char* starts[batch];
+            
+            for(std::size_t x = 0; x < count; x += batch)
+            {
+                std::size_t n(((count - x) < batch) ? (count - x) : batch);
+                for(std::size_t y = 0; y < n; y++)
+                {
+                    starts[y] = data;
+                    hashes[y] = hash_index::hash_bytes(data, sizes[(x + y)]);
+                    this->index.prefetch(hashes[y]);
+                    data += sizes[(x + y)];
+                }
+                for(std::size_t y = 0; y < n; y++) ids[(x + y)] = this->intern(starts[y], sizes[(x + y)], hashes[y]);
+            }
+        }
+        
+        /** Returns the id of a key, or no_id if it was never interned (in
+         which case no variable can have that name). */
+        id_type find(const char* data, const std::size_t& size) const
+        {
+            return this->find(data, size, hash_index::hash_bytes(data, size));
+        }
+        
+        id_type find(const char* data, const std::size_t& size, const std::uint64_t& h) const
+        {
+            return this->index.find(h, name_equal(*this, data, size));
+        }
+        
+        id_type find(const std::string& s) const
+        {
+            return this->find(s.data(), s.size());
+        }
+        
+        /** Like find, but without the table's lock: it may be called from
+         any thread inside an epoch guard, while keys are being interned.
+         Only works while lock-free reads are on. */
+        id_type find_shared(const char* data, const std::size_t& size, const std::uint64_t& h) const
+        {
+            std::uint64_t id(no_id);
+            this->published.find(h, [data, &size](const char* record){ return name_data::read(record).equals(data, size); }, id);
+            return (id_type)id;
+        }
+        
+        /** Turns lock-free lookups on or off. */
+        void set_lock_free_reads(const bool& b)
+        {
+            this->published.clear();
+            this->lock_free = b;
+            for(std::size_t x = 0; (b && (x < this->names.size())); x++)
+            {
+                name_data n(this->name(x));
+                this->published.insert(hash_index::hash_bytes(n.data, n.size), this->bytes.at(this->names[x]), x);
+            }
+        }
+        
+        /** Drops every key [keep] returns false for (it is called with each
+         id), and numbers the rest again from 0, in the order they were in.
+         Every id, name and view handed out before is meaningless afterward,
+         so this is only for when nothing holds one.  Returns the number of
+         keys dropped. */
+        template<class keep_type>
+        std::size_t compact(const keep_type& keep)
+        {
+            std::string kept;
+            std::vector<std::uint32_t> sizes;
+            for(std::size_t x = 0; x < this->names.size(); x++)
+            {
+                if(!keep((id_type)x)) continue;
+                name_data n(this->name(x));
+                kept.append(n.data, n.size);
+                sizes.push_back(n.size);
+            }
+            
+            std::size_t dropped(this->names.size() - sizes.size());
+            std::vector<id_type> ids(sizes.size());
+            this->bytes.clear();
+            this->names.clear();
+            this->index.clear();
+            this->reserve(sizes.size());
+            this->intern_all(kept.data(), sizes.data(), sizes.size(), ids.data());
+            this->set_lock_free_reads(this->lock_free);
+            return dropped;
+        }
+        
+        /** Returns the text of the key with id [id]. */
+        name_data name(const id_type& id) const
+        {
+            return name_data::read(this->bytes.at(this->names[id]));
+        }
+        
+        /** Returns a view of the keys interned so far that can be read from
+         another thread while more are interned. */
+        names_view view() const
+        {
+            return names_view(this->names.view(), this->bytes.view());
+        }
+        
+        /** Makes room for [n] keys in all, so interning them does not have to
+         grow the index. */
+        void reserve(const std::size_t& n)
+        {
+            this->index.reserve(n, name_hash(*this));
+        }
+        
+        /** Returns the number of bytes the keys, their refs and the index
+         (and the lock-free copy of it, if there is one) take up. */
+        std::size_t memory_bytes() const
+        {
+            return (this->bytes.bytes() + this->names.bytes() + this->index.bytes() + this->published.bytes());
+        }
+        
+        /** Returns the number of keys interned. */
+        std::size_t size() const
+        {
+            return this->names.size();
+        }
+        
+        /** Returns the state of the index (size, capacity, and how far along
+         an incremental resize is). */
+        hash_index::index_stats_data index_stats() const
+        {
+            return this->index.stats();
+        }
+        
+        /** Sets the maximum number of index slots a single new key migrates
+         while the index is growing. */
+        void set_rehash_step(const std::size_t& n)
+        {
+            this->index.set_step(n);
+            this->published.set_step(n);
+        }
+        
+    private:
+        
+        /** Compares a key against the one interned with an id. */
+        struct name_equal
+        {
+            name_equal(const symbol_table_class& t, const char* d, const std::size_t& s) : table(t), data(d), size(s)
+            {
+            }
+            
+            bool operator()(const std::uint32_t& id) const
+            {
+                return this->table.name(id).equals(this->data, this->size);
+            }
+            
+            const symbol_table_class& table;
+            const char* data;
+            std::size_t size;
+        };
+        
+        /** Hashes the key interned with an id again, for the index. */
+        struct name_hash
+        {
+            explicit name_hash(const symbol_table_class& t) : table(t)
+            {
+            }
+            
+            std::uint64_t operator()(const std::uint32_t& id) const
+            {
+                name_data n(this->table.name(id));
+                return hash_index::hash_bytes(n.data, n.size);
+            }
+            
+            void prefetch(const std::uint32_t& id) const
+            {
+                __builtin_prefetch(this->table.bytes.at(this->table.names[id]));
+            }
+            
+            const symbol_table_class& table;
+        };
+        
+        allocation::arena_class bytes;
+        ref_list names;
+        hash_index::index_class index;
+        
+        /* With [lock_free] on, [published] also maps every key to its id, for
+         readers that don't hold the lock.  It points at the records, which
+         never move. */
+        shared_table::table_class<const char*> published;
+        bool lock_free;
+        
+    };
+    
+}
+
+#endif
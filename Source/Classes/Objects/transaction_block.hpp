@@ -28,25 +28,41 @@
 #include <string>
 #include <iostream>
 #include <vector>
+#include <unordered_map>
+#include <unordered_set>
 
 #include "database_command.hpp"
 #include "variable_stack.hpp"
-#include "global_variables.hpp"
+#include "symbol_table.hpp"
+#include "shard_store.hpp"
+#include "write_log.hpp"
+#include "typed_value.hpp"
 
 namespace taction_block
 {
     
+    /** A write made inside a transaction block: a new value, or the
+     removal of the variable. */
+    template<class type>
+    struct write_data
+    {
+        bool removed = false;
+        var_stack::variable_data<type> var;
+    };
+    
     /**
      * Transaction block class is used to represent a transaction block.
+     * It never touches the stack: the block is an overlay holding the
+     * latest write to every variable changed in it, and how the number of
+     * variables equal to each value changed.  Reads look through the
+     * overlays of the open blocks before they look at the stack.
      */
     template<class type>
     class transaction_block_class
     {
     public:
         
-        /** Initializes a transaction block with the address of a stack which it will modify. */
-        explicit transaction_block_class(var_stack::stack_class<type>* s) : vstack(s),
-                commands()
+        explicit transaction_block_class() : writes(), count_deltas()
         {
         }
         
@@ -58,131 +74,553 @@ namespace taction_block
         /** Erases the data in the class. */
         void erase()
         {
-            this->commands.erase(this->commands.begin(), this->commands.end());
-            this->commands.shrink_to_fit();
+            this->writes.clear();
+            this->count_deltas.clear();
+        }
+        
+        /** Returns the write this block made to a variable, or nullptr if it
+         did not change it. */
+        const write_data<type>* find_write(const symbols::id_type& id) const
+        {
+            typename std::unordered_map<symbols::id_type, write_data<type> >::const_iterator it(this->writes.find(id));
+            if(it == this->writes.end()) return nullptr;
+            return &it->second;
+        }
+        
+        /** Records that a variable was set; [old] is what it was before
+         (nullptr if it did not exist).  The write is kept even if it changes
+         nothing yet, since another commit may change the variable first. */
+        void set_var(const symbols::id_type& id, const type& val, const var_stack::variable_data<type>* old)
+        {
+            if((old == nullptr) || (old->value != val))
+            {
+                if(old != nullptr) this->change_count(old->value, -1);
+                this->change_count(val, 1);
+            }
+            
+            write_data<type>& w(this->writes[id]);
+            w.removed = false;
+            w.var.id = id;
+            w.var.value = val;
+        }
+        
+        /** Records that a variable was removed; [old] is what it was before
+         (nullptr if it did not exist, which is still worth recording). */
+        void remove_var(const symbols::id_type& id, const var_stack::variable_data<type>* old)
+        {
+            if(old != nullptr) this->change_count(old->value, -1);
+            this->writes[id].removed = true;
+        }
+        
+        /** Returns how much the number of variables equal to [t] changed in 
+         this block. */
+        long long count_delta(const type& t) const
+        {
+            typename std::unordered_map<type, long long>::const_iterator it(this->count_deltas.find(t));
+            if(it == this->count_deltas.end()) return 0;
+            return it->second;
+        }
+        
+        const std::unordered_map<symbols::id_type, write_data<type> >& get_writes() const
+        {
+            return this->writes;
+        }
+        
+        /** Adds this block's writes to [merged], except for variables that
+         already have a write there (which must be from a newer block). */
+        void merge_into(std::unordered_map<symbols::id_type, write_data<type> >& merged) const
+        {
+            for(typename std::unordered_map<symbols::id_type, write_data<type> >::const_iterator it = 
+                    this->writes.begin(); it != this->writes.end(); ++it)
+            {
+                merged.insert(*it);
+            }
+        }
+        
+        /** Hands this block's writes over to [w], leaving the block empty. */
+        void take_writes(std::unordered_map<symbols::id_type, write_data<type> >& w)
+        {
+            w.clear();
+            w.swap(this->writes);
+            this->count_deltas.clear();
+        }
+        
+        const std::unordered_map<type, long long>& get_count_deltas() const
+        {
+            return this->count_deltas;
+        }
+        
+    private:
+        std::unordered_map<symbols::id_type, write_data<type> > writes;
+        std::unordered_map<type, long long> count_deltas;
+        
+        void change_count(const type& t, const long long& n)
+        {
+            long long& delta(this->count_deltas[t]);
+            delta += n;
+            if(delta == 0) this->count_deltas.erase(t);
+        }
+        
+    };
+    
+    /**
+     * The store as seen through the open transaction blocks.  It has the
+     * same interface as a stack_class, so commands are executed on it the
+     * same way; writes go into the innermost block, and nothing reaches
+     * the store until COMMIT.
+     * 
+     * When the store is versioned, a transaction is optimistic: it remembers
+     * what it read from the store (which variables, and which values it
+     * counted), and COMMIT fails if another commit has changed any of it
+     * since the transaction began.  Writes alone never conflict; the last
+     * commit wins.
+     */
+    template<class type>
+    class transaction_stack_class
+    {
+    public:
+        typedef shard_store::store_class<type> store_type;
+        
+        /** Initializes the view over the address of a store which it will modify. */
+        explicit transaction_stack_class(store_type* s) : store(s), blocks(), log(nullptr), started(0), 
+                read_keys(), read_values(), read_ranges(false), fetched()
+        {
+        }
+        
+        ~transaction_stack_class()
+        {
+            if(!this->blocks.empty()) this->store->transaction_closed();
         }
         
-        /** Adds a command to the transaction block. */
-        void add_command(const db_command::database_command_data& com)
+        transaction_stack_class(const transaction_stack_class<type>&) = delete;
+        transaction_stack_class<type>& operator=(const transaction_stack_class<type>&) = delete;
+        
+        /** Sets the log committed changes are recorded in (nullptr for none). */
+        void set_log(write_log::log_class* l)
         {
-            this->commands.push_back(com);
+            this->log = l;
         }
         
-        /** Executes all the commands on the pointed stack
-         that were added to the transaction block. */
-        void commit_changes()
+        /** Opens a new (innermost) transaction block. */
+        void begin()
         {
-            for(auto command : this->commands) db_command::execute_command(command, this->vstack);
+            if(this->blocks.empty())
+            {
+                this->store->transaction_opened();
+                if(this->store->is_versioned()) this->started = this->store->now();
+            }
+            this->blocks.push_back(transaction_block_class<type>());
         }
         
-        /** Displays the result of the command at index [loc], 
-         calculating the effects of the previous commands. */
-        void preview_change(const unsigned int& loc)
+        /** Throws away the innermost block.  Returns false if there is none. */
+        bool rollback()
         {
-            unsigned int size(this->commands.size());
-            std::string temps;
-            std::vector<db_command::database_command_data> counter_commands;
-            if(loc < size)
+            if(this->blocks.empty()) return false;
+            this->blocks.pop_back();
+            if(this->blocks.empty())
             {
-                for(unsigned int x = 0; ((x <= loc) && (x < size)); x++)
+                this->forget_reads();
+                this->store->transaction_closed();
+            }
+            return true;
+        }
+        
+        /** Applies every open block to the store and closes them all.  The
+         blocks are first merged into one write set where the newest write to
+         each variable wins, so each variable changed in the transaction is
+         written to the store (and has its value counted) exactly once.  The
+         same write set is logged as a single record.
+         Every shard the transaction read or writes is locked (in order) while
+         it is checked and applied, so other threads see all of it or none.
+         Returns false if the transaction conflicts with a commit made since it
+         began; it is thrown away then, and nothing is written. */
+        bool commit()
+        {
+            if(this->blocks.empty()) return true;
+            
+            std::unordered_map<symbols::id_type, write_data<type> > merged;
+            bool valid(false);
+            this->blocks.back().take_writes(merged);
+            for(unsigned int x = (this->blocks.size() - 1); x > 0; x--) this->blocks[x - 1].merge_into(merged);
+            this->blocks.clear();
+            this->store->transaction_closed();
+            
+            std::vector<std::size_t> shards(this->involved(merged));
+            {
+                typename store_type::lock_class lock(*this->store, shards, store_type::writing);
+                valid = this->validate();
+                if(valid)
                 {
-                    counter_commands.push_back(this->find_counter_command(this->commands[x]));
-                    if(counter_commands.back().command == db_command::null_com)
+                    unsigned long long stamp(this->store->is_versioned() ? this->store->next() : 0);
+                    if(this->log != nullptr) this->log->begin_record();
+                    for(typename std::unordered_map<symbols::id_type, write_data<type> >::const_iterator it = 
+                            merged.begin(); it != merged.end(); ++it)
                     {
-                        counter_commands.pop_back();
+                        if(it->second.removed) this->remove_committed(it->first, stamp);
+                        else this->set_committed(it->first, it->second.var.value, stamp);
                     }
+                    if(this->log != nullptr) this->log->end_record();
                 }
-                for(unsigned int x = 0; x <= loc; x++)
+            }
+            this->forget_reads();
+            return valid;
+        }
+        
+        /** Returns the number of open blocks. */
+        unsigned int depth() const
+        {
+            return this->blocks.size();
+        }
+        
+        /** Returns the variable with key id [id], or nullptr if there isn't
+         one.  The store may change as soon as its lock is let go, so what it
+         holds is copied; the pointer is good until the next call. */
+        const var_stack::variable_data<type>* find_var(const symbols::id_type& id) const
+        {
+            bool from_stack(false);
+            const var_stack::variable_data<type>* var(this->lookup(id, from_stack));
+            if(from_stack && !this->blocks.empty() && this->store->is_versioned()) this->read_keys.insert(id);
+            return var;
+        }
+        
+        bool var_exists(const symbols::id_type& id) const
+        {
+            return (this->find_var(id) != nullptr);
+        }
+        
+        void set_var(const symbols::id_type& id, const type& val)
+        {
+            bool from_stack(false);
+            if(this->blocks.empty())
+            {
+                typename store_type::lock_class lock(*this->store, this->store->shard_of(id), store_type::writing);
+                if(this->log != nullptr) this->log->begin_record();
+                this->set_committed(id, val, (this->store->is_versioned() ? this->store->next() : 0));
+                if(this->log != nullptr) this->log->end_record();
+            }
+            else this->blocks.back().set_var(id, val, this->lookup(id, from_stack));
+        }
+        
+        void remove_var(const symbols::id_type& id)
+        {
+            bool from_stack(false);
+            if(id == symbols::no_id) return;
+            if(this->blocks.empty())
+            {
+                typename store_type::lock_class lock(*this->store, this->store->shard_of(id), store_type::writing);
+                if(this->log != nullptr) this->log->begin_record();
+                this->remove_committed(id, (this->store->is_versioned() ? this->store->next() : 0));
+                if(this->log != nullptr) this->log->end_record();
+            }
+            else this->blocks.back().remove_var(id, this->lookup(id, from_stack));
+        }
+        
+        /** Returns the number of variables that match a specified value. */
+        unsigned long long find_values(const type& t) const
+        {
+            if(!this->blocks.empty() && this->store->is_versioned()) this->read_values.insert(t);
+            long long n(this->store->count_equal(t));
+            if(this->deltas_current())
+            {
+                for(unsigned int x = 0; x < this->blocks.size(); x++) n += this->blocks[x].count_delta(t);
+            }
+            else n += this->rebuilt_delta([&t](const type& v){ return (v == t); });
+            return counted(n);
+        }
+        
+        unsigned long long find_values_between(const type& low, const type& high) const
+        {
+            this->read_range();
+            long long n(this->store->count_between(low, high));
+            return counted(n + this->delta([&low, &high](const type& t)
+            {
+                return (!(t < low) && !(high < t));
+            }));
+        }
+        
+        unsigned long long find_values_less(const type& v) const
+        {
+            this->read_range();
+            long long n(this->store->count_less(v));
+            return counted(n + this->delta([&v](const type& t)
+            {
+                return (t < v);
+            }));
+        }
+        
+        unsigned long long find_values_greater(const type& v) const
+        {
+            this->read_range();
+            long long n(this->store->count_greater(v));
+            return counted(n + this->delta([&v](const type& t)
+            {
+                return (v < t);
+            }));
+        }
+        
+        /** Calls [f] with the key id of every variable equal to [t].  Returns
+         false if the key index is off. */
+        template<class function_type>
+        bool for_each_key(const type& t, const function_type& f) const
+        {
+            std::unordered_set<symbols::id_type> seen;
+            
+            if(!this->key_index_enabled()) return false;
+            if(!this->blocks.empty() && this->store->is_versioned()) this->read_values.insert(t);
+            
+            /* First the variables written in the blocks (the innermost write
+             to each one is the one that counts)... */
+            for(typename std::vector<transaction_block_class<type> >::const_reverse_iterator it = 
+                    this->blocks.rbegin(); it != this->blocks.rend(); ++it)
+            {
+                const std::unordered_map<symbols::id_type, write_data<type> >& writes(it->get_writes());
+                for(typename std::unordered_map<symbols::id_type, write_data<type> >::const_iterator w = 
+                        writes.begin(); w != writes.end(); ++w)
                 {
-                    temps = db_command::execute_command(this->commands[x], this->vstack);
-                    if(x == loc)
+                    if(seen.insert(w->first).second && !w->second.removed && (w->second.var.value == t)) 
                     {
-                        if(temps.size() > 0)
-                        {
-                            std::cout<< temps<< '\n';
-                        }
+                        f(w->first);
                     }
                 }
-                for(std::vector<db_command::database_command_data>::reverse_iterator it =
-                        counter_commands.rbegin(); it != counter_commands.rend(); it++)
+            }
+            
+            /* ...then the ones in the store that no block has touched. */
+            return this->store->for_each_key(t, [&seen, &f](const symbols::id_type& id)
+            {
+                if(seen.find(id) == seen.end()) f(id);
+            });
+        }
+        
+        bool key_index_enabled() const
+        {
+            return this->store->key_index_enabled();
+        }
+        
+        /** Returns the number of variables in the store itself. */
+        unsigned int size() const
+        {
+            return this->store->size();
+        }
+        
+    private:
+        store_type* store;
+        std::vector<transaction_block_class<type> > blocks;
+        write_log::log_class* log;
+        
+        /* The last commit the open transaction has seen, and what it read
+         from the store (counting a range of values reads them all).  Reads
+         are only kept when the store is versioned. */
+        unsigned long long started;
+        mutable std::unordered_set<symbols::id_type> read_keys;
+        mutable std::unordered_set<type> read_values;
+        mutable bool read_ranges;
+        
+        /* The last variable read from the store. */
+        mutable var_stack::variable_data<type> fetched;
+        
+        /** Looks a variable up without counting it as read.  [from_stack] is
+         set if the store answered, rather than an open block. */
+        const var_stack::variable_data<type>* lookup(const symbols::id_type& id, bool& from_stack) const
+        {
+            for(typename std::vector<transaction_block_class<type> >::const_reverse_iterator it = 
+                    this->blocks.rbegin(); it != this->blocks.rend(); ++it)
+            {
+                const write_data<type>* w(it->find_write(id));
+                if(w != nullptr) return (w->removed ? nullptr : &w->var);
+            }
+            from_stack = true;
+            if(!this->store->get(id, this->fetched)) return nullptr;
+            return &this->fetched;
+        }
+        
+        void read_range() const
+        {
+            if(!this->blocks.empty() && this->store->is_versioned()) this->read_ranges = true;
+        }
+        
+        /** Returns the shards a commit of [writes] has to lock, in order:
+         the ones it writes to and read variables from, or all of them if it
+         counted values.  None need locking unless the store is concurrent. */
+        std::vector<std::size_t> involved(const std::unordered_map<symbols::id_type, write_data<type> >& writes) const
+        {
+            std::vector<std::size_t> shards;
+            if(!this->store->is_concurrent()) return shards;
+            
+            std::vector<bool> marked(this->store->shard_count(), (this->read_ranges || !this->read_values.empty()));
+            for(typename std::unordered_map<symbols::id_type, write_data<type> >::const_iterator it = 
+                    writes.begin(); it != writes.end(); ++it)
+            {
+                marked[this->store->shard_of(it->first)] = true;
+            }
+            for(typename std::unordered_set<symbols::id_type>::const_iterator it = this->read_keys.begin(); 
+                    it != this->read_keys.end(); ++it)
+            {
+                if(*it != symbols::no_id) marked[this->store->shard_of(*it)] = true;
+            }
+            for(std::size_t x = 0; x < marked.size(); x++)
+            {
+                if(marked[x]) shards.push_back(x);
+            }
+            return shards;
+        }
+        
+        /** Returns true if nothing the transaction read has been changed by a
+         commit since it began.  The shards it read must be locked. */
+        bool validate() const
+        {
+            if(!this->store->is_versioned()) return true;
+            for(std::size_t x = 0; (this->read_ranges && (x < this->store->shard_count())); x++)
+            {
+                if(this->store->shard(x).versions.anything_changed_since(this->started)) return false;
+            }
+            for(typename std::unordered_set<symbols::id_type>::const_iterator it = this->read_keys.begin(); 
+                    it != this->read_keys.end(); ++it)
+            {
+                if((*it != symbols::no_id) && this->store->shard(this->store->shard_of(*it)).versions.key_changed_since(
+                        this->store->local(*it), this->started))
                 {
-                    db_command::execute_command(*it, this->vstack);
+                    return false;
                 }
             }
+            for(typename std::unordered_set<type>::const_iterator it = this->read_values.begin(); 
+                    it != this->read_values.end(); ++it)
+            {
+                for(std::size_t x = 0; x < this->store->shard_count(); x++)
+                {
+                    if(this->store->shard(x).versions.value_changed_since(*it, this->started)) return false;
+                }
+            }
+            return true;
         }
         
-        /** Returns the number of commands currently stored in the transaction. */
-        unsigned int command_count() const
+        void forget_reads()
         {
-            return this->commands.size();
+            this->read_keys.clear();
+            this->read_values.clear();
+            this->read_ranges = false;
         }
         
-    private:
-        var_stack::stack_class<type> *vstack;
-        std::vector<db_command::database_command_data> commands;
+        /** Writes to the store itself, adding the change to the open log
+         record and stamping it with commit number [stamp] in its shard's
+         version table.  Writes that change nothing are neither logged nor
+         stamped.  The shard must be locked. */
+        void set_committed(const symbols::id_type& id, const type& val, const unsigned long long& stamp)
+        {
+            typename store_type::shard_data& shard(this->store->shard(this->store->shard_of(id)));
+            symbols::id_type local(this->store->local(id));
+            if((this->log != nullptr) || this->store->is_versioned())
+            {
+                const type* old(shard.vars.find_value(local));
+                if((old != nullptr) && old->identical(val)) return;
+                if(this->log != nullptr)
+                {
+                    symbols::name_data name(shard.keys.name(local));
+                    this->log->log_set(name.data, name.size, val);
+                }
+                if(this->store->is_versioned())
+                {
+                    shard.versions.key_changed(local, stamp);
+                    shard.versions.value_changed(val, stamp);
+                    if(old != nullptr) shard.versions.value_changed(*old, stamp);
+                }
+            }
+            shard.vars.set_var(local, val);
+        }
         
-        /** Returns a command that should reverse the effect of a command that it's
-         given.  If no command counters it, such as a "GET" command, then it will
-         return null_com.*/
-        db_command::database_command_data find_counter_command(const db_command::database_command_data& command) const
+        void remove_committed(const symbols::id_type& id, const unsigned long long& stamp)
         {
-            db_command::database_command_data counter;
-            counter.command = db_command::null_com;
-            if(command.args.size() > 0)
+            typename store_type::shard_data& shard(this->store->shard(this->store->shard_of(id)));
+            symbols::id_type local(this->store->local(id));
+            if((this->log != nullptr) || this->store->is_versioned())
             {
-                switch(command.command)
+                const type* old(shard.vars.find_value(local));
+                if(old == nullptr) return;
+                if(this->log != nullptr)
                 {
-                    case db_command::setvar:
-                    {
-                        switch(this->vstack->var_exists(command.args[0]))
-                        {
-                            case true:
-                            {
-                                counter.command = db_command::setvar;
-                                counter.args.push_back(command.args[0]);
-                                counter.args.push_back(std::to_string(this->vstack->find_name(command.args[0]).value));
-                            }
-                            break;
-                            
-                            case false:
-                            {
-                                counter.command = db_command::unsetvar;
-                                counter.args.push_back(command.args[0]);
-                            }
-                            break;
-                            
-                            default:
-                            {
-                            }
-                            break;
-                        }
-                    }
-                    break;
-
-                    case db_command::unsetvar:
-                    {
-                        if(this->vstack->var_exists(command.args[0]))
-                        {
-                            counter.command = db_command::setvar;
-                            counter.args.push_back(command.args[0]);
-                            counter.args.push_back(std::to_string(this->vstack->find_name(command.args[0]).value));
-                        }
-                    }
-                    break;
-
-                    default:
-                    {
-                    }
-                    break;
+                    symbols::name_data name(shard.keys.name(local));
+                    this->log->log_unset(name.data, name.size);
+                }
+                if(this->store->is_versioned())
+                {
+                    shard.versions.key_changed(local, stamp);
+                    shard.versions.value_changed(*old, stamp);
+                }
+            }
+            shard.vars.remove_var(local);
+        }
+        
+        /** Returns true if the blocks' count changes are still relative to
+         the store as it is: they were worked out against what it held when
+         each write was made, so that is only so if nothing has been committed
+         since the transaction began.  A count must be read before this is
+         asked. */
+        bool deltas_current() const
+        {
+            return (!this->store->is_versioned() || (this->store->now() == this->started));
+        }
+        
+        /** Returns how much the open blocks change the number of variables
+         that [in_range] accepts. */
+        template<class function_type>
+        long long delta(const function_type& in_range) const
+        {
+            long long n(0);
+            if(!this->deltas_current()) return this->rebuilt_delta(in_range);
+            for(unsigned int x = 0; x < this->blocks.size(); x++) n += sum_deltas(this->blocks[x], in_range);
+            return n;
+        }
+        
+        /** Works the change out again from the writes and what the store
+         holds now: the innermost write to each variable, less its value in
+         the store. */
+        template<class function_type>
+        long long rebuilt_delta(const function_type& in_range) const
+        {
+            std::unordered_set<symbols::id_type> seen;
+            var_stack::variable_data<type> base;
+            long long n(0);
+            
+            for(typename std::vector<transaction_block_class<type> >::const_reverse_iterator it = 
+                    this->blocks.rbegin(); it != this->blocks.rend(); ++it)
+            {
+                const std::unordered_map<symbols::id_type, write_data<type> >& writes(it->get_writes());
+                for(typename std::unordered_map<symbols::id_type, write_data<type> >::const_iterator w = 
+                        writes.begin(); w != writes.end(); ++w)
+                {
+                    if(!seen.insert(w->first).second) continue;
+                    if(!w->second.removed && in_range(w->second.var.value)) n++;
+                    if(this->store->get(w->first, base) && in_range(base.value)) n--;
                 }
             }
-            return counter;
+            return n;
+        }
+        
+        /** A count the store and the deltas are read for separately can
+         come out below 0 if a commit lands in between; it is never less. */
+        static unsigned long long counted(const long long& n)
+        {
+            return ((n < 0) ? 0 : (unsigned long long)n);
+        }
+        
+        /** Adds up a block's count changes for the values that [in_range] accepts. */
+        template<class function_type>
+        static long long sum_deltas(const transaction_block_class<type>& block, const function_type& in_range)
+        {
+            long long n(0);
+            const std::unordered_map<type, long long>& deltas(block.get_count_deltas());
+            for(typename std::unordered_map<type, long long>::const_iterator it = deltas.begin(); 
+                    it != deltas.end(); ++it)
+            {
+                if(in_range(it->first)) n += it->second;
+            }
+            return n;
         }
         
     };
     
-    template class transaction_block_class<int>;
+    template class transaction_block_class<typed_value::value_class>;
+    template class transaction_stack_class<typed_value::value_class>;
     
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,293 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2014 Jonathan Craig Whitlock
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+ */
+
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <limits>
+
+#include "typed_value.hpp"
+#include "hash_index.hpp"
+
+namespace
+{
+    /* 2^63, the first double past the end of an int64 (and -2^63 is its
+     first). */
+    const double integer_limit = 9223372036854775808.0;
+    
+    /** Compares an integer with a real exactly, without rounding the integer
+     to a double. */
+    int compare_mixed(const std::int64_t& n, const double& d)
+    {
+        if(d >= integer_limit) return -1;
+        if(d < -integer_limit) return 1;
+        
+        std::int64_t whole((std::int64_t)d);
+        if(n != whole) return ((n < whole) ? -1 : 1);
+        
+        double fraction(d - (double)whole);
+        if(fraction > 0) return -1;
+        if(fraction < 0) return 1;
+        return 0;
+    }
+    
+    int compare_numbers(const typed_value::value_class& a, const typed_value::value_class& b)
+    {
+        if(a.kind() == typed_value::integer_kind)
+        {
+            if(b.kind() == typed_value::integer_kind)
+            {
+                return ((a.as_integer() < b.as_integer()) ? -1 : ((a.as_integer() > b.as_integer()) ? 1 : 0));
+            }
+            return compare_mixed(a.as_integer(), b.as_real());
+        }
+        if(b.kind() == typed_value::integer_kind) return -compare_mixed(b.as_integer(), a.as_real());
+        return ((a.as_real() < b.as_real()) ? -1 : ((a.as_real() > b.as_real()) ? 1 : 0));
+    }
+    
+    /** Returns true if the [size] characters at [s] only use the characters
+     of a decimal number (strtod also reads hex, "inf" and "nan"). */
+    bool decimal_characters(const char* s, const std::size_t& size)
+    {
+        bool digit(false);
+        for(std::size_t x = 0; x < size; x++)
+        {
+            if((s[x] >= '0') && (s[x] <= '9')) digit = true;
+            else if((s[x] != '.') && (s[x] != 'e') && (s[x] != 'E') && (s[x] != '-') && (s[x] != '+')) return false;
+        }
+        return digit;
+    }
+    
+    enum number_type
+    {
+        not_number = 0,
+        integer_number,
+        real_number,
+        bad_number
+    };
+    
+    /** Reads a whole number.  Returns bad_number if it is one, but too big
+     for an int64. */
+    number_type read_integer(const char* s, const std::size_t& size, std::int64_t& n)
+    {
+        std::uint64_t magnitude(0), limit((std::uint64_t)std::numeric_limits<std::int64_t>::max());
+        std::size_t x(0);
+        bool negative(false), overflow(false);
+        
+        if((size > 0) && ((s[0] == '-') || (s[0] == '+')))
+        {
+            negative = (s[0] == '-');
+            x++;
+        }
+        if(x == size) return not_number;
+        if(negative) limit++;
+        for(; x < size; x++)
+        {
+            if((s[x] < '0') || (s[x] > '9')) return not_number;
+            std::uint64_t digit(s[x] - '0');
+            if(magnitude > ((limit - digit) / 10)) overflow = true;
+            else magnitude = ((magnitude * 10) + digit);
+        }
+        if(overflow) return bad_number;
+        n = (negative ? (std::int64_t)(0 - magnitude) : (std::int64_t)magnitude);
+        return integer_number;
+    }
+    
+    /** Reads anything strtod takes whole for a number; only finite decimal
+     numbers are accepted, the rest (hex, inf, nan, overflow) are
+     bad_number. */
+    number_type read_real(const char* s, const std::size_t& size, double& d)
+    {
+        char copy[64];
+        
+        if(size >= sizeof(copy)) return not_number;
+        std::memcpy(copy, s, size);
+        copy[size] = 0;
+        
+        char* end(nullptr);
+        d = std::strtod(copy, &end);
+        if((size == 0) || (end != (copy + size))) return not_number;
+        if(!decimal_characters(s, size) || !std::isfinite(d)) return bad_number;
+        return real_number;
+    }
+    
+    
+}
+
+namespace typed_value
+{
+    const std::size_t value_class::max_text;
+    const std::size_t value_class::max_format;
+    const std::size_t value_class::max_encoded;
+    
+    int value_class::compare(const value_class& v) const
+    {
+        bool text(this->kind() == text_kind), other_text(v.kind() == text_kind);
+        
+        if(!text && !other_text) return compare_numbers(*this, v);
+        if(text != other_text) return (text ? 1 : -1);
+        
+        std::size_t size(this->text_size()), other_size(v.text_size());
+        int c(std::memcmp(this->bytes, v.bytes, ((size < other_size) ? size : other_size)));
+        if(c != 0) return c;
+        return ((size < other_size) ? -1 : ((size > other_size) ? 1 : 0));
+    }
+    
+    std::uint64_t value_class::slow_hash() const
+    {
+        if(this->kind() == text_kind) return hash_index::hash_bytes(this->bytes, this->text_size());
+        
+        /* A whole real hashes like the integer it equals. */
+        double d(this->as_real());
+        if((d >= -integer_limit) && (d < integer_limit) && (d == std::trunc(d)))
+        {
+            return hash_index::hash_int((std::uint64_t)(std::int64_t)d);
+        }
+        std::uint64_t bits(0);
+        std::memcpy(&bits, &d, sizeof(d));
+        return hash_index::hash_int(bits);
+    }
+    
+    std::size_t value_class::format(char* out) const
+    {
+        switch(this->kind())
+        {
+            case integer_kind:
+            {
+                std::int64_t n(this->as_integer());
+                std::uint64_t magnitude((n < 0) ? (0 - (std::uint64_t)n) : (std::uint64_t)n);
+                char digits[20];
+                std::size_t count(0), size(0);
+                
+                do
+                {
+                    digits[count++] = (char)('0' + (magnitude % 10));
+                    magnitude /= 10;
+                }while(magnitude > 0);
+                if(n < 0) out[size++] = '-';
+                while(count > 0) out[size++] = digits[--count];
+                return size;
+            }
+            break;
+            
+            case real_kind:
+            {
+                /* The shortest of these that reads back as the same double. */
+                double d(this->as_real());
+                int size(0);
+                for(int precision = 15; precision <= 17; precision++)
+                {
+                    size = std::snprintf(out, max_format, "%.*g", precision, d);
+                    if(std::strtod(out, nullptr) == d) break;
+                }
+                if(std::strpbrk(out, ".e") == nullptr)
+                {
+                    out[size++] = '.';
+                    out[size++] = '0';
+                }
+                return (std::size_t)size;
+            }
+            break;
+            
+            case text_kind:
+            {
+                std::memcpy(out, this->bytes, this->text_size());
+                return this->text_size();
+            }
+            break;
+            
+            default:
+            {
+            }
+            break;
+        }
+        return 0;
+    }
+    
+    bool value_class::parse(const char* s, const std::size_t& size, value_class& v)
+    {
+        std::int64_t n(0);
+        double d(0);
+        number_type read(read_integer(s, size, n));
+        
+        if(read == not_number) read = read_real(s, size, d);
+        switch(read)
+        {
+            case integer_number:
+            {
+                v = integer(n);
+            }
+            break;
+            
+            case real_number:
+            {
+                v = real(d);
+            }
+            break;
+            
+            case not_number:
+            {
+                if(size > max_text) return false;
+                v = text(s, size);
+            }
+            break;
+            
+            default:
+            {
+                return false;
+            }
+            break;
+        }
+        return true;
+    }
+    
+    std::size_t value_class::encode(char* out) const
+    {
+        std::size_t size((this->kind() == text_kind) ? this->text_size() : sizeof(std::int64_t));
+        out[0] = (char)this->info;
+        std::memcpy((out + 1), this->bytes, size);
+        return (size + 1);
+    }
+    
+    std::size_t value_class::decode(const char* p, const std::size_t& size, value_class& v)
+    {
+        if(size == 0) return 0;
+        
+        value_class read;
+        read.info = (std::uint8_t)p[0];
+        if((read.kind() > text_kind) || ((read.kind() != text_kind) && (read.text_size() != 0))) return 0;
+        
+        std::size_t used((read.kind() == text_kind) ? read.text_size() : sizeof(std::int64_t));
+        if((size - 1) < used) return 0;
+        std::memcpy(read.bytes, (p + 1), used);
+        if((read.kind() == real_kind) && !std::isfinite(read.as_real())) return 0;
+        v = read;
+        return (used + 1);
+    }
+    
+    
+}
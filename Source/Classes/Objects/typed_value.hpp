@@ -0,0 +1,217 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2014 Jonathan Craig Whitlock
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+ */
+
+
+#ifndef TYPED_VALUE_HPP_INCLUDED
+#define TYPED_VALUE_HPP_INCLUDED
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+
+#include "hash_index.hpp"
+
+namespace typed_value
+{
+    enum kind_type
+    {
+        integer_kind = 0,
+        real_kind,
+        text_kind
+    };
+    
+    /**
+     * A value stored in the database: a 64-bit integer, a double, or a
+     * string of up to max_text bytes, kept inline in 16 bytes.  Integers and
+     * reals compare as numbers (so 2 equals 2.0, and they hash alike); every
+     * text is greater than every number, and texts compare byte by byte.
+     */
+    class value_class
+    {
+    public:
+        static const std::size_t max_text = 15;
+        
+        /** The most characters format() can write. */
+        static const std::size_t max_format = 32;
+        
+        /** The most bytes encode() can write. */
+        static const std::size_t max_encoded = 16;
+        
+        explicit value_class() : bytes(), info(integer_kind)
+        {
+        }
+        
+        static value_class integer(const std::int64_t& n)
+        {
+            value_class v;
+            std::memcpy(v.bytes, &n, sizeof(n));
+            return v;
+        }
+        
+        /** [d] must be finite. */
+        static value_class real(const double& d)
+        {
+            value_class v;
+            std::memcpy(v.bytes, &d, sizeof(d));
+            v.info = real_kind;
+            return v;
+        }
+        
+        /** [size] must not be more than max_text. */
+        static value_class text(const char* data, const std::size_t& size)
+        {
+            value_class v;
+            std::memcpy(v.bytes, data, size);
+            v.info = (std::uint8_t)(text_kind | (size << 4));
+            return v;
+        }
+        
+        kind_type kind() const
+        {
+            return (kind_type)(this->info & 0x0f);
+        }
+        
+        std::int64_t as_integer() const
+        {
+            std::int64_t n(0);
+            std::memcpy(&n, this->bytes, sizeof(n));
+            return n;
+        }
+        
+        double as_real() const
+        {
+            double d(0);
+            std::memcpy(&d, this->bytes, sizeof(d));
+            return d;
+        }
+        
+        const char* text_data() const
+        {
+            return this->bytes;
+        }
+        
+        std::size_t text_size() const
+        {
+            return (this->info >> 4);
+        }
+        
+        bool operator==(const value_class& v) const
+        {
+            if((this->info == integer_kind) && (v.info == integer_kind)) return (this->as_integer() == v.as_integer());
+            return (this->compare(v) == 0);
+        }
+        
+        bool operator!=(const value_class& v) const
+        {
+            return !(this->operator==(v));
+        }
+        
+        bool operator<(const value_class& v) const
+        {
+            if((this->info == integer_kind) && (v.info == integer_kind)) return (this->as_integer() < v.as_integer());
+            return (this->compare(v) < 0);
+        }
+        
+        bool operator>(const value_class& v) const
+        {
+            return v.operator<(*this);
+        }
+        
+        bool operator<=(const value_class& v) const
+        {
+            return !v.operator<(*this);
+        }
+        
+        bool operator>=(const value_class& v) const
+        {
+            return !this->operator<(v);
+        }
+        
+        /** Returns true if [v] is the same kind of value with the same bits.
+         Equal values need not be identical (1 and 1.0, or 0 and -0.0), so
+         replacing a value only changes nothing if the new one is. */
+        bool identical(const value_class& v) const
+        {
+            if(this->info != v.info) return false;
+            return (std::memcmp(this->bytes, v.bytes, ((this->kind() == text_kind) ? this->text_size() : 
+                    sizeof(std::int64_t))) == 0);
+        }
+        
+        /** Returns less than, equal to, or greater than 0 as this value is
+         less than, equal to, or greater than [v]. */
+        int compare(const value_class&) const;
+        
+        /** Equal values hash the same, whatever their kind. */
+        std::uint64_t hash() const
+        {
+            if(this->info == integer_kind) return hash_index::hash_int((std::uint64_t)this->as_integer());
+            return this->slow_hash();
+        }
+        
+        /** Writes the value as text to [out], which has room for max_format
+         characters, and returns how many it wrote.  Reals always show a
+         point or an exponent, so they read back as reals. */
+        std::size_t format(char* out) const;
+        
+        /** Reads the [size] characters at [s]: a whole number is an integer,
+         any other decimal number is a real, and anything strtod would not
+         take for a number is text.  Returns false if it is a whole number
+         that doesn't fit in 64 bits, a number that isn't finite or isn't
+         decimal (such as 1e400, nan or 0x10), or text longer than max_text. */
+        static bool parse(const char* s, const std::size_t& size, value_class& v);
+        
+        /** Writes the value in the form it is saved in (a byte holding its
+         kind and the length of a text, then the 8 bytes of a number or the
+         text) to [out], and returns how many bytes that took. */
+        std::size_t encode(char* out) const;
+        
+        /** Reads a value that encode() wrote from the [size] bytes at [p].
+         Returns how many bytes it used, or 0 if they don't hold one. */
+        static std::size_t decode(const char* p, const std::size_t& size, value_class& v);
+        
+    private:
+        char bytes[max_text];
+        
+        /* The kind in the low 4 bits, and the length of a text above them. */
+        std::uint8_t info;
+        
+        std::uint64_t slow_hash() const;
+        
+    };
+}
+
+namespace std
+{
+    /** So values can key the standard unordered containers. */
+    template<>
+    struct hash<typed_value::value_class>
+    {
+        std::size_t operator()(const typed_value::value_class& v) const
+        {
+            return (std::size_t)v.hash();
+        }
+    };
+}
+
+#endif
@@ -0,0 +1,289 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2014 Jonathan Craig Whitlock
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+ */
+
+
+
+#ifndef VALUE_COUNT_HPP_INCLUDED
+#define VALUE_COUNT_HPP_INCLUDED
+#include <vector>
+#include <utility>
+#include <cstdint>
+#include <cstddef>
+
+#include "global_defines.hpp"
+#include "hash_index.hpp"
+#include "chunk_vector.hpp"
+#include "allocation.hpp"
+
+namespace var_stack
+{
+    
+    /**
+     * Counts how many variables hold each value.  The counts are kept densely
+     * packed and indexed by a flat hash table, so a count is found with one
+     * probe, and a value disappears from the table when its count drops to 0.
+     * 
+     * If the key index is on, each value also keeps the list of variables
+     * (by their key id) that hold it.  A variable's place in
+     * that list is its "slot", which the stack has to remember so that the
+     * variable can be taken out of the list without searching it.  The
+     * lists get their memory from the stack's resource.
+     */
+    template<class type, class policy>
+    class count_class
+    {
+    public:
+        static const std::uint32_t npos = hash_index::index_class::npos;
+        
+        typedef typename policy::resource_type resource_type;
+        typedef std::vector<std::uint32_t, allocation::allocator_class<std::uint32_t, resource_type> > key_list;
+        
+        explicit count_class(resource_type& r) : counts(), values(), memory(&r), 
+                track_keys(KEY_INDEX_ENABLED)
+        {
+        }
+        
+        count_class(const count_class<type, policy>&) = delete;
+        
+        /** Copies the counts (and lists) of another, keeping its own resource. */
+        const count_class<type, policy>& operator=(const count_class<type, policy>& c)
+        {
+            if(this != &c)
+            {
+                this->clear();
+                for(std::size_t x = 0; x < c.counts.size(); x++)
+                {
+                    this->counts.push_back(count_data(this->memory));
+                    this->counts.back().value = c.counts[x].value;
+                    this->counts.back().count = c.counts[x].count;
+#if KEY_INDEX_ENABLED
+                    this->counts.back().keys.assign(c.counts[x].keys.begin(), c.counts[x].keys.end());
+#endif
+                }
+                this->values = c.values;
+                this->track_keys = c.track_keys;
+            }
+            return *this;
+        }
+        
+        /** Returns the number of variables equal to [t]. */
+        unsigned long long find(const type& t) const
+        {
+            std::uint32_t pos(this->values.find(hash_index::hash_value(t), value_equal(this->counts, t)));
+            if(pos == npos) return 0;
+            return this->counts[pos].count;
+        }
+        
+        /** Returns the positions of the variables equal to [t], or nullptr
+         if there are none (or the key index is off). */
+        const key_list* find_keys(const type& t) const
+        {
+#if KEY_INDEX_ENABLED
+            std::uint32_t pos(this->values.find(hash_index::hash_value(t), value_equal(this->counts, t)));
+            if((pos != npos) && this->track_keys) return &this->counts[pos].keys;
+#else
+            (void)t;
+#endif
+            return nullptr;
+        }
+        
+        /** Counts one more variable equal to [t].  [var] is the variable's
+         key id, and its slot is returned. */
+        std::uint32_t add(const type& t, const std::uint32_t& var)
+        {
+            std::uint64_t h(hash_index::hash_value(t));
+            std::uint32_t pos(this->values.find_or_insert(h, value_equal(this->counts, t), this->counts.size(),
+                    value_hash(this->counts)));
+            if(pos == npos)
+            {
+                pos = this->counts.size();
+                this->counts.push_back(count_data(this->memory));
+                this->counts.back().value = t;
+            }
+            this->counts[pos].count++;
+#if KEY_INDEX_ENABLED
+            if(this->track_keys)
+            {
+                this->counts[pos].keys.push_back(var);
+                return (this->counts[pos].keys.size() - 1);
+            }
+#else
+            (void)var;
+#endif
+            return 0;
+        }
+        
+        /** Counts one less variable equal to [t].  [slot] is the variable's
+         slot.  If another variable had to be moved into that slot, its key id
+         is returned (so its slot can be updated); otherwise npos. */
+        std::uint32_t remove(const type& t, const std::uint32_t& slot)
+        {
+            std::uint64_t h(hash_index::hash_value(t));
+            std::uint32_t pos(this->values.find(h, value_equal(this->counts, t))), moved(npos);
+            if(pos == npos) return npos;
+#if KEY_INDEX_ENABLED
+            if(this->track_keys)
+            {
+                key_list& keys(this->counts[pos].keys);
+                if((slot + 1) < keys.size())
+                {
+                    keys[slot] = keys.back();
+                    moved = keys[slot];
+                }
+                keys.pop_back();
+            }
+#else
+            (void)slot;
+#endif
+            if(--(this->counts[pos].count) == 0)
+            {
+                this->values.erase(h, value_equal(this->counts, t), value_hash(this->counts));
+                this->fill(pos);
+            }
+            return moved;
+        }
+        
+        /** Makes room for [n] distinct values. */
+        void reserve(const std::size_t& n)
+        {
+            this->values.reserve(n, value_hash(this->counts));
+        }
+        
+        /** Returns the number of distinct values being counted. */
+        std::size_t size() const
+        {
+            return this->counts.size();
+        }
+        
+        /** Returns true if the lists of variables per value are kept. */
+        bool tracking_keys() const
+        {
+            return this->track_keys;
+        }
+        
+        /** Turns the key index on or off.  It can only be changed while
+         nothing is being counted. */
+        bool set_tracking_keys(const bool& b)
+        {
+            if(this->counts.size() > 0) return false;
+            this->track_keys = (KEY_INDEX_ENABLED && b);
+            return (this->track_keys == b);
+        }
+        
+        /** Returns the number of bytes the counts and their index take up.
+         The lists of keys are allocated from the stack's resource, so they
+         are not included. */
+        std::size_t bytes() const
+        {
+            return (this->counts.bytes() + this->values.bytes());
+        }
+        
+        void clear()
+        {
+            this->counts.clear();
+            this->values.clear();
+        }
+        
+    private:
+        
+        struct count_data
+        {
+#if KEY_INDEX_ENABLED
+            explicit count_data(resource_type* r) : value(), count(0), keys(typename key_list::allocator_type(r))
+            {
+            }
+#else
+            explicit count_data(resource_type*) : value(), count(0)
+            {
+            }
+#endif
+            
+            type value;
+            unsigned long long count;
+#if KEY_INDEX_ENABLED
+            key_list keys;
+#endif
+        };
+        
+        /** Compares a value against the one counted at a position. */
+        struct value_equal
+        {
+            value_equal(const chunk_vector::chunk_vector_class<count_data>& c, const type& t) : counts(c), value(t)
+            {
+            }
+            
+            bool operator()(const std::uint32_t& pos) const
+            {
+                return (this->counts[pos].value == this->value);
+            }
+            
+            const chunk_vector::chunk_vector_class<count_data>& counts;
+            const type& value;
+        };
+        
+        /** Hashes the value counted at a position again, for the index. */
+        struct value_hash
+        {
+            explicit value_hash(const chunk_vector::chunk_vector_class<count_data>& c) : counts(c)
+            {
+            }
+            
+            std::uint64_t operator()(const std::uint32_t& pos) const
+            {
+                return hash_index::hash_value(this->counts[pos].value);
+            }
+            
+            void prefetch(const std::uint32_t& pos) const
+            {
+                __builtin_prefetch(&this->counts[pos]);
+            }
+            
+            const chunk_vector::chunk_vector_class<count_data>& counts;
+        };
+        
+        chunk_vector::chunk_vector_class<count_data> counts;
+        hash_index::index_class values;
+        resource_type* memory;
+        bool track_keys;
+        
+        /** Fills the hole left at [pos] with the last count. */
+        void fill(const std::uint32_t& pos)
+        {
+            std::uint32_t last(this->counts.size() - 1);
+            if(pos != last)
+            {
+                this->counts[pos] = std::move(this->counts[last]);
+                this->values.relocate(hash_index::hash_value(this->counts[pos].value), last, pos);
+            }
+            this->counts.pop_back();
+        }
+        
+    };
+    
+    template<class type, class policy>
+    const std::uint32_t count_class<type, policy>::npos;
+    
+}
+
+#endif
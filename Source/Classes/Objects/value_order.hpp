@@ -0,0 +1,337 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2014 Jonathan Craig Whitlock
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+ */
+
+
+
+#ifndef VALUE_ORDER_HPP_INCLUDED
+#define VALUE_ORDER_HPP_INCLUDED
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#include "chunk_vector.hpp"
+
+namespace var_stack
+{
+    
+    /**
+     * Keeps the distinct values of the stack in order, so that the number of
+     * variables in a range of values can be found in O(log n) no matter how
+     * many variables are in it.  The values are the nodes of a treap (a binary
+     * search tree balanced by random priorities), and every node carries
+     * the number of variables in its whole subtree.
+     */
+    template<class type>
+    class order_class
+    {
+    public:
+        
+        explicit order_class() : nodes(), free_nodes(), root(nil), seed(0x2545f491U)
+        {
+        }
+        
+        /** Counts one more variable equal to [t]. */
+        void add(const type& t)
+        {
+            this->root = this->insert(this->root, t);
+        }
+        
+        /** Counts one less variable equal to [t]. */
+        void remove(const type& t)
+        {
+            this->root = this->erase(this->root, t);
+        }
+        
+        /** Moves one variable from the value [from] to the value [to]. */
+        void move(const type& from, const type& to)
+        {
+            if(from == to) return;
+            this->remove(from);
+            this->add(to);
+        }
+        
+        /** Returns the number of variables less than [t]. */
+        unsigned long long count_less(const type& t) const
+        {
+            unsigned long long total(0);
+            std::uint32_t n(this->root);
+            while(n != nil)
+            {
+                if(this->nodes[n].value < t)
+                {
+                    total += (this->sum(this->nodes[n].left) + this->nodes[n].count);
+                    n = this->nodes[n].right;
+                }
+                else n = this->nodes[n].left;
+            }
+            return total;
+        }
+        
+        /** Returns the number of variables less than or equal to [t]. */
+        unsigned long long count_less_equal(const type& t) const
+        {
+            unsigned long long total(0);
+            std::uint32_t n(this->root);
+            while(n != nil)
+            {
+                if(t < this->nodes[n].value) n = this->nodes[n].left;
+                else
+                {
+                    total += (this->sum(this->nodes[n].left) + this->nodes[n].count);
+                    n = this->nodes[n].right;
+                }
+            }
+            return total;
+        }
+        
+        /** Returns the number of variables from [low] to [high], inclusive. */
+        unsigned long long count_between(const type& low, const type& high) const
+        {
+            if(high < low) return 0;
+            return (this->count_less_equal(high) - this->count_less(low));
+        }
+        
+        /** Returns the number of variables greater than [t]. */
+        unsigned long long count_greater(const type& t) const
+        {
+            return (this->sum(this->root) - this->count_less_equal(t));
+        }
+        
+        /** Calls [f] with every distinct value and the number of variables
+         equal to it, in order. */
+        template<class function_type>
+        void for_each(const function_type& f) const
+        {
+            std::vector<std::uint32_t> path;
+            std::uint32_t n(this->root);
+            while((n != nil) || !path.empty())
+            {
+                if(n != nil)
+                {
+                    path.push_back(n);
+                    n = this->nodes[n].left;
+                }
+                else
+                {
+                    n = path.back();
+                    path.pop_back();
+                    f(this->nodes[n].value, this->nodes[n].count);
+                    n = this->nodes[n].right;
+                }
+            }
+        }
+        
+        /** Replaces everything with the [size] distinct values at [values]
+         (which must be in ascending order), each counted [counts] times.  The
+         treap is built in one pass instead of by inserting each value. */
+        void build(const type* values, const unsigned long long* counts, const std::size_t& size)
+        {
+            std::vector<std::uint32_t> spine;
+            
+            this->clear();
+            for(std::size_t x = 0; x < size; x++)
+            {
+                std::uint32_t n(this->new_node(values[x])), last(nil);
+                this->nodes[n].count = counts[x];
+                
+                /* The right spine of the tree so far, kept as a stack: the new
+                 (largest) value goes at the bottom of it, under every node
+                 with a higher priority. */
+                while(!spine.empty() && (this->nodes[spine.back()].priority < this->nodes[n].priority))
+                {
+                    last = spine.back();
+                    spine.pop_back();
+                }
+                this->nodes[n].left = last;
+                if(!spine.empty()) this->nodes[spine.back()].right = n;
+                spine.push_back(n);
+            }
+            if(!spine.empty()) this->root = spine.front();
+            this->total_up(this->root);
+        }
+        
+        /** Returns the number of bytes the nodes take up. */
+        std::size_t bytes() const
+        {
+            return (this->nodes.bytes() + (this->free_nodes.capacity() * sizeof(std::uint32_t)));
+        }
+        
+        void clear()
+        {
+            this->nodes.clear();
+            std::vector<std::uint32_t>().swap(this->free_nodes);
+            this->root = nil;
+        }
+        
+    private:
+        static const std::uint32_t nil = 0xffffffffU;
+        
+        struct node_data
+        {
+            type value;
+            unsigned long long count;
+            unsigned long long total;
+            std::uint32_t priority;
+            std::uint32_t left;
+            std::uint32_t right;
+        };
+        
+        /* Nodes are kept in chunks and refer to each other by position; the
+         positions of erased nodes are re-used. */
+        chunk_vector::chunk_vector_class<node_data> nodes;
+        std::vector<std::uint32_t> free_nodes;
+        std::uint32_t root;
+        std::uint32_t seed;
+        
+        unsigned long long sum(const std::uint32_t& n) const
+        {
+            return ((n == nil) ? 0 : this->nodes[n].total);
+        }
+        
+        void update(const std::uint32_t& n)
+        {
+            this->nodes[n].total = (this->nodes[n].count + this->sum(this->nodes[n].left) + 
+                    this->sum(this->nodes[n].right));
+        }
+        
+        /** Works out the totals of a subtree whose counts are set. */
+        unsigned long long total_up(const std::uint32_t& n)
+        {
+            if(n == nil) return 0;
+            this->nodes[n].total = (this->nodes[n].count + this->total_up(this->nodes[n].left) + 
+                    this->total_up(this->nodes[n].right));
+            return this->nodes[n].total;
+        }
+        
+        std::uint32_t rotate_right(const std::uint32_t& n)
+        {
+            std::uint32_t l(this->nodes[n].left);
+            this->nodes[n].left = this->nodes[l].right;
+            this->nodes[l].right = n;
+            this->update(n);
+            this->update(l);
+            return l;
+        }
+        
+        std::uint32_t rotate_left(const std::uint32_t& n)
+        {
+            std::uint32_t r(this->nodes[n].right);
+            this->nodes[n].right = this->nodes[r].left;
+            this->nodes[r].left = n;
+            this->update(n);
+            this->update(r);
+            return r;
+        }
+        
+        std::uint32_t new_node(const type& t)
+        {
+            std::uint32_t n(0);
+            
+            /* xorshift32; the priorities only need to look random. */
+            this->seed ^= (this->seed << 13);
+            this->seed ^= (this->seed >> 17);
+            this->seed ^= (this->seed << 5);
+            
+            if(this->free_nodes.empty())
+            {
+                n = this->nodes.size();
+                this->nodes.push_back(node_data());
+            }
+            else
+            {
+                n = this->free_nodes.back();
+                this->free_nodes.pop_back();
+            }
+            this->nodes[n].value = t;
+            this->nodes[n].count = 1;
+            this->nodes[n].total = 1;
+            this->nodes[n].priority = this->seed;
+            this->nodes[n].left = nil;
+            this->nodes[n].right = nil;
+            return n;
+        }
+        
+        std::uint32_t insert(const std::uint32_t& n, const type& t)
+        {
+            if(n == nil) return this->new_node(t);
+            
+            node_data& node(this->nodes[n]);
+            if(t < node.value)
+            {
+                std::uint32_t l(this->insert(node.left, t));
+                this->nodes[n].left = l;
+                if(this->nodes[l].priority > this->nodes[n].priority) return this->rotate_right(n);
+            }
+            else if(node.value < t)
+            {
+                std::uint32_t r(this->insert(node.right, t));
+                this->nodes[n].right = r;
+                if(this->nodes[r].priority > this->nodes[n].priority) return this->rotate_left(n);
+            }
+            else this->nodes[n].count++;
+            this->nodes[n].total++;
+            return n;
+        }
+        
+        std::uint32_t erase(const std::uint32_t& n, const type& t)
+        {
+            if(n == nil) return nil;
+            
+            if(t < this->nodes[n].value) this->nodes[n].left = this->erase(this->nodes[n].left, t);
+            else if(this->nodes[n].value < t) this->nodes[n].right = this->erase(this->nodes[n].right, t);
+            else if(--(this->nodes[n].count) == 0) return this->unlink(n);
+            this->update(n);
+            return n;
+        }
+        
+        /** Removes node [n] from its subtree by rotating it down to a leaf,
+         and returns the subtree's new root. */
+        std::uint32_t unlink(const std::uint32_t& n)
+        {
+            std::uint32_t l(this->nodes[n].left), r(this->nodes[n].right), top(nil);
+            
+            if((l == nil) || (r == nil))
+            {
+                this->free_nodes.push_back(n);
+                return ((l == nil) ? r : l);
+            }
+            if(this->nodes[l].priority > this->nodes[r].priority)
+            {
+                top = this->rotate_right(n);
+                this->nodes[top].right = this->unlink(n);
+            }
+            else
+            {
+                top = this->rotate_left(n);
+                this->nodes[top].left = this->unlink(n);
+            }
+            this->update(top);
+            return top;
+        }
+        
+    };
+    
+}
+
+#endif
@@ -34,7 +34,7 @@ namespace
 namespace var_stack
 {
     /** Sets the value of a variable equal to the value of another.
-     does not copy the name!!*/
+     does not copy the key id!!*/
     template<class type>
     const variable_data<type>& variable_data<type>::operator=(const variable_data<type>& var)
     {
@@ -61,5 +61,7 @@ namespace var_stack
         return !(this->operator==(var));
     }
     
+    template struct variable_data<typed_value::value_class>;
+    
     
 }
\ No newline at end of file
@@ -27,8 +27,17 @@
 #define VARIABLE_STACK_HPP_INCLUDED
 #include <string>
 #include <vector>
-#include <map>
 #include <algorithm>
+#include <cstdint>
+
+#include "symbol_table.hpp"
+#include "chunk_vector.hpp"
+#include "value_count.hpp"
+#include "value_order.hpp"
+#include "persistent_map.hpp"
+#include "shared_table.hpp"
+#include "allocation.hpp"
+#include "typed_value.hpp"
 
 namespace var_stack
 {
@@ -37,7 +46,7 @@ namespace var_stack
     template<class type>
     struct variable_data
     {
-        std::string name;
+        symbols::id_type id;
         type value;
         
         const variable_data<type>& operator=(const variable_data<type>&);
@@ -45,13 +54,26 @@ namespace var_stack
         bool operator!=(const variable_data<type>&) const;
     };
     
-    template<class type>
+    /**
+     * The variables, and the indexes of their values.  A variable is stored
+     * by its key id, which is small and dense, so it takes the size of its
+     * value and one bit saying it exists; its key's bytes live only in the
+     * symbol table.  [policy] says where the memory for the per-value lists
+     * of keys comes from (see allocation.hpp): with the pool, adding a
+     * variable does not call malloc once its chunks exist, and erase_all
+     * gives back a few big blocks instead of one list at a time.
+     */
+    template<class type, class policy = allocation::pool_policy>
     class stack_class
     {
     public:
         
         /** initializes an empty stack. */
-        explicit stack_class() : vars(), var_count(){}
+        typedef typename persistent_map::map_class<type>::snapshot_type snapshot_type;
+        typedef typename count_class<type, policy>::key_list key_list;
+        
+        explicit stack_class() : memory(), values(), present(), count(0), key_slots(), var_count(this->memory), 
+                var_order(), shared(), persistent(false), read_vars(), read_counts(false), lock_free(false){}
         ~stack_class()
         {
             /* Make sure that vector releases it's memory to us. */
@@ -59,163 +81,392 @@ namespace var_stack
         }
         
         /** Sets one stack equal to another. */
-        const stack_class<type>& operator=(const stack_class<type>& s)
+        const stack_class<type, policy>& operator=(const stack_class<type, policy>& s)
         {
             if(this != &s)
             {
                 this->erase_all();
                 this->var_count = s.var_count;
-                this->vars = s.vars;
+                this->var_order = s.var_order;
+                this->values = s.values;
+                this->present = s.present;
+                this->count = s.count;
+                this->key_slots = s.key_slots;
+                this->shared = s.shared;
+                this->persistent = s.persistent;
+                this->set_lock_free_reads(s.lock_free);
             }
             return *this;
         }
         
-        /** returns a direct reference the Nth index. */
-        variable_data<type>& operator[](const unsigned int& x)
+        /** Calls [f] with the key id and value of every variable, in order
+         of key id. */
+        template<class function_type>
+        void for_each_var(const function_type& f) const
         {
-            if(x < this->vars.size())
+            for(std::size_t x = 0; x < this->present.size(); x++)
             {
-                typename std::map<std::string, variable_data<type> >::iterator tempit(this->vars.begin());
-                for(unsigned int loc = 0; ((loc < x) && (tempit != this->vars.end())); loc++)
+                for(std::uint64_t bits = this->present[x]; bits != 0; bits &= (bits - 1))
                 {
-                    tempit++;
+                    symbols::id_type id((x * 64) + __builtin_ctzll(bits));
+                    f(id, this->values[id]);
                 }
-                if(tempit != this->vars.end()) return tempit->second;
-            }
-            throw "out of bounds!";
-            return (this->vars.begin())->second;
-        }
-        
-        /** Returns a constant reference to the Nth index. */
-        const variable_data<type>& operator[](const unsigned int& x) const
-        {
-            if(x < this->vars.size())
-            {
-                typename std::map<std::string, variable_data<type> >::const_iterator tempit(this->vars.cbegin());
-                for(unsigned int loc = 0; ((loc < x) && (tempit != this->vars.cend())); loc++) tempit++;
-                if(tempit != this->vars.cend()) return tempit->second;
             }
-            throw "out of bounds!";
-            return this->vars.cbegin()->second;
         }
         
         /** Returns the number of variables currently stored on the stack. */
         unsigned int size() const
         {
-            return this->vars.size();
+            return this->count;
         }
         
         /** Erases the stack from memory. */
         void erase_all()
         {
-            this->vars.erase(this->vars.begin(), this->vars.end());
-            this->var_count.erase(this->var_count.begin(), this->var_count.end());
+            this->values.clear();
+            this->present.clear();
+            this->count = 0;
+            this->key_slots.clear();
+            this->var_count.clear();
+            this->var_order.clear();
+            this->shared.clear();
+            this->read_vars.clear();
+            this->read_counts.clear();
+            this->memory.clear();
         }
         
-        /** Returns a read-only structure of the variable data that matches
-        * a variable name.  */
-        const variable_data<type>& find_name(const std::string& s)
+        /** Returns a pointer to the value of the variable with key id [id],
+         or nullptr if there isn't one. */
+        const type* find_value(const symbols::id_type& id) const
         {
-            typename std::map<std::string, var_stack::variable_data<type> >::iterator element(this->vars.find(s));
-            if(element == this->vars.end())
-            {
-                return (this->vars.begin())->second;
-            }
-            return element->second;
+            if(!this->exists(id)) return nullptr;
+            return &this->values[id];
         }
         
         /** Returns the number of variables that match a specified value. */
         unsigned long long find_values(const type& t) const
         {
-            typename std::map<type, unsigned long long>::const_iterator element(this->var_count.find(t));
-            if(element == this->var_count.end()) return 0;
-            return element->second;
+            return this->var_count.find(t);
+        }
+        
+        /** Returns the number of variables with a value from [low] to [high],
+         inclusive. */
+        unsigned long long find_values_between(const type& low, const type& high) const
+        {
+            return this->var_order.count_between(low, high);
+        }
+        
+        /** Returns the number of variables with a value less than [t]. */
+        unsigned long long find_values_less(const type& t) const
+        {
+            return this->var_order.count_less(t);
+        }
+        
+        /** Returns the number of variables with a value greater than [t]. */
+        unsigned long long find_values_greater(const type& t) const
+        {
+            return this->var_order.count_greater(t);
         }
         
         /** Returns true if the variable in question does exist. */
-        bool var_exists(const std::string& s) const
+        bool var_exists(const symbols::id_type& id) const
         {
-            return (this->vars.find(s) != this->vars.end());
+            return this->exists(id);
         }
         
         /** adds the variable to the stack if it does not exist.
         * Changes a variable's value if it does exist. */
-        void set_var(const std::string& name, const type& val)
+        void set_var(const symbols::id_type& id, const type& val)
         {
-            type temp_val(this->vars[name].value);
-
-            /* Remove this variable from the count before over-writing it.*/
-            if(this->var_exists(name))
+            if(!this->exists(id))
             {
-                this->var_count[temp_val]--;
-
-                //if there are not more vars equal to the value, erase it from the count
-                if(this->var_count[temp_val] == 0)
-                {
-                    this->var_count.erase(temp_val);
-                }
+                this->make_room(id);
+                this->present[(id / 64)] |= bit(id);
+                this->count++;
+                this->values[id] = val;
+                this->count_key(id, val);
+                this->var_order.add(val);
+                if(this->persistent) this->shared.set(id, val);
+                if(this->lock_free) this->publish(id, val, nullptr);
             }
-
-            //over-write the old variable
-            this->vars[name].name = name;
-            this->vars[name].value = val;
-
-            //update the count
-            switch(this->var_count.find(val) == this->var_count.end())
+            else if(!this->values[id].identical(val))
             {
-                case true:
-                {
-                    this->var_count[val] = 1;
-                }
-                break;
-
-                case false:
-                {
-                    this->var_count[val]++;
-                }
-                break;
-
-                default:
+                /* Move this variable's count to the new value before over-writing it.
+                 An equal value of another kind (1.0 for 1) keeps the count it has. */
+                if(this->values[id] != val)
                 {
+                    this->uncount(id);
+                    this->count_key(id, val);
+                    this->var_order.move(this->values[id], val);
                 }
-                break;
+                if(this->lock_free) this->publish(id, val, &this->values[id]);
+                this->values[id] = val;
+                if(this->persistent) this->shared.set(id, val);
             }
         }
         
         /** Removes a variable from the stack, if it exists.  Also decreases value
         * count of the variable's value. */
-        void remove_var(const std::string& name)
+        void remove_var(const symbols::id_type& id)
         {
-            if(this->vars.find(name) != this->vars.end())
+            if(this->exists(id))
             {
-                type temp_val(this->vars[name].value);
-                this->var_count[temp_val]--;
-                if(this->var_count[temp_val] == 0)
+                this->present[(id / 64)] &= ~bit(id);
+                this->count--;
+                this->uncount(id);
+                this->var_order.remove(this->values[id]);
+                if(this->lock_free)
                 {
-                    this->var_count.erase(temp_val);
+                    this->read_vars.unset(id);
+                    this->count_shared(this->values[id], -1);
                 }
-
-                this->vars.erase(name);
+                if(this->persistent) this->shared.erase(id);
+            }
+        }
+        
+        /** Returns the key ids of the variables equal to [t], or nullptr if
+         there are none.  Also nullptr if the key index is off. */
+        const key_list* find_keys(const type& t) const
+        {
+            return this->var_count.find_keys(t);
+        }
+        
+        /** Calls [f] with the key id of every variable equal to [t].  Returns
+         false (without calling it) if the key index is off. */
+        template<class function_type>
+        bool for_each_key(const type& t, const function_type& f) const
+        {
+            if(!this->key_index_enabled()) return false;
+            
+            const key_list* keys(this->find_keys(t));
+            if(keys != nullptr)
+            {
+                for(unsigned int x = 0; x < keys->size(); x++) f((*keys)[x]);
+            }
+            return true;
+        }
+        
+        /** Calls [f] with every distinct value on the stack and the number
+         of variables equal to it, from the lowest value to the highest. */
+        template<class function_type>
+        void for_each_count(const function_type& f) const
+        {
+            this->var_order.for_each(f);
+        }
+        
+        /** Fills an empty stack with [size] variables at once: variable x has
+         key [ids][x] and value [values][x].  The keys must all be different.
+         [count_values] are the distinct values in ascending order, and
+         [counts] how many variables hold each; they let the ordered index be
+         built in one pass.  Returns false (leaving the stack empty) if the
+         counts don't match the variables. */
+        bool bulk_load(const symbols::id_type* ids, const type* values, const std::size_t& size,
+                const type* count_values, const unsigned long long* counts, const std::size_t& count_size)
+        {
+            this->erase_all();
+            this->var_count.reserve(count_size);
+            for(std::size_t x = 0; x < size; x++)
+            {
+                if(this->exists(ids[x]))
+                {
+                    this->erase_all();
+                    return false;
+                }
+                this->make_room(ids[x]);
+                this->present[(ids[x] / 64)] |= bit(ids[x]);
+                this->count++;
+                this->values[ids[x]] = values[x];
+                this->count_key(ids[x], values[x]);
+                if(this->persistent) this->shared.set(ids[x], values[x]);
+                if(this->lock_free) this->publish(ids[x], values[x], nullptr);
+            }
+            for(std::size_t x = 0; x < count_size; x++)
+            {
+                if(((x > 0) && !(count_values[(x - 1)] < count_values[x])) || 
+                        (this->var_count.find(count_values[x]) != counts[x]))
+                {
+                    this->erase_all();
+                    return false;
+                }
+            }
+            if(count_size != this->var_count.size())
+            {
+                this->erase_all();
+                return false;
             }
+            this->var_order.build(count_values, counts, count_size);
+            return true;
+        }
+        
+        /** Returns true if the stack also keeps its variables in a
+         persistent map, so it can hand out snapshots. */
+        bool persistent_enabled() const
+        {
+            return this->persistent;
+        }
+        
+        /** Turns the persistent map on or off.  Like the key index, this is
+         only possible while the stack is empty. */
+        bool set_persistent(const bool& b)
+        {
+            if(this->count > 0) return false;
+            this->persistent = b;
+            return true;
+        }
+        
+        /** Returns a consistent snapshot of every variable (by key id), in
+         constant time.  It can be read from another thread while the stack
+         goes on changing.  Empty unless the persistent map is on. */
+        snapshot_type snapshot() const
+        {
+            return this->shared.snapshot();
+        }
+        
+        /** Returns the number of persistent map nodes that were copied because
+         a snapshot still shared them. */
+        unsigned long long snapshot_copies() const
+        {
+            return this->shared.copied();
+        }
+        
+        /** Returns true if the values and their counts are also kept where
+         other threads can read them without the stack's lock. */
+        bool lock_free_reads() const
+        {
+            return this->lock_free;
+        }
+        
+        /** Turns lock-free reads on or off. */
+        void set_lock_free_reads(const bool& b)
+        {
+            this->read_vars.clear();
+            this->read_counts.clear();
+            this->lock_free = b;
+            if(b) this->for_each_var([this](const symbols::id_type& id, const type& val){ this->publish(id, val, nullptr); });
+        }
+        
+        /** These may be called from any thread without the lock, inside an
+         epoch guard, while lock-free reads are on.  What they return is only
+         consistent if nothing changed the stack while they ran, which is up
+         to the caller to check. */
+        bool read_var(const symbols::id_type& id, type& t) const
+        {
+            return this->read_vars.get(id, t);
+        }
+        
+        unsigned long long read_count(const type& t) const
+        {
+            std::uint64_t n(0);
+            this->read_counts.find(hash_index::hash_value(t), [&t](const type& v){ return (v == t); }, n);
+            return n;
+        }
+        
+        /** Returns true if the stack keeps track of which variables hold
+         each value. */
+        bool key_index_enabled() const
+        {
+            return this->var_count.tracking_keys();
+        }
+        
+        /** Turns the key index on or off.  This is only possible while the
+         stack is empty.  Returns false if it could not be done. */
+        bool set_key_index(const bool& b)
+        {
+            return this->var_count.set_tracking_keys(b);
+        }
+        
+        /** Returns the number of bytes the variables and everything kept
+         about them take up. */
+        std::size_t memory_bytes() const
+        {
+            return (this->values.bytes() + this->present.bytes() + this->key_slots.bytes() + 
+                    this->var_count.bytes() + this->var_order.bytes() + this->memory.bytes() +
+                    this->read_vars.bytes() + this->read_counts.bytes() + this->shared.bytes());
         }
         
         
     private:
-        std::map<std::string, variable_data<type> > vars;
-        std::map<type, unsigned long long> var_count;
         
+        /* Has to outlive everything that takes memory from it. */
+        typename policy::resource_type memory;
+        
+        /* [values] holds the value of each key id, and [present] has a bit
+         set for each id that has a variable.  Both grow in chunks, so adding a
+         variable never copies the others. */
+        chunk_vector::chunk_vector_class<type> values;
+        chunk_vector::chunk_vector_class<std::uint64_t> present;
+        unsigned int count;
+        
+        /* [key_slots] is where each key id is in its value's key list.  It is
+         only kept while the key index is on. */
+        chunk_vector::chunk_vector_class<std::uint32_t> key_slots;
+        count_class<type, policy> var_count;
+        order_class<type> var_order;
+        
+        /* With [persistent] on, every variable is also in [shared], which is
+         what snapshots are taken from. */
+        persistent_map::map_class<type> shared;
+        bool persistent;
+        
+        /* With [lock_free] on, every variable's value (by key id) and the
+         count of every value are also kept in tables other threads can read
+         without locking. */
+        shared_table::array_class<type> read_vars;
+        shared_table::table_class<type> read_counts;
+        bool lock_free;
+        
+        static std::uint64_t bit(const symbols::id_type& id)
+        {
+            return (std::uint64_t(1) << (id % 64));
+        }
+        
+        bool exists(const symbols::id_type& id) const
+        {
+            return (((id / 64) < this->present.size()) && ((this->present[(id / 64)] & bit(id)) != 0));
+        }
+        
+        /** Makes sure there is a place for key id [id]. */
+        void make_room(const symbols::id_type& id)
+        {
+            while(this->values.size() <= id) this->values.push_back(type());
+            while(this->present.size() <= (id / 64)) this->present.push_back(0);
+        }
+        
+        /** Adds key id [id] to the count of [val]. */
+        void count_key(const symbols::id_type& id, const type& val)
+        {
+            std::uint32_t slot(this->var_count.add(val, id));
+            if(!this->var_count.tracking_keys()) return;
+            while(this->key_slots.size() <= id) this->key_slots.push_back(0);
+            this->key_slots[id] = slot;
+        }
+        
+        /** Publishes a variable's new value; [old] is its old one (nullptr
+         if it is new). */
+        void publish(const symbols::id_type& id, const type& val, const type* old)
+        {
+            if(old != nullptr) this->count_shared(*old, -1);
+            this->count_shared(val, 1);
+            this->read_vars.set(id, val);
+        }
+        
+        void count_shared(const type& t, const std::int64_t& n)
+        {
+            this->read_counts.add(hash_index::hash_value(t), t, [&t](const type& v){ return (v == t); }, n);
+        }
+        
+        /** Removes the variable with key id [id] from the count of its value. */
+        void uncount(const symbols::id_type& id)
+        {
+            std::uint32_t slot(this->var_count.tracking_keys() ? this->key_slots[id] : 0);
+            std::uint32_t moved(this->var_count.remove(this->values[id], slot));
+            if(moved != count_class<type, policy>::npos) this->key_slots[moved] = slot;
+        }
         
     };
     
-    template class stack_class<int>;
-//    template class stack_class<unsigned int>;
-//    template class stack_class<std::string>;
-//    template class stack_class<unsigned long long>;
-//    template class stack_class<unsigned long>;
-//    template class stack_class<long>;
-//    template class stack_class<float>;
-//    template class stack_class<double>;
-//    template class stack_class<long double>;
+    template class stack_class<typed_value::value_class>;
+    template class stack_class<typed_value::value_class, allocation::heap_policy>;
 }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,184 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2014 Jonathan Craig Whitlock
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+ */
+
+
+
+#ifndef WIRE_PROTOCOL_HPP_INCLUDED
+#define WIRE_PROTOCOL_HPP_INCLUDED
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * The binary protocol.  A client that starts its connection with the byte
+ * [hello] sends requests framed like this instead of lines of text:
+ * 
+ *     opcode       1 byte, a db_command::command_type
+ *     key length   varint (7 bits a byte, low bits first)
+ *     key          that many bytes, any bytes at all
+ *     value        4 bytes, little-endian, signed
+ *     request id   4 bytes, little-endian, echoed in the response
+ * 
+ * Every request gets one response of [response_size] bytes: the request id,
+ * a status byte, and an 8-byte little-endian value.  A status_real value
+ * holds the bits of a double; a status_text value is the length of the text,
+ * which follows the response.  Requests are answered in order.
+ */
+namespace wire
+{
+    const unsigned char hello = 0xdb;
+    
+    /* The biggest key a request can carry; anything longer is taken to be
+     garbage, and the connection is dropped. */
+    const std::size_t max_key = (1 << 20);
+    
+    const std::size_t response_size = 13;
+    
+    /** What a decode returns when the bytes are not a valid request. */
+    const std::size_t malformed = ~std::size_t(0);
+    
+    enum status_type
+    {
+        status_ok = 0,
+        status_value = 1,
+        status_null = 2,
+        status_error = 3,
+        status_conflict = 4,
+        status_real = 5,
+        status_text = 6
+    };
+    
+    /** A decoded request.  The key points into the buffer it was decoded
+     from, so it is only valid as long as that is. */
+    struct request_data
+    {
+        unsigned char opcode = 0;
+        const char* key = nullptr;
+        std::size_t key_size = 0;
+        std::int32_t value = 0;
+        std::uint32_t id = 0;
+    };
+    
+    struct response_data
+    {
+        std::uint32_t id = 0;
+        status_type status = status_ok;
+        std::int64_t value = 0;
+        std::string text;
+    };
+    
+    inline void put_u32(char* p, const std::uint32_t& n)
+    {
+        for(int x = 0; x < 4; x++) p[x] = (char)(unsigned char)(n >> (8 * x));
+    }
+    
+    inline std::uint32_t get_u32(const char* p)
+    {
+        std::uint32_t n(0);
+        for(int x = 0; x < 4; x++) n |= ((std::uint32_t)(unsigned char)p[x] << (8 * x));
+        return n;
+    }
+    
+    inline void put_u64(char* p, const std::uint64_t& n)
+    {
+        for(int x = 0; x < 8; x++) p[x] = (char)(unsigned char)(n >> (8 * x));
+    }
+    
+    inline std::uint64_t get_u64(const char* p)
+    {
+        std::uint64_t n(0);
+        for(int x = 0; x < 8; x++) n |= ((std::uint64_t)(unsigned char)p[x] << (8 * x));
+        return n;
+    }
+    
+    /** Decodes the request at the start of [data].  Returns the bytes it
+     takes up, 0 if the rest of it has not arrived yet, or malformed. */
+    inline std::size_t decode_request(const char* data, const std::size_t& size, request_data& r)
+    {
+        std::size_t pos(1), length(0);
+        unsigned int shift(0);
+        
+        if(size == 0) return 0;
+        r.opcode = (unsigned char)data[0];
+        while(true)
+        {
+            if(pos == size) return 0;
+            unsigned char b((unsigned char)data[pos++]);
+            length |= ((std::size_t)(b & 0x7f) << shift);
+            if((b & 0x80) == 0) break;
+            shift += 7;
+            if(shift > 21) return malformed;
+        }
+        if(length > max_key) return malformed;
+        if((size - pos) < (length + 8)) return 0;
+        r.key = (data + pos);
+        r.key_size = length;
+        pos += length;
+        r.value = (std::int32_t)get_u32(data + pos);
+        r.id = get_u32(data + pos + 4);
+        return (pos + 8);
+    }
+    
+    /** Appends a request to [out]. */
+    inline void encode_request(std::string& out, const unsigned char& opcode, const char* key, 
+            const std::size_t& key_size, const std::int32_t& value, const std::uint32_t& id)
+    {
+        char fixed[8];
+        std::size_t length(key_size);
+        
+        out.push_back((char)opcode);
+        do
+        {
+            out.push_back((char)((length & 0x7f) | ((length > 0x7f) ? 0x80 : 0)));
+            length >>= 7;
+        }
+        while(length > 0);
+        out.append(key, key_size);
+        put_u32(fixed, (std::uint32_t)value);
+        put_u32((fixed + 4), id);
+        out.append(fixed, 8);
+    }
+    
+    /** Writes a response into the [response_size] bytes at [p]. */
+    inline void encode_response(char* p, const std::uint32_t& id, const status_type& status, 
+            const std::int64_t& value)
+    {
+        put_u32(p, id);
+        p[4] = (char)status;
+        put_u64((p + 5), (std::uint64_t)value);
+    }
+    
+    /** Decodes the response at the start of [data]; there must be
+     [response_size] bytes of it.  The text of a status_text response is not
+     included. */
+    inline void decode_response(const char* data, response_data& r)
+    {
+        r.id = get_u32(data);
+        r.status = (status_type)(unsigned char)data[4];
+        r.value = (std::int64_t)get_u64(data + 5);
+    }
+    
+}
+
+#endif
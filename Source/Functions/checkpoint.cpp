@@ -0,0 +1,180 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2014 Jonathan Craig Whitlock
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+ */
+
+
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <chrono>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "checkpoint.hpp"
+#include "snapshot.hpp"
+#include "write_log.hpp"
+#include "shard_store.hpp"
+
+namespace
+{
+    /* How fast recovery reads a snapshot and replays the log, in bytes per
+     millisecond.  These were measured with 3 million short keys; they are
+     only used to estimate how long recovery would take. */
+    const unsigned long long snapshot_load_rate = 65000;
+    const unsigned long long log_replay_rate = 75000;
+    
+    unsigned long long microseconds(const std::chrono::steady_clock::duration& d)
+    {
+        return std::chrono::duration_cast<std::chrono::microseconds>(d).count();
+    }
+}
+
+namespace checkpoint
+{
+    bool checkpoint_class::start(write_log::log_class& log, const shard_store::value_store& s)
+    {
+        if(this->running() || !log.is_open()) return false;
+        
+        /* Everything up to here is in the snapshot, so the log can drop it
+         once the snapshot is safely written.  No commit is half done while
+         every shard is locked. */
+        shard_store::value_store::lock_class hold(s);
+        this->lsn = log.next_lsn();
+        this->offset = log.size();
+        this->started = std::chrono::steady_clock::now();
+        if(s.persistent_enabled())
+        {
+            std::vector<snapshot::part_data> parts;
+            for(std::size_t x = 0; x < s.shard_count(); x++)
+            {
+                parts.push_back(snapshot::part_data{s.shard(x).vars.snapshot(), s.shard(x).keys.view()});
+            }
+            this->written = 0;
+            this->writer = std::thread([this, parts]()
+            {
+                std::string error;
+                bool success(snapshot::save(this->path, parts, this->lsn, error));
+                if(!success) std::cerr<< "checkpoint: "<< error<< std::endl;
+                this->written = (success ? 1 : 2);
+            });
+            this->pause = (std::chrono::steady_clock::now() - this->started);
+            return true;
+        }
+        
+        pid_t pid(fork());
+        if(pid == 0)
+        {
+            std::string error;
+            bool success(snapshot::save(this->path, s, this->lsn, error));
+            if(!success) std::cerr<< "checkpoint: "<< error<< std::endl;
+            _exit(success ? 0 : 1);
+        }
+        this->pause = (std::chrono::steady_clock::now() - this->started);
+        if(pid < 0)
+        {
+            std::cerr<< "checkpoint: can't fork: "<< std::strerror(errno)<< std::endl;
+            this->stats.failures++;
+            this->trigger_bytes = (log.size() + this->max_log_bytes);
+            return false;
+        }
+        this->child = pid;
+        return true;
+    }
+    
+    stats_data checkpoint_class::get_stats(const write_log::log_class& log) const
+    {
+        std::lock_guard<std::mutex> hold(this->lock);
+        stats_data result(this->stats);
+        struct stat info;
+        unsigned long long snapshot_bytes(0);
+        
+        result.running = this->running();
+        if(stat(this->path.c_str(), &info) == 0) snapshot_bytes = info.st_size;
+        result.recovery_ms = ((snapshot_bytes / snapshot_load_rate) + (log.size() / log_replay_rate));
+        return result;
+    }
+    
+    void checkpoint_class::check(write_log::log_class& log, const shard_store::value_store& s)
+    {
+        std::unique_lock<std::mutex> hold(this->lock, std::try_to_lock);
+        if(!hold.owns_lock()) return;
+        if(this->running()) this->wait(log, false);
+        else if(this->size_due(log) || ((this->interval > 0) && (log.next_lsn() != this->lsn) && 
+                ((std::chrono::steady_clock::now() - this->started) >= std::chrono::seconds(this->interval))))
+        {
+            this->start(log, s);
+        }
+    }
+    
+    void checkpoint_class::wait(write_log::log_class& log, const bool& block)
+    {
+        bool saved(false);
+        
+        if(this->writer.joinable())
+        {
+            if(!block && (this->written == 0)) return;
+            this->writer.join();
+            saved = (this->written == 1);
+        }
+        else
+        {
+            int status(0);
+            pid_t pid(-1);
+            
+            do
+            {
+                pid = waitpid(this->child, &status, (block ? 0 : WNOHANG));
+            }
+            while((pid < 0) && (errno == EINTR) && block);
+            if((pid == 0) || ((pid < 0) && (errno == EINTR))) return;
+            this->child = -1;
+            saved = ((pid > 0) && WIFEXITED(status) && (WEXITSTATUS(status) == 0));
+        }
+        
+        std::string error;
+        struct stat info;
+        std::chrono::steady_clock::time_point compacting(std::chrono::steady_clock::now());
+        if(!saved || !log.compact(this->lsn, this->offset, error))
+        {
+            /* The log is left alone (or compacting it was undone), so nothing
+             is lost; a later checkpoint will try again. */
+            if(!error.empty()) std::cerr<< "checkpoint: "<< error<< std::endl;
+            this->stats.failures++;
+            this->trigger_bytes = (log.size() + this->max_log_bytes);
+            return;
+        }
+        std::chrono::steady_clock::time_point now(std::chrono::steady_clock::now());
+        
+        this->trigger_bytes = this->max_log_bytes;
+        this->stats.count++;
+        this->stats.duration_ms = (microseconds(now - this->started) / 1000);
+        this->stats.pause_us = microseconds(this->pause + (now - compacting));
+        this->stats.bytes = ((stat(this->path.c_str(), &info) == 0) ? info.st_size : 0);
+    }
+    
+}
@@ -0,0 +1,163 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2014 Jonathan Craig Whitlock
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+ */
+
+
+
+#ifndef CHECKPOINT_HPP_INCLUDED
+#define CHECKPOINT_HPP_INCLUDED
+#include <string>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <sys/types.h>
+
+#include "shard_store.hpp"
+#include "write_log.hpp"
+
+/**
+ * Checkpoints keep the write-ahead log short.  A checkpoint writes the
+ * committed stack to a snapshot tagged with the log's next LSN, and then
+ * drops every log record before it.  The snapshot is written by a forked
+ * child, from its copy-on-write view of the stack, so the commands go on
+ * while it's being written; they only wait for the fork and, at the end,
+ * for the records logged in the meantime to be copied into the new log.
+ * 
+ * If the stack keeps a persistent map, no fork is needed: the snapshot is
+ * written from one of its snapshots by a thread instead.
+ * 
+ * Every shard is locked while a checkpoint starts, so its LSN is the
+ * boundary of a whole commit.  Any thread may check on checkpoints; only
+ * one at a time gets to.
+ */
+namespace checkpoint
+{
+    /** Describes the checkpoints made so far, for reporting. */
+    struct stats_data
+    {
+        unsigned long long count = 0;
+        unsigned long long failures = 0;
+        bool running = false;
+        
+        /* The last checkpoint that finished: how long it took from start to
+         finish, how big the snapshot was, and how long commands had to wait
+         for it (the fork, or taking the snapshot, plus compacting the log). */
+        unsigned long long duration_ms = 0;
+        unsigned long long bytes = 0;
+        unsigned long long pause_us = 0;
+        
+        /* Roughly how long recovering right now would take. */
+        unsigned long long recovery_ms = 0;
+    };
+    
+    class checkpoint_class
+    {
+    public:
+        /** Checkpoints are written to [p].  One is started when the log
+         reaches [log_bytes] bytes, or [seconds] after the last one started
+         (0 turns either trigger off). */
+        explicit checkpoint_class(const std::string& p, const unsigned long long& log_bytes, 
+                const unsigned int& seconds) : path(p), max_log_bytes(log_bytes), trigger_bytes(log_bytes), 
+                interval(seconds), lock(), child(-1), writer(), written(0), lsn(0), offset(0), polls(0), 
+                started(std::chrono::steady_clock::now()), pause(), stats()
+        {
+        }
+        
+        ~checkpoint_class()
+        {
+            if(this->writer.joinable()) this->writer.join();
+        }
+        
+        /** Called between commands, when only one thread runs them: starts
+         a checkpoint if one is due, and finishes the one running if it's done. */
+        void poll(write_log::log_class& log, const shard_store::value_store& s)
+        {
+            /* Looking at the clock or the child costs a system call, so that's
+             only done every so often. */
+            if(this->size_due(log) || (((++this->polls) & 1023) == 0)) this->check(log, s);
+        }
+        
+        /** Starts a checkpoint if it's time for one, and finishes the one
+         running if it's done.  For callers that sit idle between commands,
+         or that share the checkpoints with other threads.  Returns at once
+         if another thread is already doing it. */
+        void check(write_log::log_class&, const shard_store::value_store&);
+        
+        /** Waits for a checkpoint that is running to finish. */
+        void finish(write_log::log_class& log)
+        {
+            std::lock_guard<std::mutex> hold(this->lock);
+            if(this->running()) this->wait(log, true);
+        }
+        
+        bool running() const
+        {
+            return ((this->child >= 0) || this->writer.joinable());
+        }
+        
+        const std::string& get_path() const
+        {
+            return this->path;
+        }
+        
+        stats_data get_stats(const write_log::log_class&) const;
+        
+    private:
+        std::string path;
+        unsigned long long max_log_bytes;
+        
+        /* The log size that starts the next checkpoint.  After one fails,
+         the log has to grow by another [max_log_bytes] before retrying. */
+        unsigned long long trigger_bytes;
+        unsigned int interval;
+        mutable std::mutex lock;
+        
+        /* The running checkpoint: its child (or thread, and whether that
+         succeeded once it's done: 1 yes, 2 no), the LSN its snapshot is
+         tagged with, and where the log records after that start. */
+        pid_t child;
+        std::thread writer;
+        std::atomic<int> written;
+        unsigned long long lsn;
+        unsigned long long offset;
+        
+        unsigned long long polls;
+        std::chrono::steady_clock::time_point started;
+        std::chrono::steady_clock::duration pause;
+        stats_data stats;
+        
+        bool size_due(const write_log::log_class& log) const
+        {
+            return ((this->max_log_bytes > 0) && (log.size() >= this->trigger_bytes));
+        }
+        
+        /** Starts a checkpoint, unless one is running already. */
+        bool start(write_log::log_class&, const shard_store::value_store&);
+        void wait(write_log::log_class&, const bool&);
+        
+    };
+    
+}
+
+#endif
@@ -0,0 +1,254 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2014 Jonathan Craig Whitlock
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+ */
+
+
+
+#ifndef COMMAND_TABLE_HPP_INCLUDED
+#define COMMAND_TABLE_HPP_INCLUDED
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+namespace db_command
+{
+    
+    /** Defines a command's type. */
+    enum command_type
+    {
+        null_com = 0,
+        setvar = 1,
+        getvar = 2,
+        unsetvar = 3,
+        numequaltovar = 4,
+        end = 5,
+        commit = 6,
+        rollback = 7,
+        begin = 8,
+        stats = 9,
+        numbetweenvar = 10,
+        numgreaterthanvar = 11,
+        numlessthanvar = 12,
+        keysequaltovar = 13,
+        helpcom = 14,
+        savecom = 15,
+        loadcom = 16
+    };
+    
+    /** What a command's first argument is, before any values. */
+    enum argument_kind
+    {
+        values_only = 0,
+        key_first = 1,
+        path_first = 2
+    };
+    
+    /** Describes a command: its name, the arguments it takes (what the
+     first one is, and how many values follow), and its help text. */
+    struct command_info_data
+    {
+        const char* name;
+        command_type type;
+        argument_kind first;
+        unsigned int min_values;
+        unsigned int max_values;
+        const char* help;
+    };
+    
+    /**
+     * Every command there is, in command_type order.  This is the only place
+     * a command has to be added: recognizing its name, checking its arguments
+     * and HELP all come from here.  Commands with no help text are not listed
+     * by HELP.
+     */
+    struct command_table
+    {
+        static constexpr command_info_data entries[] = {
+            {"NULL", null_com, values_only, 0, 0, ""},
+            {"SET", setvar, key_first, 1, 1, "SET [name] [value] : sets/creates a variable"},
+            {"GET", getvar, key_first, 0, 0, "GET [name] : prints a variable"},
+            {"UNSET", unsetvar, key_first, 0, 0, "UNSET [name] : deletes a variable"},
+            {"NUMEQUALTO", numequaltovar, values_only, 1, std::numeric_limits<unsigned int>::max(), 
+                    "NUMEQUALTO [value] ... : prints number of objects equal to each number"},
+            {"END", end, values_only, 0, 0, "END : exits program"},
+            {"COMMIT", commit, values_only, 0, 0, "COMMIT : commits all transaction blocks"},
+            {"ROLLBACK", rollback, values_only, 0, 0, "ROLLBACK : removes the most recent transaction block"},
+            {"BEGIN", begin, values_only, 0, 0, "BEGIN : opens a transaction block"},
+            {"STATS", stats, values_only, 0, 0, 
+                    "STATS : prints the size of the stack, the keys interned and the state of the key index"},
+            {"NUMBETWEEN", numbetweenvar, values_only, 2, 2, 
+                    "NUMBETWEEN [low] [high] : prints number of objects from low to high (inclusive)"},
+            {"NUMGREATERTHAN", numgreaterthanvar, values_only, 1, 1, 
+                    "NUMGREATERTHAN [value] : prints number of objects greater than a number"},
+            {"NUMLESSTHAN", numlessthanvar, values_only, 1, 1, 
+                    "NUMLESSTHAN [value] : prints number of objects less than a number"},
+            {"KEYSEQUALTO", keysequaltovar, values_only, 1, 1, 
+                    "KEYSEQUALTO [value] : prints the name of every object equal to a number"},
+            {"HELP", helpcom, values_only, 0, 0, "HELP : lists the commands"},
+            {"SAVE", savecom, path_first, 0, 0, "SAVE [file] : writes the committed variables to a snapshot"},
+            {"LOAD", loadcom, path_first, 0, 0, "LOAD [file] : replaces every variable with a snapshot's"}
+        };
+        
+        static constexpr std::size_t size = (sizeof(entries) / sizeof(entries[0]));
+    };
+    
+    /** Builds the perfect hash for the command names while compiling. */
+    namespace command_hash
+    {
+        /* The hash picks a slot in a table of 2^[table_bits]. */
+        constexpr unsigned int table_bits = 5;
+        constexpr std::size_t table_size = (std::size_t(1) << table_bits);
+        constexpr unsigned char no_command = 0xff;
+        constexpr unsigned int max_tries = 256;
+        
+        /** Folds lower case letters, so names hash the same in any case. */
+        constexpr std::uint32_t fold(const char& ch)
+        {
+            return (((ch >= 'a') && (ch <= 'z')) ? (std::uint32_t)(ch - ('a' - 'A')) : (std::uint32_t)(unsigned char)ch);
+        }
+        
+        /** Only the length and the first, middle and last characters are
+         hashed; that is enough to tell the commands apart. */
+        constexpr std::uint32_t slot(const char* s, const std::size_t& n, const std::uint32_t& seed)
+        {
+            return (std::uint32_t)(((((fold(s[0]) * 31u) + fold(s[n / 2])) * 31u + fold(s[n - 1])) * 31u + 
+                    (std::uint32_t)n) * seed) >> (32 - table_bits);
+        }
+        
+        constexpr std::size_t length(const char* s)
+        {
+            return ((*s == 0) ? 0 : (1 + length(s + 1)));
+        }
+        
+        constexpr std::uint32_t entry_slot(const std::size_t& x, const std::uint32_t& seed)
+        {
+            return slot(command_table::entries[x].name, length(command_table::entries[x].name), seed);
+        }
+        
+        /** Returns true if entry [x] has the same slot as one from [y] on. */
+        constexpr bool collides(const std::uint32_t& seed, const std::size_t& x, const std::size_t& y)
+        {
+            return ((y < command_table::size) && ((entry_slot(x, seed) == entry_slot(y, seed)) || 
+                    collides(seed, x, (y + 1))));
+        }
+        
+        /** Returns true if the entries from [x] on all have different slots. */
+        constexpr bool distinct(const std::uint32_t& seed, const std::size_t& x)
+        {
+            return ((x == command_table::size) || (!collides(seed, x, (x + 1)) && distinct(seed, (x + 1))));
+        }
+        
+        constexpr std::uint32_t candidate(const unsigned int& n)
+        {
+            return (0x9e3779b1u + (2u * n));
+        }
+        
+        /** Returns the first seed that gives every command its own slot, or 0. */
+        constexpr std::uint32_t find_seed(const unsigned int& n)
+        {
+            return ((n == max_tries) ? 0 : (distinct(candidate(n), 0) ? candidate(n) : find_seed(n + 1)));
+        }
+        
+        constexpr std::uint32_t seed = find_seed(0);
+        static_assert((seed != 0), "No perfect hash for the command names was found: make table_bits bigger.");
+        static_assert((command_table::size < table_size), "There are more commands than hash slots.");
+        
+        constexpr bool in_order(const std::size_t& x)
+        {
+            return ((x == command_table::size) || ((command_table::entries[x].type == (command_type)x) && 
+                    in_order(x + 1)));
+        }
+        
+        static_assert(in_order(0), "command_table::entries must be in command_type order.");
+        
+        /** Returns the entry that hashes to slot [s], or no_command. */
+        constexpr unsigned char command_at(const std::size_t& s, const std::size_t& x)
+        {
+            return ((x == command_table::size) ? no_command : 
+                    ((entry_slot(x, seed) == s) ? (unsigned char)x : command_at(s, (x + 1))));
+        }
+        
+        template<std::size_t... s>
+        struct index_list
+        {
+        };
+        
+        template<std::size_t n, std::size_t... s>
+        struct make_index_list : make_index_list<(n - 1), (n - 1), s...>
+        {
+        };
+        
+        template<std::size_t... s>
+        struct make_index_list<0, s...>
+        {
+            typedef index_list<s...> type;
+        };
+        
+        template<class list_type>
+        struct slot_table;
+        
+        /** The slots, filled in by the compiler. */
+        template<std::size_t... s>
+        struct slot_table<index_list<s...> >
+        {
+            static constexpr unsigned char slots[sizeof...(s)] = {command_at(s, 0)...};
+        };
+        
+        template<std::size_t... s>
+        constexpr unsigned char slot_table<index_list<s...> >::slots[sizeof...(s)];
+        
+        typedef slot_table<typename make_index_list<table_size>::type> slots;
+    }
+    
+    /** Returns the command named by the [size] characters at [name], or
+     nullptr if there isn't one.  Case only matters if [ignore_case] is false. */
+    inline const command_info_data* find_command(const char* name, const std::size_t& size, 
+            const bool& ignore_case)
+    {
+        if(size == 0) return nullptr;
+        
+        unsigned char x(command_hash::slots::slots[command_hash::slot(name, size, command_hash::seed)]);
+        if(x == command_hash::no_command) return nullptr;
+        
+        const char* s(command_table::entries[x].name);
+        for(std::size_t y = 0; y < size; y++)
+        {
+            if(s[y] == 0) return nullptr;
+            if(ignore_case ? (command_hash::fold(s[y]) != command_hash::fold(name[y])) : (s[y] != name[y])) 
+            {
+                return nullptr;
+            }
+        }
+        if(s[size] != 0) return nullptr;
+        return &command_table::entries[x];
+    }
+    
+    /** Returns the description of a command. */
+    inline const command_info_data& command_info(const command_type& type)
+    {
+        return command_table::entries[type];
+    }
+    
+}
+
+#endif
@@ -23,12 +23,13 @@
  */
 
 #include <string>
-#include <utility>
 #include <vector>
-#include <map>
 
 #include "database_command.hpp"
-#include "variable_stack.hpp"
+#include "shard_store.hpp"
+#include "symbol_table.hpp"
+#include "command_reader.hpp"
+#include "command_table.hpp"
 
 namespace
 {
@@ -36,34 +37,48 @@ namespace
 
 namespace db_command
 {
-    namespace type_checks
+    constexpr command_info_data command_table::entries[];
+    constexpr std::size_t command_table::size;
+    
+    /** Converts the text of a value.  Returns false if the [size] characters
+     at [s] can't be stored as one (only text that is too long can't). */
+    bool parse_value(const char* s, const std::size_t& size, value_type& v)
     {
-        std::vector<std::pair<db_command::command_type, std::string> > retrieve_commands()
+        return value_type::parse(s, size, v);
+    }
+    
+    /** Builds the command [com] that [info] describes from the [count]
+     arguments that followed it on the line, checking that it was given the
+     right number of arguments and that its values can be stored.  Returns
+     false if it wasn't.  The key is looked up
+     in [keys] here, which is the only time it gets hashed; only SET can
+     add a key to the store, and UNSET [in_transaction]: there it is a write
+     even if the key doesn't exist yet, and needs an id to be kept under. */
+    bool compile_command(const command_info_data& info, const command_reader::token_data* args, 
+            const std::size_t& count, database_command_data& com, shard_store::store_class<value_type>& keys, 
+            const bool& in_transaction)
+    {
+        com = database_command_data();
+        com.command = info.type;
+        
+        unsigned int first((info.first != values_only) ? 1 : 0);
+        if((count < (first + info.min_values)) || ((count - first) > info.max_values)) return false;
+        for(std::size_t x = first; x < count; x++)
         {
-            using db_command::command_type;
-
-            std::vector<std::pair<command_type, std::string> > coms;
-            std::string command_names[9] = {
-                "NULL",
-                "SET",
-                "GET",
-                "UNSET",
-                "NUMEQUALTO",
-                "END",
-                "COMMIT",
-                "ROLLBACK",
-                "BEGIN"
-            };
-            for(unsigned int x = 0; x < 9; x++)
+            value_type v;
+            if(!parse_value(args[x].data, args[x].size, v)) return false;
+            com.add_value(v);
+        }
+        if(info.first == path_first) com.path = args[0].str();
+        else if(info.first == key_first)
+        {
+            if((info.type == setvar) || ((info.type == unsetvar) && in_transaction))
             {
-                coms.push_back(std::pair<command_type, std::string>());
-                coms.back().first = (command_type)x;
-                coms.back().second = command_names[x];
+                com.key = keys.intern(args[0].data, args[0].size);
             }
-            return coms;
+            else com.key = keys.find(args[0].data, args[0].size);
         }
-    
-    
+        return true;
     }
     
     
@@ -25,139 +25,74 @@
 #ifndef DATABASE_COMMAND_HPP_INCLUDED
 #define DATABASE_COMMAND_HPP_INCLUDED
 #include <string>
-#include <map>
 #include <vector>
-#include <iostream>
-#include <utility>
 
-#include "variable_stack.hpp"
+#include "command_table.hpp"
+#include "shard_store.hpp"
+#include "symbol_table.hpp"
+#include "command_reader.hpp"
+#include "output_sink.hpp"
+#include "hash_index.hpp"
+#include "typed_value.hpp"
 
 namespace db_command
 {
-    struct database_command_data;
+    /** The type of value stored in the database. */
+    typedef typed_value::value_class value_type;
     
-    
-    
-    /** Defines a command's type. */
-    enum command_type
-    {
-        null_com = 0,
-        setvar = 1,
-        getvar = 2,
-        unsetvar = 3,
-        numequaltovar = 4,
-        end = 5,
-        commit = 6,
-        rollback = 7,
-        begin = 8
-    };
-    
-    
-    /** contains essential type_check templates, and a function that
-     retrieve_command_map uses. */
-    namespace type_checks
-    {
-        std::vector<std::pair<db_command::command_type, std::string> > retrieve_commands();
-        
-        template<class type>
-        struct is_command_type : std::false_type
-        {
-        };
-
-        template<>
-        struct is_command_type<db_command::command_type> : std::true_type
-        {
-        };
-
-        template<class type>
-        struct is_string_type : std::false_type
-        {
-        };
-
-        template<>
-        struct is_string_type<std::string> : std::true_type
-        {
-        };
-    }
-    
-    
-    
-    /** Represents a single command. */
+    /** Represents a single command, already parsed: the interned key it
+     works on (or the file, for the few that take one) and its values, converted
+     once when it was read.
+     Up to two values are kept inline; only a NUMEQUALTO with more than that
+     needs more memory. */
     struct database_command_data
     {
         command_type command = null_com;
-        std::vector<std::string> args;
+        symbols::id_type key = symbols::no_id;
+        std::string path;
+        unsigned int value_count = 0;
+        value_type values[2];
+        std::vector<value_type> more_values;
         
-        const database_command_data& operator=(const database_command_data& d)
+        /** Returns the [x]th value. */
+        const value_type& value(const unsigned int& x) const
         {
-            if(this != &d)
-            {
-                this->command = d.command;
-                this->args = d.args;
-            }
-            return *this;
+            if(x < 2) return this->values[x];
+            return this->more_values[(x - 2)];
+        }
+        
+        void add_value(const value_type& v)
+        {
+            if(this->value_count < 2) this->values[this->value_count] = v;
+            else this->more_values.push_back(v);
+            this->value_count++;
         }
     };
     
+    bool parse_value(const char*, const std::size_t&, value_type&);
+    
+    /** Writes a value as text. */
+    inline void put_value(output_sink::sink_class& out, const value_type& v)
+    {
+        char text[value_type::max_format];
+        out.put(text, v.format(text));
+    }
+    bool compile_command(const command_info_data&, const command_reader::token_data*, const std::size_t&, 
+            database_command_data&, shard_store::store_class<value_type>&, const bool& = false);
+    
     
     /** the namespace limits the function's definition. */
     namespace
     {
-        /** Retrieves a map of strings and command types.  This will allow
-         the easy retrieval and use of commands and their corresponding
-         data representations */
-        template<class type1, class type2>
-        std::map<type1, type2> retrieve_command_map()
-        {
-            using namespace type_checks;
-            
-            /* If you're getting an error here, then you're passing the wrong value types.  This
-             function takes a string and a command_type in any order.  std::enable_if
-             is used to make sure you don't use this function incorrectly! */
-            return std::map<typename std::enable_if<((is_string_type<type1>::value && is_command_type<type2>::value) ||
-                    (is_command_type<type1>::value && is_string_type<type2>::value)), type1>::type, 
-                    typename std::enable_if<((is_string_type<type1>::value && is_command_type<type2>::value) ||
-                    (is_command_type<type1>::value && is_string_type<type2>::value)), type2>::type>();
-        }
-        
-        template<>
-        std::map<command_type, std::string> retrieve_command_map<command_type, std::string>()
-        {
-            using namespace type_checks;
-
-            std::vector<std::pair<command_type, std::string> > command_associations(retrieve_commands());
-            std::map<command_type, std::string> coms;
-            unsigned int size(command_associations.size());
-            for(unsigned int x = 0; x < size; x++)
-            {
-                coms[command_associations[x].first] = command_associations[x].second;
-            }
-            return coms;
-        }
-
-        template<>
-        std::map<std::string, command_type> retrieve_command_map<std::string, command_type>()
+        /** Executes commands that can be applied to the stack, and writes
+         what they print to [out].  [s] can be a stack_class, or anything that
+         looks like one (such as the store seen through open transactions).
+         The command must have been built by compile_command, so its arguments
+         are already checked; [keys] is the store its key was interned in. */
+        template<class store_type>
+        void execute_command(const database_command_data& com, store_type* s,
+                const shard_store::store_class<value_type>& keys, output_sink::sink_class& out)
         {
-            using namespace type_checks;
-
-            std::vector<std::pair<command_type, std::string> > command_associations(retrieve_commands());
-            std::map<std::string, command_type> coms;
-            unsigned int size(command_associations.size());
-            for(unsigned int x = 0; x < size; x++)
-            {
-                coms[command_associations[x].second] = command_associations[x].first;
-            }
-            return coms;
-        }
-        
-        /** Executes commands that can be applied to the stack. */
-        template<class type>
-        std::string execute_command(const database_command_data& com, 
-                var_stack::stack_class<type>* s)
-        {
-            using std::cout;
-            
-            std::string message;
             switch(com.command)
             {
                 case null_com:
@@ -167,62 +102,142 @@ namespace db_command
                 
                 case setvar:
                 {
-                    if(com.args.size() < 2)
-                    {
-                        message = "Invalid arguments";
-                    }
-                    if(com.args.size() >= 2)
-                    {
-                        s->set_var(com.args[0], std::stoi(com.args[1]));
-                    }
+                    /* A new key gets no id once its shard is out of room for keys. */
+                    if(com.key == symbols::no_id) out.put("no room for another key\n");
+                    else s->set_var(com.key, com.value(0));
                 }
                 break;
                 
                 case getvar:
                 {
-                    message = "invalid arguments";
-                    if(com.args.size() > 0)
+                    auto var(s->find_var(com.key));
+                    switch(var != nullptr)
                     {
-                        message.erase();
-                        switch(s->var_exists(com.args[0]))
+                        case true:
                         {
-                            case true:
-                            {
-                                message = std::to_string(s->find_name(com.args[0]).value);
-                            }
-                            break;
-                            
-                            case false:
-                            {
-                                message = "NULL";
-                            }
-                            break;
-                            
-                            default:
-                            {
-                            }
-                            break;
+                            put_value(out, var->value);
                         }
+                        break;
+                        
+                        case false:
+                        {
+                            out.put("NULL");
+                        }
+                        break;
+                        
+                        default:
+                        {
+                        }
+                        break;
                     }
+                    out.put('\n');
                 }
                 break;
                 
                 case unsetvar:
                 {
-                    message = "invalid arguments";
-                    if(com.args.size() > 0)
+                    s->remove_var(com.key);
+                }
+                break;
+                
+                case numequaltovar:
+                {
+                    /* Any number of values can be asked for at once; each count
+                     is printed on its own line, in the order they were given. */
+                    for(unsigned int x = 0; x < com.value_count; x++)
                     {
-                        message.erase();
-                        s->remove_var(com.args[0]);
+                        out.put(s->find_values(com.value(x)));
+                        out.put('\n');
                     }
                 }
                 break;
                 
-                case numequaltovar:
+                case numbetweenvar:
+                {
+                    out.put(s->find_values_between(com.value(0), com.value(1)));
+                    out.put('\n');
+                }
+                break;
+                
+                case numgreaterthanvar:
+                {
+                    out.put(s->find_values_greater(com.value(0)));
+                    out.put('\n');
+                }
+                break;
+                
+                case numlessthanvar:
+                {
+                    out.put(s->find_values_less(com.value(0)));
+                    out.put('\n');
+                }
+                break;
+                
+                case keysequaltovar:
+                {
+                    /* Prints the name of every variable equal to the value, one per line. */
+                    bool indexed(s->for_each_key(com.value(0), [&out, &keys](const symbols::id_type& id)
+                    {
+                        out.put(keys.name(id));
+                        out.put('\n');
+                    }));
+                    if(!indexed) out.put("key index disabled\n");
+                }
+                break;
+                
+                case stats:
+                {
+                    hash_index::index_stats_data index(keys.index_stats());
+                    std::size_t memory(keys.memory_bytes());
+                    out.put("keys: ");
+                    out.put(s->size());
+                    out.put("\nsymbols: ");
+                    out.put(index.size);
+                    out.put("\nindex slots: ");
+                    out.put(index.capacity);
+                    out.put("\nindex resizes: ");
+                    out.put(index.migrations);
+                    out.put("\nrehash: ");
+                    if(index.migrating > 0)
+                    {
+                        out.put(index.migrated);
+                        out.put('/');
+                        out.put(index.migrating);
+                        out.put(" slots migrated");
+                    }
+                    else out.put("idle");
+                    out.put("\nrehash step: ");
+                    out.put(index.step);
+                    out.put("\nmemory: ");
+                    out.put(memory);
+                    out.put(" bytes\nbytes per key: ");
+                    out.put((s->size() == 0) ? 0 : ((memory + (s->size() / 2)) / s->size()));
+                    out.put('\n');
+                    if(keys.shard_count() > 1)
+                    {
+                        out.put("shards: ");
+                        out.put(keys.shard_count());
+                        out.put('\n');
+                    }
+                }
+                break;
+                
+                case savecom:
+                case loadcom:
                 {
-                    if(com.args.size() > 0)
+                    /* These work on the stack itself, so they're run by the caller. */
+                }
+                break;
+                
+                case helpcom:
+                {
+                    for(std::size_t x = 0; x < command_table::size; x++)
                     {
-                        message =  std::to_string(s->find_values(std::stoi(com.args[0])));
+                        if(command_table::entries[x].help[0] != 0)
+                        {
+                            out.put(command_table::entries[x].help);
+                            out.put('\n');
+                        }
                     }
                 }
                 break;
@@ -236,7 +251,6 @@ namespace db_command
                 }
                 break;
             }
-            return message;
         }
         
         
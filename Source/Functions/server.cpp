@@ -0,0 +1,415 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2014 Jonathan Craig Whitlock
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+ */
+
+
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <cstring>
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
+#include <unistd.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include "server.hpp"
+#include "session.hpp"
+#include "output_sink.hpp"
+#include "global_variables.hpp"
+
+namespace
+{
+    std::atomic<bool> stopping(false);
+    
+    /* The eventfd that wakes the workers up. */
+    int wake_signal_fd(-1);
+    
+    /** Stops every worker.  It's called from a signal handler, so it
+     does nothing but set a flag and write to the eventfd. */
+    void stop_all()
+    {
+        std::uint64_t one(1);
+        stopping = true;
+        if(wake_signal_fd >= 0)
+        {
+            ssize_t ignored(write(wake_signal_fd, &one, sizeof(one)));
+            (void)ignored;
+        }
+    }
+    
+    void stop_signal(int)
+    {
+        stop_all();
+    }
+    
+    /** Splits "host:port" (the host may be in brackets, for IPv6).  A
+     lone port means every address. */
+    void split_address(const std::string& address, std::string& host, std::string& port)
+    {
+        std::string::size_type colon(address.rfind(':'));
+        if(colon == std::string::npos)
+        {
+            host.clear();
+            port = address;
+            return;
+        }
+        host = address.substr(0, colon);
+        port = address.substr(colon + 1);
+        if((host.size() >= 2) && (host.front() == '[') && (host.back() == ']'))
+        {
+            host = host.substr(1, (host.size() - 2));
+        }
+    }
+    
+}
+
+namespace server
+{
+    const unsigned int server_class::turn_commands;
+    const std::size_t server_class::connection_buffer;
+    
+    server_class::server_class(const session::shared_data& s, const output_sink::flush_policy& p, 
+            const unsigned int& threads) : shared(s), session_shared(s), policy(p), workers(), listeners(), 
+            unix_paths(), wake_fd(eventfd(0, (EFD_NONBLOCK | EFD_CLOEXEC)))
+    {
+        epoll_event e;
+        std::memset(&e, 0, sizeof(e));
+        e.events = EPOLLIN;
+        e.data.fd = this->wake_fd;
+        for(unsigned int x = 0; x < ((threads > 0) ? threads : 1); x++)
+        {
+            this->workers.push_back(std::unique_ptr<worker_data>(new worker_data()));
+            this->workers.back()->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+            if((this->workers.back()->epoll_fd >= 0) && (this->wake_fd >= 0))
+            {
+                epoll_ctl(this->workers.back()->epoll_fd, EPOLL_CTL_ADD, this->wake_fd, &e);
+            }
+        }
+        if(this->workers.size() > 1) this->session_shared.checkpoints = nullptr;
+    }
+    
+    server_class::~server_class()
+    {
+        for(std::size_t x = 0; x < this->workers.size(); x++)
+        {
+            worker_data& w(*this->workers[x]);
+            while(!w.connections.empty()) this->close_connection(w, w.connections.begin()->first);
+            if(w.epoll_fd >= 0) close(w.epoll_fd);
+        }
+        for(std::size_t x = 0; x < this->listeners.size(); x++) close(this->listeners[x]);
+        for(std::size_t x = 0; x < this->unix_paths.size(); x++) unlink(this->unix_paths[x].c_str());
+        if(this->wake_fd >= 0) close(this->wake_fd);
+    }
+    
+    bool server_class::listen_tcp(const std::string& address, std::string& error)
+    {
+        std::string host, port;
+        addrinfo hints, *found(nullptr);
+        int fd(-1), result(0), on(1);
+        
+        split_address(address, host, port);
+        std::memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_flags = AI_PASSIVE;
+        result = getaddrinfo((host.empty() ? nullptr : host.c_str()), port.c_str(), &hints, &found);
+        if(result != 0)
+        {
+            error = ("can't listen on " + address + ": " + gai_strerror(result));
+            return false;
+        }
+        for(addrinfo* a = found; ((a != nullptr) && (fd < 0)); a = a->ai_next)
+        {
+            fd = socket(a->ai_family, (a->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC), a->ai_protocol);
+            if(fd < 0) continue;
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+            if((bind(fd, a->ai_addr, a->ai_addrlen) != 0) || (listen(fd, SOMAXCONN) != 0))
+            {
+                result = errno;
+                close(fd);
+                fd = -1;
+                errno = result;
+            }
+        }
+        freeaddrinfo(found);
+        if(fd < 0)
+        {
+            error = ("can't listen on " + address + ": " + std::strerror(errno));
+            return false;
+        }
+        return this->add_listener(fd, error);
+    }
+    
+    bool server_class::listen_unix(const std::string& path, std::string& error)
+    {
+        sockaddr_un a;
+        struct stat info;
+        int fd(-1);
+        
+        std::memset(&a, 0, sizeof(a));
+        a.sun_family = AF_UNIX;
+        if(path.size() >= sizeof(a.sun_path))
+        {
+            error = ("can't listen on " + path + ": the path is too long");
+            return false;
+        }
+        std::memcpy(a.sun_path, path.data(), path.size());
+        
+        /* A socket left behind by a server that was killed is in the way,
+         but anything else at that path is left alone. */
+        if((lstat(path.c_str(), &info) == 0) && S_ISSOCK(info.st_mode)) unlink(path.c_str());
+        fd = socket(AF_UNIX, (SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC), 0);
+        if((fd < 0) || (bind(fd, (sockaddr*)&a, sizeof(a)) != 0) || (listen(fd, SOMAXCONN) != 0))
+        {
+            error = ("can't listen on " + path + ": " + std::strerror(errno));
+            if(fd >= 0) close(fd);
+            return false;
+        }
+        this->unix_paths.push_back(path);
+        return this->add_listener(fd, error);
+    }
+    
+    bool server_class::run(std::string& error)
+    {
+        std::vector<std::thread> threads;
+        struct sigaction action;
+        bool success(true);
+        
+        for(std::size_t x = 0; x < this->workers.size(); x++)
+        {
+            if((this->workers[x]->epoll_fd < 0) || (this->wake_fd < 0))
+            {
+                error = (std::string("can't start the server: ") + std::strerror(errno));
+                return false;
+            }
+        }
+        
+        /* A client that goes away must not take the server with it, and
+         stopping is only noticed between waits (no SA_RESTART, so a signal
+         interrupts the wait, and the eventfd wakes the other workers). */
+        wake_signal_fd = this->wake_fd;
+        std::signal(SIGPIPE, SIG_IGN);
+        std::memset(&action, 0, sizeof(action));
+        action.sa_handler = stop_signal;
+        sigemptyset(&action.sa_mask);
+        sigaction(SIGINT, &action, nullptr);
+        sigaction(SIGTERM, &action, nullptr);
+        
+        for(std::size_t x = 1; x < this->workers.size(); x++)
+        {
+            threads.push_back(std::thread(&server_class::loop, this, std::ref(*this->workers[x])));
+        }
+        this->loop(*this->workers[0]);
+        for(std::size_t x = 0; x < threads.size(); x++) threads[x].join();
+        for(std::size_t x = 0; (success && (x < this->workers.size())); x++)
+        {
+            success = this->workers[x]->error.empty();
+            if(!success) error = this->workers[x]->error;
+        }
+        return success;
+    }
+    
+    /** Runs one worker until the server stops.  Returns false (after
+     stopping the others) if its loop fails. */
+    bool server_class::loop(worker_data& w)
+    {
+        std::vector<epoll_event> events(256);
+        std::vector<int> turn;
+        int count(0);
+        
+        while(!stopping)
+        {
+            /* Connections that still have lines buffered must not wait.  When
+             there are checkpoints, the worker wakes up now and then so one
+             can be started or finished while it is idle. */
+            int timeout(-1);
+            if(!w.ready.empty()) timeout = 0;
+            else if(this->shared.checkpoints != nullptr) timeout = 1000;
+            
+            count = epoll_wait(w.epoll_fd, events.data(), (int)events.size(), timeout);
+            if((count < 0) && (errno != EINTR))
+            {
+                w.error = (std::string("server: ") + std::strerror(errno));
+                stop_all();
+                return false;
+            }
+            for(int x = 0; x < count; x++)
+            {
+                int fd(events[x].data.fd);
+                if(fd == this->wake_fd) continue;
+                
+                auto c(w.connections.find(fd));
+                if(c == w.connections.end())
+                {
+                    this->accept_all(w, fd);
+                    continue;
+                }
+                
+                connection_data& connection(*c->second);
+                if(!connection.writing) this->serve(w, fd);
+                else if(!connection.client.output().retry() && connection.client.output().good())
+                {
+                    if((events[x].events & (EPOLLERR | EPOLLHUP)) != 0) this->close_connection(w, fd);
+                }
+                else if(connection.closing || !connection.client.output().good()) this->close_connection(w, fd);
+                else
+                {
+                    this->wait_for(w, fd, connection, false);
+                    this->serve(w, fd);
+                }
+            }
+            
+            /* Everyone with commands left over from their last turn gets
+             another one. */
+            turn.swap(w.ready);
+            w.ready.clear();
+            for(std::size_t x = 0; x < turn.size(); x++)
+            {
+                auto c(w.connections.find(turn[x]));
+                if(c != w.connections.end())
+                {
+                    c->second->ready = false;
+                    if(!c->second->writing) this->serve(w, turn[x]);
+                }
+            }
+            turn.clear();
+            if(this->shared.checkpoints != nullptr)
+            {
+                this->shared.checkpoints->check(*this->shared.log, global::vStore);
+            }
+        }
+        return true;
+    }
+    
+    bool server_class::add_listener(const int& fd, std::string& error)
+    {
+        epoll_event e;
+        std::memset(&e, 0, sizeof(e));
+        e.events = EPOLLIN;
+        
+        /* Every worker waits on the listener, but only one of them needs to
+         wake up for each new connection. */
+#ifdef EPOLLEXCLUSIVE
+        if(this->workers.size() > 1) e.events |= EPOLLEXCLUSIVE;
+#endif
+        e.data.fd = fd;
+        for(std::size_t x = 0; x < this->workers.size(); x++)
+        {
+            if((this->workers[x]->epoll_fd < 0) || (epoll_ctl(this->workers[x]->epoll_fd, EPOLL_CTL_ADD, fd, &e) != 0))
+            {
+                error = (std::string("can't start the server: ") + std::strerror(errno));
+                for(std::size_t y = 0; y < x; y++) epoll_ctl(this->workers[y]->epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+                close(fd);
+                return false;
+            }
+        }
+        this->listeners.push_back(fd);
+        return true;
+    }
+    
+    void server_class::accept_all(worker_data& w, const int& listener)
+    {
+        epoll_event e;
+        int fd(-1), on(1);
+        
+        /* With several workers each takes one connection per wake-up, so
+         that a burst of them is spread out instead of all going to one. */
+        bool once(this->workers.size() > 1);
+        std::memset(&e, 0, sizeof(e));
+        e.events = EPOLLIN;
+        while((fd = accept4(listener, nullptr, nullptr, (SOCK_NONBLOCK | SOCK_CLOEXEC))) >= 0)
+        {
+            /* Answers are already batched by the sink, so Nagle would only
+             add latency.  This fails harmlessly on Unix sockets. */
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+            e.data.fd = fd;
+            if(epoll_ctl(w.epoll_fd, EPOLL_CTL_ADD, fd, &e) != 0)
+            {
+                close(fd);
+                continue;
+            }
+            w.connections[fd].reset(new connection_data(fd, this->policy, this->session_shared));
+            if(once) break;
+        }
+    }
+    
+    /** Gives a connection its turn: runs what it sent, and sends what that
+     answered. */
+    void server_class::serve(worker_data& w, const int& fd)
+    {
+        connection_data& connection(*w.connections[fd]);
+        output_sink::sink_class& out(connection.client.output());
+        bool open(connection.client.run(turn_commands));
+        
+        out.flush();
+        if(!out.good() || (!open && !out.backed_up()))
+        {
+            this->close_connection(w, fd);
+            return;
+        }
+        
+        /* Until the client reads what it has been sent, we stop reading
+         what it sends. */
+        connection.closing = !open;
+        if(out.backed_up()) this->wait_for(w, fd, connection, true);
+        else if(connection.client.pending() && !connection.ready)
+        {
+            connection.ready = true;
+            w.ready.push_back(fd);
+        }
+    }
+    
+    void server_class::wait_for(worker_data& w, const int& fd, connection_data& connection, const bool& output)
+    {
+        epoll_event e;
+        std::memset(&e, 0, sizeof(e));
+        e.events = (output ? EPOLLOUT : EPOLLIN);
+        e.data.fd = fd;
+        epoll_ctl(w.epoll_fd, EPOLL_CTL_MOD, fd, &e);
+        connection.writing = output;
+    }
+    
+    void server_class::close_connection(worker_data& w, const int& fd)
+    {
+        /* The session goes first: whatever it still has to say is lost
+         anyway, and the descriptor must not be reused before it is gone. */
+        epoll_ctl(w.epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+        w.connections.erase(fd);
+        close(fd);
+    }
+    
+    
+}
@@ -0,0 +1,124 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2014 Jonathan Craig Whitlock
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+ */
+
+
+
+#ifndef SERVER_HPP_INCLUDED
+#define SERVER_HPP_INCLUDED
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+
+#include "session.hpp"
+#include "output_sink.hpp"
+
+namespace server
+{
+    /**
+     * Serves the database over TCP and Unix sockets.  Each worker thread has
+     * an epoll loop of its own, and every connection belongs to one of them:
+     * it is a session of its own, its commands are run as soon as whole lines
+     * arrive (so a client may pipeline as many as it likes), and their
+     * answers are written once the lines buffered for it run out.  The
+     * listening sockets are shared, and each new connection goes to
+     * whichever worker wakes up for it.
+     */
+    class server_class
+    {
+    public:
+        explicit server_class(const session::shared_data& s, const output_sink::flush_policy& p, 
+                const unsigned int& threads = 1);
+        ~server_class();
+        
+        /** Listens on "host:port", or "port" for every address. */
+        bool listen_tcp(const std::string& address, std::string& error);
+        
+        /** Listens on a Unix socket, which is removed again when the server stops. */
+        bool listen_unix(const std::string& path, std::string& error);
+        
+        /** Serves connections until SIGINT or SIGTERM.  Returns false if
+         the loops could not be set up, or one of them failed. */
+        bool run(std::string& error);
+        
+    private:
+        struct connection_data
+        {
+            explicit connection_data(const int& f, const output_sink::flush_policy& p, 
+                    const session::shared_data& s) : client(f, f, p, s, connection_buffer), writing(false), 
+                    closing(false), ready(false)
+            {
+            }
+            
+            session::session_class client;
+            
+            /* Whether we wait for the socket to take more output rather
+             than for more input, and whether it is closed once it has. */
+            bool writing;
+            bool closing;
+            bool ready;
+        };
+        
+        /** One worker thread: its epoll loop, and the connections it serves. */
+        struct worker_data
+        {
+            int epoll_fd = -1;
+            std::unordered_map<int, std::unique_ptr<connection_data> > connections;
+            
+            /* Connections with whole lines left to run after their last turn. */
+            std::vector<int> ready;
+            std::string error;
+        };
+        
+        /* Each connection runs this many commands at most before the
+         others get a turn. */
+        static const unsigned int turn_commands = 1024;
+        
+        /* The size of each connection's input and output buffers. */
+        static const std::size_t connection_buffer = (1 << 14);
+        
+        /* What the sessions are given: with more than one worker, the
+         checkpoints are left to the workers' loops. */
+        session::shared_data shared;
+        session::shared_data session_shared;
+        output_sink::flush_policy policy;
+        std::vector<std::unique_ptr<worker_data> > workers;
+        std::vector<int> listeners;
+        std::vector<std::string> unix_paths;
+        
+        /* Becomes readable when the server stops, so every worker wakes up. */
+        int wake_fd;
+        
+        bool add_listener(const int&, std::string&);
+        bool loop(worker_data&);
+        void accept_all(worker_data&, const int&);
+        void serve(worker_data&, const int&);
+        void wait_for(worker_data&, const int&, connection_data&, const bool&);
+        void close_connection(worker_data&, const int&);
+        
+    };
+    
+}
+
+#endif
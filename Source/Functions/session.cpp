@@ -0,0 +1,485 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2014 Jonathan Craig Whitlock
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+ */
+
+
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+
+#include "session.hpp"
+#include "transaction_block.hpp"
+#include "database_command.hpp"
+#include "global_variables.hpp"
+#include "shard_store.hpp"
+#include "command_reader.hpp"
+#include "output_sink.hpp"
+#include "snapshot.hpp"
+#include "write_log.hpp"
+#include "checkpoint.hpp"
+#include "wire_protocol.hpp"
+#include "typed_value.hpp"
+
+namespace
+{
+    /** Clears the screen the way common::cls does (200 newlines), but
+     through the session's own output. */
+    void clear_screen(output_sink::sink_class& out)
+    {
+        for(int x = 0; x < 200; x++) out.put('\n');
+    }
+    
+    /** Returns the status a value is answered with in the binary protocol,
+     and sets [n] to the response's value field. */
+    wire::status_type wire_status(const typed_value::value_class& v, std::int64_t& n)
+    {
+        switch(v.kind())
+        {
+            case typed_value::real_kind:
+            {
+                double d(v.as_real());
+                std::memcpy(&n, &d, sizeof(d));
+                return wire::status_real;
+            }
+            break;
+            
+            case typed_value::text_kind:
+            {
+                n = v.text_size();
+                return wire::status_text;
+            }
+            break;
+            
+            default:
+            {
+                n = v.as_integer();
+            }
+            break;
+        }
+        return wire::status_value;
+    }
+}
+
+namespace session
+{
+    session_class::session_class(const int& in, const int& out, const output_sink::flush_policy& policy, 
+            const shared_data& s, const std::size_t& block) : reader(in, block), out(out, policy, block), 
+            transactions(&global::vStore), tokens(), shared(s), started(false), binary(false)
+    {
+        /* No answer is written before the commits it follows are durable. */
+        if(this->shared.log->is_open())
+        {
+            write_log::log_class* log(this->shared.log);
+            this->transactions.set_log(log);
+            this->out.set_before_write([log](){ log->commit_point(); });
+        }
+    }
+    
+    bool session_class::run(const unsigned int& limit)
+    {
+        db_command::database_command_data command;
+        if(!this->started)
+        {
+            const char* data(nullptr);
+            if(!this->reader.need(1)) return this->reader.waiting();
+            this->reader.buffered(data);
+            this->binary = ((unsigned char)data[0] == wire::hello);
+            if(this->binary) this->reader.skip(1);
+            this->started = true;
+        }
+        if(this->binary) return this->run_binary(limit);
+        
+        for(unsigned int x = 0; ((limit == 0) || (x < limit)); x++)
+        {
+            command = this->gcommand_input();
+            if(command.command == db_command::end) return false;
+            if(command.command == db_command::null_com) return true;
+            this->execute_command(command);
+            this->between_commands();
+        }
+        return true;
+    }
+    
+    bool session_class::execute_command(const db_command::database_command_data& c)
+    {
+        taction_block::transaction_stack_class<typed_value::value_class>& transactions(this->transactions);
+        write_log::log_class& log(*this->shared.log);
+        checkpoint::checkpoint_class* checkpoints(this->shared.checkpoints);
+        output_sink::sink_class& out(this->out);
+        bool success(true);
+        switch(c.command)
+        {
+            case db_command::commit:
+            {
+                if(!transactions.commit())
+                {
+                    out.put("CONFLICT\n");
+                    success = false;
+                }
+            }
+            break;
+
+            case db_command::begin:
+            {
+                transactions.begin();
+            }
+            break;
+
+            case db_command::rollback:
+            {
+                if(!transactions.rollback())
+                {
+                    out.put("NO TRANSACTIONS\n");
+                    success = false;
+                }
+            }
+            break;
+
+            case db_command::savecom:
+            {
+                /* Only what has been committed is saved. */
+                std::string error;
+                {
+                    shard_store::value_store::lock_class hold(global::vStore);
+                    success = snapshot::save(c.path, global::vStore, (log.is_open() ? log.next_lsn() : 0), error);
+                }
+                if(!success)
+                {
+                    out.put(error);
+                    out.put('\n');
+                }
+            }
+            break;
+
+            case db_command::loadcom:
+            {
+                std::string error;
+                if(transactions.depth() > 0)
+                {
+                    out.put("can't LOAD while a transaction is open\n");
+                    success = false;
+                }
+                else if(log.is_open())
+                {
+                    /* The log only holds changes, so it can't replay a LOAD. */
+                    out.put("can't LOAD while the log is on; use --load\n");
+                    success = false;
+                }
+                else
+                {
+                    unsigned long long lsn(0);
+                    shard_store::value_store::lock_class hold(global::vStore, shard_store::value_store::writing);
+                    success = snapshot::load(c.path, global::vStore, lsn, error);
+                    global::vStore.all_changed();
+                    this->compact_keys(true);
+                }
+                if(!error.empty())
+                {
+                    out.put(error);
+                    out.put('\n');
+                }
+            }
+            break;
+
+            case db_command::stats:
+            {
+                db_command::execute_command(c, &transactions, global::vStore, out);
+                if(log.is_open())
+                {
+                    out.put("log lsn: ");
+                    out.put(log.next_lsn());
+                    out.put("\nlog bytes: ");
+                    out.put(log.size());
+                    out.put("\nlog records: ");
+                    out.put(log.record_count());
+                    out.put("\nlog syncs: ");
+                    out.put(log.sync_count());
+                    out.put('\n');
+                }
+                if(global::vStore.persistent_enabled())
+                {
+                    out.put("snapshot node copies: ");
+                    out.put(global::vStore.snapshot_copies());
+                    out.put('\n');
+                }
+                if(checkpoints != nullptr)
+                {
+                    checkpoint::stats_data stats(checkpoints->get_stats(log));
+                    out.put("checkpoints: ");
+                    out.put(stats.count);
+                    out.put("\ncheckpoint failures: ");
+                    out.put(stats.failures);
+                    out.put("\ncheckpoint: ");
+                    out.put(stats.running ? "running" : "idle");
+                    out.put("\nlast checkpoint ms: ");
+                    out.put(stats.duration_ms);
+                    out.put("\nlast checkpoint bytes: ");
+                    out.put(stats.bytes);
+                    out.put("\nlast checkpoint pause us: ");
+                    out.put(stats.pause_us);
+                    out.put("\nrecovery estimate ms: ");
+                    out.put(stats.recovery_ms);
+                    out.put('\n');
+                }
+            }
+            break;
+
+            default:
+            {
+                /* Outside of a transaction this goes straight to the store. */
+                db_command::execute_command(c, &transactions, global::vStore, out);
+            }
+            break;
+        }
+        return success;
+    }
+    
+    void session_class::between_commands()
+    {
+        if(this->shared.checkpoints != nullptr) this->shared.checkpoints->poll(*this->shared.log, global::vStore);
+        this->compact_keys(false);
+    }
+    
+    void session_class::compact_keys(const bool& now)
+    {
+        /* A checkpoint's thread reads the keys as they were when it started. */
+        if((this->shared.checkpoints != nullptr) && this->shared.checkpoints->running()) return;
+        if(now) global::vStore.compact_keys();
+        else global::vStore.poll_keys();
+    }
+    
+    /** Runs binary requests; returns the same as run. */
+    bool session_class::run_binary(const unsigned int& limit)
+    {
+        wire::request_data request;
+        const char* data(nullptr);
+        std::size_t size(0), used(0);
+        for(unsigned int x = 0; ((limit == 0) || (x < limit)); x++)
+        {
+            size = this->reader.buffered(data);
+            used = wire::decode_request(data, size, request);
+            if(used != 0) this->out.command_done(false);
+            while(used == 0)
+            {
+                /* Just like between lines of text: when the input runs dry,
+                 the commits so far are made durable and the answers sent. */
+                this->shared.log->commit_point();
+                this->out.command_done(true);
+                if(!this->reader.need(size + 1)) return this->reader.waiting();
+                size = this->reader.buffered(data);
+                used = wire::decode_request(data, size, request);
+            }
+            if((used == wire::malformed) || (request.opcode == db_command::end)) return false;
+            
+            /* The key is still in the reader's buffer until it is skipped. */
+            this->execute_request(request);
+            this->reader.skip(used);
+            this->between_commands();
+        }
+        return true;
+    }
+    
+    void session_class::execute_request(const wire::request_data& r)
+    {
+        char response[wire::response_size];
+        wire::status_type status(wire::status_ok);
+        std::int64_t value(0);
+        typed_value::value_class given(typed_value::value_class::integer(r.value)), found;
+        switch(r.opcode)
+        {
+            case db_command::setvar:
+            {
+                symbols::id_type id(global::vStore.intern(r.key, r.key_size));
+                if(id == symbols::no_id) status = wire::status_error;
+                else this->transactions.set_var(id, given);
+            }
+            break;
+            
+            case db_command::getvar:
+            {
+                auto var(this->transactions.find_var(global::vStore.find(r.key, r.key_size)));
+                status = ((var != nullptr) ? wire_status(var->value, value) : wire::status_null);
+                if(var != nullptr) found = var->value;
+            }
+            break;
+            
+            case db_command::unsetvar:
+            {
+                /* Inside a transaction, an UNSET of a new key is still a write. */
+                this->transactions.remove_var((this->transactions.depth() > 0) ? 
+                        global::vStore.intern(r.key, r.key_size) : global::vStore.find(r.key, r.key_size));
+            }
+            break;
+            
+            case db_command::numequaltovar:
+            {
+                status = wire::status_value;
+                value = this->transactions.find_values(given);
+            }
+            break;
+            
+            case db_command::numgreaterthanvar:
+            {
+                status = wire::status_value;
+                value = this->transactions.find_values_greater(given);
+            }
+            break;
+            
+            case db_command::numlessthanvar:
+            {
+                status = wire::status_value;
+                value = this->transactions.find_values_less(given);
+            }
+            break;
+            
+            case db_command::begin:
+            {
+                this->transactions.begin();
+            }
+            break;
+            
+            case db_command::commit:
+            {
+                if(!this->transactions.commit()) status = wire::status_conflict;
+            }
+            break;
+            
+            case db_command::rollback:
+            {
+                if(!this->transactions.rollback()) status = wire::status_error;
+            }
+            break;
+            
+            default:
+            {
+                /* Everything else needs more than a key and a value, or
+                 answers with more than a number; it is only spoken in text. */
+                status = wire::status_error;
+            }
+            break;
+        }
+        wire::encode_response(response, r.id, status, value);
+        this->out.put(response, wire::response_size);
+        if(status == wire::status_text) this->out.put(found.text_data(), found.text_size());
+    }
+    
+    bool session_class::request_ready() const
+    {
+        wire::request_data request;
+        const char* data(nullptr);
+        std::size_t size(this->reader.buffered(data));
+        return (wire::decode_request(data, size, request) != 0);
+    }
+    
+    /** Reads lines until one holds a command, and returns it.  Returns an
+     END command once the input runs out, and a null_com if it would block. */
+    db_command::database_command_data session_class::gcommand_input()
+    {
+        command_reader::reader_class& in(this->reader);
+        std::vector<command_reader::token_data>& tokens(this->tokens);
+        write_log::log_class& log(*this->shared.log);
+        output_sink::sink_class& out(this->out);
+        bool finished(false);
+        db_command::database_command_data command;
+        do
+        {
+            /* Once the input runs dry nothing else is coming to share a sync
+             with, so the commits made so far are made durable now. */
+            if(in.drained()) log.commit_point();
+            out.command_done(in.drained());
+            if(!in.next_line(tokens))
+            {
+                command.command = (in.waiting() ? db_command::null_com : db_command::end);
+                finished = true;
+            }
+            else if(tokens.empty())
+            {
+            }
+            else if(tokens[0] == "clear")
+            {
+                clear_screen(out);
+            }
+            else if(tokens[0] == "dumpstack")
+            {
+                shard_store::value_store::lock_class hold(global::vStore);
+                clear_screen(out);
+                out.put("Stack Begin: \n\n");
+                global::vStore.for_each_var([&out](const symbols::name_data& name, 
+                        const typed_value::value_class& value)
+                {
+                    out.put(name.data, name.size);
+                    out.put(" = ");
+                    db_command::put_value(out, value);
+                    out.put('\n');
+                });
+            }
+            else if((tokens[0] == "clearstack") && (this->transactions.depth() > 0))
+            {
+                /* The open blocks' count changes are relative to what would be cleared. */
+                out.put("can't clearstack while a transaction is open\n");
+            }
+            else if(tokens[0] == "clearstack")
+            {
+                shard_store::value_store::lock_class hold(global::vStore, shard_store::value_store::writing);
+                log.begin_record();
+                log.log_clear();
+                log.end_record();
+                global::vStore.erase_all();
+                global::vStore.all_changed();
+                this->compact_keys(true);
+            }
+            else
+            {
+                const db_command::command_info_data* info(db_command::find_command(tokens[0].data, tokens[0].size,
+                        this->shared.ignore_case));
+                switch(info != nullptr)
+                {
+                    case true:
+                    {
+                        finished = db_command::compile_command(*info, (tokens.data() + 1), (tokens.size() - 1),
+                                command, global::vStore, (this->transactions.depth() > 0));
+                        if(!finished) out.put("invalid arguments\n");
+                    }
+                    break;
+
+                    case false:
+                    {
+                        out.put("Not a command!\n");
+                    }
+                    break;
+
+                    default:
+                    {
+                    }
+                    break;
+                }
+            }
+        }
+        while(!finished);
+        return command;
+    }
+    
+    
+}
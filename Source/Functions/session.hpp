@@ -0,0 +1,114 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2014 Jonathan Craig Whitlock
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+ */
+
+
+
+#ifndef SESSION_HPP_INCLUDED
+#define SESSION_HPP_INCLUDED
+#include <string>
+#include <vector>
+#include <cstddef>
+
+#include "transaction_block.hpp"
+#include "database_command.hpp"
+#include "command_reader.hpp"
+#include "output_sink.hpp"
+#include "write_log.hpp"
+#include "checkpoint.hpp"
+#include "wire_protocol.hpp"
+
+namespace session
+{
+    /** What every session shares. */
+    struct shared_data
+    {
+        bool ignore_case = false;
+        write_log::log_class* log = nullptr;
+        
+        /* nullptr if there are no checkpoints (or the session is not the
+         one to poll them). */
+        checkpoint::checkpoint_class* checkpoints = nullptr;
+    };
+    
+    /**
+     * One client of the database: the commands it sends are read from one
+     * descriptor and answered on another, and it has transaction blocks of
+     * its own over the shared store.  The descriptors may be non-blocking.
+     * The first byte it sends decides whether it speaks lines of text or
+     * the binary protocol (see wire_protocol.hpp).
+     */
+    class session_class
+    {
+    public:
+        explicit session_class(const int& in, const int& out, const output_sink::flush_policy& policy, 
+                const shared_data& s, const std::size_t& block = command_reader::reader_class::default_block);
+        
+        /** Runs commands until the input ends or an END is read (returns
+         false), or until the input would block or [limit] commands have run
+         (returns true).  0 means no limit. */
+        bool run(const unsigned int& limit = 0);
+        
+        /** Returns true if there are whole commands waiting to be run. */
+        bool pending() const
+        {
+            return (this->binary ? this->request_ready() : !this->reader.drained());
+        }
+        
+        output_sink::sink_class& output()
+        {
+            return this->out;
+        }
+        
+    private:
+        command_reader::reader_class reader;
+        output_sink::sink_class out;
+        taction_block::transaction_stack_class<typed_value::value_class> transactions;
+        
+        /* Storage for the words of a line, kept so it is not re-allocated. */
+        std::vector<command_reader::token_data> tokens;
+        shared_data shared;
+        
+        /* Whether the first byte has been read yet, and what it said. */
+        bool started;
+        bool binary;
+        
+        bool execute_command(const db_command::database_command_data&);
+        db_command::database_command_data gcommand_input();
+        
+        /** Polls the checkpoints and the unused keys. */
+        void between_commands();
+        
+        /** Gives back the ids of keys no variable has: at once, or if poll_keys
+         says it's time. */
+        void compact_keys(const bool&);
+        
+        bool run_binary(const unsigned int&);
+        void execute_request(const wire::request_data&);
+        bool request_ready() const;
+        
+    };
+    
+}
+
+#endif
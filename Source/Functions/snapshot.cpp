@@ -0,0 +1,479 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2014 Jonathan Craig Whitlock
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+ */
+
+
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <cstdint>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "snapshot.hpp"
+#include "shard_store.hpp"
+#include "variable_stack.hpp"
+#include "symbol_table.hpp"
+#include "hash_index.hpp"
+#include "output_sink.hpp"
+#include "crc32c.hpp"
+#include "typed_value.hpp"
+
+namespace
+{
+    const char magic[8] = {'S', 'D', 'B', 'S', 'N', 'A', 'P', 0};
+    
+    typedef typed_value::value_class value_type;
+    
+    /* Every value takes this many bytes in a snapshot, whatever its kind. */
+    const std::size_t value_size = value_type::max_encoded;
+    
+    /** Writes a section, adding it to the checksum. */
+    inline void put_section(output_sink::sink_class& out, std::uint32_t& crc, const void* data, const std::size_t& size)
+    {
+        if(size == 0) return;
+        out.put((const char*)data, size);
+        crc = checksum::crc32c(data, size, crc);
+    }
+    
+    /** Writes a section of values, each encoded in value_size bytes. */
+    void put_values(output_sink::sink_class& out, std::uint32_t& crc, const std::vector<value_type>& values)
+    {
+        char buffer[(256 * value_size)];
+        std::size_t used(0);
+        
+        for(std::size_t x = 0; x < values.size(); x++)
+        {
+            std::memset((buffer + used), 0, value_size);
+            values[x].encode(buffer + used);
+            used += value_size;
+            if((used == sizeof(buffer)) || ((x + 1) == values.size()))
+            {
+                put_section(out, crc, buffer, used);
+                used = 0;
+            }
+        }
+    }
+    
+    /** Reads [count] values that put_values wrote.  Returns false if any
+     of them isn't a value. */
+    bool get_values(const char* data, const std::size_t& count, std::vector<value_type>& values)
+    {
+        values.resize(count);
+        for(std::size_t x = 0; x < count; x++)
+        {
+            if(value_type::decode((data + (x * value_size)), value_size, values[x]) == 0) return false;
+        }
+        return true;
+    }
+    
+    /** Closes a file and unmaps it when it goes out of scope. */
+    struct mapping_data
+    {
+        int fd = -1;
+        const char* data = nullptr;
+        std::size_t size = 0;
+        
+        ~mapping_data()
+        {
+            if(this->data != nullptr) munmap((void*)this->data, this->size);
+            if(this->fd >= 0) close(this->fd);
+        }
+    };
+    
+    void start_header(snapshot::header_data& header, const unsigned long long& lsn)
+    {
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, magic, sizeof(magic));
+        header.version = snapshot::version;
+        header.header_size = sizeof(snapshot::header_data);
+        header.lsn = lsn;
+    }
+    
+    /** Writes a snapshot whose sections are already gathered; [name]
+     returns the [x]th key.  The file is written under a temporary name
+     and renamed into place once it's complete. */
+    template<class name_type>
+    bool write_file(const std::string& path, snapshot::header_data& header, 
+            const std::vector<unsigned long long>& counts, const std::vector<value_type>& count_values,
+            const std::vector<std::uint32_t>& sizes, const std::vector<value_type>& values, 
+            const name_type& name, std::string& error)
+    {
+        std::string temp(path + ".tmp");
+        
+        header.key_count = sizes.size();
+        header.value_count = counts.size();
+        for(std::size_t x = 0; x < sizes.size(); x++) header.name_bytes += sizes[x];
+        header.body_size = ((header.value_count * (sizeof(unsigned long long) + value_size)) + 
+                (header.key_count * (sizeof(std::uint32_t) + value_size)) + header.name_bytes);
+        
+        /* The body's checksum is only known once it's written, so the header
+         goes in last, over the space left for it. */
+        int fd(open(temp.c_str(), (O_WRONLY | O_CREAT | O_TRUNC), 0644));
+        if(fd < 0)
+        {
+            error = ("can't create " + temp + ": " + std::strerror(errno));
+            return false;
+        }
+        
+        bool success(false);
+        {
+            output_sink::sink_class out(fd, output_sink::bulk, (1 << 20));
+            std::uint32_t crc(0);
+            
+            out.put((const char*)&header, sizeof(header));
+            put_section(out, crc, counts.data(), (counts.size() * sizeof(unsigned long long)));
+            put_section(out, crc, sizes.data(), (sizes.size() * sizeof(std::uint32_t)));
+            put_values(out, crc, values);
+            put_values(out, crc, count_values);
+            for(unsigned int x = 0; x < sizes.size(); x++)
+            {
+                const symbols::name_data& key(name(x));
+                put_section(out, crc, key.data, key.size);
+            }
+            out.flush();
+            
+            header.body_crc = crc;
+            header.header_crc = checksum::crc32c(&header, (sizeof(header) - sizeof(header.header_crc)));
+            success = (out.good() && (pwrite(fd, &header, sizeof(header), 0) == (ssize_t)sizeof(header)) && 
+                    (fsync(fd) == 0));
+        }
+        if(!success) error = ("can't write " + temp + ": " + std::strerror(errno));
+        if((close(fd) != 0) && success)
+        {
+            error = ("can't write " + temp + ": " + std::strerror(errno));
+            success = false;
+        }
+        if(success && (rename(temp.c_str(), path.c_str()) != 0))
+        {
+            error = ("can't rename " + temp + " to " + path + ": " + std::strerror(errno));
+            success = false;
+        }
+        if(!success) unlink(temp.c_str());
+        return success;
+    }
+    
+    /** Turns (value, count) pairs from several shards, each shard's in
+     ascending order, into one list of distinct values with their counts. */
+    void merge_counts(std::vector<std::pair<value_type, unsigned long long> >& pairs, 
+            std::vector<value_type>& count_values, std::vector<unsigned long long>& counts)
+    {
+        std::sort(pairs.begin(), pairs.end());
+        for(std::size_t x = 0; x < pairs.size(); x++)
+        {
+            if(count_values.empty() || (count_values.back() != pairs[x].first))
+            {
+                count_values.push_back(pairs[x].first);
+                counts.push_back(0);
+            }
+            counts.back() += pairs[x].second;
+        }
+    }
+    
+    /** Returns true if every key got an id: a shard that has run out of
+     room for keys gives new ones none. */
+    bool all_interned(const std::vector<symbols::id_type>& ids)
+    {
+        return (std::find(ids.begin(), ids.end(), symbols::no_id) == ids.end());
+    }
+    
+    /** Loads a snapshot's keys into a store of several shards.  Each key
+     goes to the shard its hash picks, and each shard is bulk loaded with
+     value counts of its own; together they must add up to the snapshot's.
+     Returns false (leaving the store empty) if they don't, or if a shard
+     has no room for its keys (which sets [full]). */
+    bool load_shards(shard_store::value_store& s, const char* names, const std::uint32_t* sizes, 
+            const value_type* values, const std::size_t& key_size, const value_type* count_values, 
+            const unsigned long long* counts, const std::size_t& count_size, bool& full)
+    {
+        std::vector<std::vector<std::size_t> > members(s.shard_count());
+        std::vector<const char*> starts(key_size);
+        std::vector<std::uint64_t> hashes(key_size);
+        std::vector<std::pair<value_type, unsigned long long> > shard_counts;
+        
+        for(std::size_t x = 0; x < key_size; x++)
+        {
+            starts[x] = names;
+            hashes[x] = hash_index::hash_bytes(names, sizes[x]);
+            members[s.shard_for(hashes[x])].push_back(x);
+            names += sizes[x];
+        }
+        for(std::size_t x = 0; x < members.size(); x++)
+        {
+            symbols::symbol_table_class& keys(s.shard(x).keys);
+            std::vector<symbols::id_type> ids(members[x].size());
+            std::vector<value_type> shard_values(members[x].size());
+            std::vector<value_type> shard_count_values;
+            std::vector<unsigned long long> shard_value_counts;
+            
+            keys.reserve(keys.size() + members[x].size());
+            for(std::size_t y = 0; y < members[x].size(); y++)
+            {
+                std::size_t key(members[x][y]);
+                ids[y] = keys.intern(starts[key], sizes[key], hashes[key]);
+                shard_values[y] = values[key];
+            }
+            if(!all_interned(ids))
+            {
+                full = true;
+                s.erase_all();
+                return false;
+            }
+            std::vector<value_type> sorted(shard_values);
+            std::sort(sorted.begin(), sorted.end());
+            for(std::size_t y = 0; y < sorted.size(); y++)
+            {
+                if((y == 0) || (sorted[y] != sorted[(y - 1)]))
+                {
+                    shard_count_values.push_back(sorted[y]);
+                    shard_value_counts.push_back(0);
+                    shard_counts.push_back(std::make_pair(sorted[y], 0ULL));
+                }
+                shard_value_counts.back()++;
+                shard_counts.back().second++;
+            }
+            if(!s.shard(x).vars.bulk_load(ids.data(), shard_values.data(), ids.size(), shard_count_values.data(), 
+                    shard_value_counts.data(), shard_count_values.size()))
+            {
+                s.erase_all();
+                return false;
+            }
+        }
+        
+        std::vector<value_type> merged_values;
+        std::vector<unsigned long long> merged_counts;
+        merge_counts(shard_counts, merged_values, merged_counts);
+        if((merged_values.size() != count_size) || 
+                !std::equal(merged_values.begin(), merged_values.end(), count_values) || 
+                !std::equal(merged_counts.begin(), merged_counts.end(), counts))
+        {
+            s.erase_all();
+            return false;
+        }
+        return true;
+    }
+}
+
+namespace snapshot
+{
+    bool save(const std::string& path, const shard_store::value_store& s, const unsigned long long& lsn, 
+            std::string& error)
+    {
+        header_data header;
+        std::vector<unsigned long long> counts;
+        std::vector<value_type> count_values;
+        std::vector<std::pair<value_type, unsigned long long> > shard_counts;
+        std::vector<symbols::name_data> names;
+        std::vector<std::uint32_t> sizes;
+        std::vector<value_type> values;
+        
+        start_header(header, lsn);
+        for(std::size_t x = 0; x < s.shard_count(); x++)
+        {
+            const symbols::symbol_table_class& keys(s.shard(x).keys);
+            const var_stack::stack_class<value_type>& vars(s.shard(x).vars);
+            vars.for_each_var([&keys, &names, &sizes, &values](const symbols::id_type& id, const value_type& value)
+            {
+                names.push_back(keys.name(id));
+                sizes.push_back(names.back().size);
+                values.push_back(value);
+            });
+            vars.for_each_count([&shard_counts](const value_type& value, const unsigned long long& count)
+            {
+                shard_counts.push_back(std::make_pair(value, count));
+            });
+        }
+        merge_counts(shard_counts, count_values, counts);
+        return write_file(path, header, counts, count_values, sizes, values, [&names](const unsigned int& x) -> 
+                const symbols::name_data&
+        {
+            return names[x];
+        }, error);
+    }
+    
+    bool save(const std::string& path, const std::vector<part_data>& parts, const unsigned long long& lsn, 
+            std::string& error)
+    {
+        header_data header;
+        std::vector<unsigned long long> counts;
+        std::vector<value_type> count_values;
+        std::vector<symbols::name_data> names;
+        std::vector<std::uint32_t> sizes;
+        std::vector<value_type> values;
+        
+        start_header(header, lsn);
+        for(std::size_t x = 0; x < parts.size(); x++)
+        {
+            const part_data& part(parts[x]);
+            part.vars.for_each([&names, &values, &part](const std::uint32_t& id, const value_type& value)
+            {
+                names.push_back(part.names[id]);
+                values.push_back(value);
+            });
+        }
+        sizes.resize(names.size());
+        for(std::size_t x = 0; x < names.size(); x++) sizes[x] = names[x].size;
+        
+        /* There is no ordered index to read the value counts from, so they
+         come from sorting a copy of the values. */
+        std::vector<value_type> sorted(values);
+        std::sort(sorted.begin(), sorted.end());
+        for(std::size_t x = 0; x < sorted.size(); x++)
+        {
+            if((x == 0) || (sorted[x] != sorted[(x - 1)]))
+            {
+                count_values.push_back(sorted[x]);
+                counts.push_back(0);
+            }
+            counts.back()++;
+        }
+        return write_file(path, header, counts, count_values, sizes, values, [&names](const unsigned int& x) -> 
+                const symbols::name_data&
+        {
+            return names[x];
+        }, error);
+    }
+    
+    bool load(const std::string& path, shard_store::value_store& s, unsigned long long& lsn, 
+            std::string& error)
+    {
+        mapping_data file;
+        header_data header;
+        struct stat info;
+        
+        file.fd = open(path.c_str(), O_RDONLY);
+        if((file.fd < 0) || (fstat(file.fd, &info) != 0))
+        {
+            error = ("can't open " + path + ": " + std::strerror(errno));
+            return false;
+        }
+        file.size = info.st_size;
+        if(file.size < sizeof(header_data))
+        {
+            error = (path + " is not a snapshot");
+            return false;
+        }
+        void* data(mmap(nullptr, file.size, PROT_READ, MAP_PRIVATE, file.fd, 0));
+        if(data == MAP_FAILED)
+        {
+            error = ("can't map " + path + ": " + std::strerror(errno));
+            return false;
+        }
+        file.data = (const char*)data;
+        madvise(data, file.size, MADV_SEQUENTIAL);
+        
+        std::memcpy(&header, file.data, sizeof(header));
+        if(std::memcmp(header.magic, magic, sizeof(magic)) != 0)
+        {
+            error = (path + " is not a snapshot");
+            return false;
+        }
+        if((header.version != version) || (header.header_size != sizeof(header_data)))
+        {
+            error = (path + " is a snapshot of version " + std::to_string(header.version) + 
+                    ", which this version can't read");
+            return false;
+        }
+        if(header.header_crc != checksum::crc32c(&header, (sizeof(header) - sizeof(header.header_crc))))
+        {
+            error = (path + " has a damaged header");
+            return false;
+        }
+        
+        /* The sizes come from a header that checks out, so the arithmetic
+         here only has to guard against a truncated file. */
+        const std::size_t count_size(header.value_count), key_size(header.key_count);
+        if((header.body_size != (file.size - sizeof(header_data))) || (header.body_size != 
+                ((count_size * (sizeof(unsigned long long) + value_size)) + 
+                (key_size * (sizeof(std::uint32_t) + value_size)) + header.name_bytes)))
+        {
+            error = (path + " is truncated");
+            return false;
+        }
+        const char* body(file.data + sizeof(header_data));
+        if(checksum::crc32c(body, header.body_size) != header.body_crc)
+        {
+            error = (path + " is damaged (checksum mismatch)");
+            return false;
+        }
+        
+        const unsigned long long* counts((const unsigned long long*)body);
+        const std::uint32_t* sizes((const std::uint32_t*)(counts + count_size));
+        const char* encoded((const char*)(sizes + key_size));
+        const char* names(encoded + ((key_size + count_size) * value_size));
+        
+        unsigned long long name_bytes(0);
+        for(std::size_t x = 0; x < key_size; x++) name_bytes += sizes[x];
+        if(name_bytes != header.name_bytes)
+        {
+            error = (path + " is damaged (key sizes)");
+            return false;
+        }
+        
+        std::vector<value_type> values, count_values;
+        if(!get_values(encoded, key_size, values) || 
+                !get_values((encoded + (key_size * value_size)), count_size, count_values))
+        {
+            error = (path + " is damaged (values)");
+            return false;
+        }
+        
+        /* With one shard, a key's id in it is its id in the store, and the
+         snapshot's counts are the shard's. */
+        bool loaded(false), full(false);
+        if(s.shard_count() == 1)
+        {
+            std::vector<symbols::id_type> ids(key_size);
+            symbols::symbol_table_class& keys(s.shard(0).keys);
+            keys.reserve(keys.size() + key_size);
+            keys.intern_all(names, sizes, key_size, ids.data());
+            full = !all_interned(ids);
+            if(full) s.erase_all();
+            else loaded = s.shard(0).vars.bulk_load(ids.data(), values.data(), key_size, count_values.data(), counts, 
+                    count_size);
+        }
+        else 
+        {
+            loaded = load_shards(s, names, sizes, values.data(), key_size, count_values.data(), counts, count_size, 
+                    full);
+        }
+        if(full)
+        {
+            error = (path + " has more key bytes than a shard has room for; try more --shards");
+            return false;
+        }
+        if(!loaded)
+        {
+            error = (path + " is damaged (value counts)");
+            return false;
+        }
+        lsn = header.lsn;
+        return true;
+    }
+}
@@ -0,0 +1,103 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2014 Jonathan Craig Whitlock
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+ */
+
+
+
+#ifndef SNAPSHOT_HPP_INCLUDED
+#define SNAPSHOT_HPP_INCLUDED
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "shard_store.hpp"
+#include "symbol_table.hpp"
+#include "persistent_map.hpp"
+#include "typed_value.hpp"
+
+/**
+ * A snapshot is a binary image of the store, made to be loaded fast:
+ * 
+ * header_data, then
+ *   unsigned long long counts[value_count]
+ *   uint32 name sizes[key_count]
+ *   values[key_count]
+ *   distinct values[value_count], ascending
+ *   the names, back to back
+ * 
+ * Each value takes 16 bytes: what typed_value's encode() writes, padded
+ * with zeros.  Every section is in the machine's own byte order.  The header has a
+ * checksum of its own and one of everything after it (both CRC-32C), and
+ * the version changes whenever the layout does.  [lsn] is the LSN of the
+ * first log record the snapshot does not include (0 if it was not taken
+ * with a log).  Keys are saved by name, so a snapshot can be loaded into
+ * a store with any number of shards.
+ */
+namespace snapshot
+{
+    const std::uint32_t version = 3;
+    
+    struct header_data
+    {
+        char magic[8];
+        std::uint32_t version;
+        std::uint32_t header_size;
+        std::uint64_t key_count;
+        std::uint64_t value_count;
+        std::uint64_t name_bytes;
+        std::uint64_t lsn;
+        std::uint64_t body_size;
+        std::uint32_t body_crc;
+        std::uint32_t header_crc;
+    };
+    
+    /** One shard's persistent map, as a snapshot, and its key names. */
+    struct part_data
+    {
+        persistent_map::snapshot_class<typed_value::value_class> vars;
+        symbols::symbol_table_class::names_view names;
+    };
+    
+    /** Writes the variables in [s] to the file [path]; the caller holds
+     every shard's lock.  The file is written under a temporary name and
+     renamed when it's complete, so an existing snapshot is never left half
+     overwritten.  On failure, [error] says why. */
+    bool save(const std::string& path, const shard_store::value_store& s, const unsigned long long& lsn, 
+            std::string& error);
+    
+    /** Writes a snapshot taken from the shards' persistent maps.  None of
+     the parts is changed by the store, so this can run on another thread
+     while commands go on. */
+    bool save(const std::string& path, const std::vector<part_data>& parts, const unsigned long long& lsn, 
+            std::string& error);
+    
+    /** Replaces the variables in [s] with the ones in the snapshot [path];
+     the caller holds every shard's lock.  Nothing is changed if the file
+     isn't a valid snapshot, unless the only thing wrong with it is its value
+     counts, which are checked last; then the store is left empty.  [lsn] is
+     set to the snapshot's LSN. */
+    bool load(const std::string& path, shard_store::value_store& s, unsigned long long& lsn, 
+            std::string& error);
+}
+
+#endif
@@ -0,0 +1,516 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2014 Jonathan Craig Whitlock
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+ */
+
+
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "write_log.hpp"
+#include "shard_store.hpp"
+#include "crc32c.hpp"
+
+namespace
+{
+    const char magic[8] = {'S', 'D', 'B', 'W', 'A', 'L', 0, 0};
+    
+    /* A record bigger than this can only be garbage. */
+    const std::uint32_t max_record = (1U << 30);
+    
+    const std::size_t frame_size = (2 * sizeof(std::uint32_t));
+    
+    /** Writes all of [size] bytes, retrying after interruptions. */
+    bool write_all(const int& fd, const char* data, std::size_t size)
+    {
+        while(size > 0)
+        {
+            ssize_t count(::write(fd, data, size));
+            if(count < 0)
+            {
+                if(errno == EINTR) continue;
+                return false;
+            }
+            data += count;
+            size -= count;
+        }
+        return true;
+    }
+    
+    std::uint32_t header_checksum(const write_log::header_data& h)
+    {
+        write_log::header_data temp(h);
+        temp.header_crc = 0;
+        return checksum::crc32c(&temp, sizeof(temp));
+    }
+    
+    write_log::header_data make_header(const unsigned long long& base_lsn)
+    {
+        write_log::header_data header;
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, magic, sizeof(magic));
+        header.version = write_log::version;
+        header.base_lsn = base_lsn;
+        header.header_crc = header_checksum(header);
+        return header;
+    }
+    
+    /** Reads operations out of a record's payload. */
+    struct payload_reader
+    {
+        const char* pos;
+        const char* end;
+        
+        template<class type>
+        bool get(type& t)
+        {
+            if(std::size_t(this->end - this->pos) < sizeof(type)) return false;
+            std::memcpy(&t, this->pos, sizeof(type));
+            this->pos += sizeof(type);
+            return true;
+        }
+    };
+    
+    /** Applies one record to the store, unless its LSN is before
+     [first_lsn].  It has already passed its checksum, so it is checked only
+     for sanity, before anything is applied.  Sets [full] if it could not be
+     applied because a shard had no room for one of its keys. */
+    bool apply_record(const char* data, const std::uint32_t& size, const unsigned long long& first_lsn,
+            shard_store::value_store& s, unsigned long long& lsn, bool& full)
+    {
+        std::uint32_t count(0);
+        payload_reader in{data, (data + size)};
+        
+        if(!in.get(lsn) || !in.get(count)) return false;
+        for(int pass = 0; pass < ((lsn < first_lsn) ? 1 : 2); pass++)
+        {
+            payload_reader ops(in);
+            for(std::uint32_t x = 0; x < count; x++)
+            {
+                unsigned char op(0);
+                std::uint32_t key_size(0);
+                typed_value::value_class value;
+                
+                if(!ops.get(op)) return false;
+                if(op == write_log::log_class::clear_op)
+                {
+                    if(pass == 1) s.erase_all();
+                    continue;
+                }
+                if(!ops.get(key_size) || (std::size_t(ops.end - ops.pos) < key_size)) return false;
+                const char* key(ops.pos);
+                ops.pos += key_size;
+                if(op == write_log::log_class::set_op)
+                {
+                    std::size_t used(typed_value::value_class::decode(ops.pos, std::size_t(ops.end - ops.pos), value));
+                    if(used == 0) return false;
+                    ops.pos += used;
+                }
+                if((op != write_log::log_class::set_op) && (op != write_log::log_class::unset_op)) return false;
+                
+                /* The first pass only checks. */
+                if(pass == 0) continue;
+                if(op == write_log::log_class::set_op)
+                {
+                    /* Keys set and unset earlier in the log may have used up a
+                     shard's room for keys; nothing holds an id while it replays. */
+                    symbols::id_type id(s.intern(key, key_size));
+                    if(id == symbols::no_id)
+                    {
+                        s.compact_keys();
+                        id = s.intern(key, key_size);
+                    }
+                    if(id == symbols::no_id)
+                    {
+                        full = true;
+                        return false;
+                    }
+                    s.set(id, value);
+                }
+                else s.remove(s.find(key, key_size));
+            }
+            if((pass == 0) && (ops.pos != ops.end)) return false;
+        }
+        return true;
+    }
+}
+
+namespace write_log
+{
+    const unsigned char log_class::set_op;
+    const unsigned char log_class::unset_op;
+    const unsigned char log_class::clear_op;
+    
+    bool log_class::open(const std::string& path, const unsigned long long& next_lsn, const durability_level& l,
+            const unsigned int& interval_ms, std::string& error)
+    {
+        struct stat info;
+        
+        this->close();
+        this->path = path;
+        this->fd = ::open(path.c_str(), (O_WRONLY | O_CREAT | O_APPEND), 0644);
+        if((this->fd < 0) || (fstat(this->fd, &info) != 0))
+        {
+            error = ("can't open log " + path + ": " + std::strerror(errno));
+            this->close();
+            return false;
+        }
+        this->level = l;
+        this->interval = interval_ms;
+        this->lsn = next_lsn;
+        this->bytes = info.st_size;
+        if(info.st_size == 0)
+        {
+            header_data header(make_header(next_lsn));
+            if(!write_all(this->fd, (const char*)&header, sizeof(header)) || (fsync(this->fd) != 0))
+            {
+                error = ("can't write log " + path + ": " + std::strerror(errno));
+                this->close();
+                return false;
+            }
+            this->bytes = sizeof(header);
+        }
+        this->logged = this->bytes;
+        this->written = this->synced = 0;
+        if(this->level == sync_interval)
+        {
+            this->stopping = false;
+            this->syncer = std::thread(&log_class::sync_loop, this);
+        }
+        return true;
+    }
+    
+    void log_class::close()
+    {
+        if(this->syncer.joinable())
+        {
+            {
+                std::lock_guard<std::mutex> lock(this->sync_lock);
+                this->stopping = true;
+            }
+            this->stop_syncer.notify_all();
+            this->syncer.join();
+        }
+        if(this->fd >= 0)
+        {
+            this->write_pending();
+            if(this->level != sync_os) this->sync_to(this->written);
+            ::close(this->fd);
+        }
+        this->fd = -1;
+    }
+    
+    void log_class::begin_record()
+    {
+        this->record_lock.lock();
+        
+        std::uint64_t current(this->lsn);
+        this->record_start = this->pending.size();
+        this->op_count = 0;
+        this->pending.resize((this->record_start + frame_size), 0);
+        this->append(&current, sizeof(current));
+        this->append(&this->op_count, sizeof(this->op_count));
+    }
+    
+    void log_class::log_set(const char* name, const std::size_t& name_size, const typed_value::value_class& value)
+    {
+        std::uint32_t size(name_size);
+        char encoded[typed_value::value_class::max_encoded];
+        
+        this->pending.push_back((char)set_op);
+        this->append(&size, sizeof(size));
+        this->append(name, name_size);
+        this->append(encoded, value.encode(encoded));
+        this->op_count++;
+    }
+    
+    void log_class::log_unset(const char* name, const std::size_t& name_size)
+    {
+        std::uint32_t size(name_size);
+        
+        this->pending.push_back((char)unset_op);
+        this->append(&size, sizeof(size));
+        this->append(name, name_size);
+        this->op_count++;
+    }
+    
+    void log_class::log_clear()
+    {
+        this->pending.push_back((char)clear_op);
+        this->op_count++;
+    }
+    
+    void log_class::end_record()
+    {
+        if((this->op_count == 0) || (this->fd < 0))
+        {
+            this->pending.resize(this->record_start);
+            this->record_lock.unlock();
+            return;
+        }
+        
+        char* frame(this->pending.data() + this->record_start);
+        std::uint32_t size(this->pending.size() - this->record_start - frame_size);
+        std::memcpy((frame + frame_size + sizeof(std::uint64_t)), &this->op_count, sizeof(this->op_count));
+        std::uint32_t crc(checksum::crc32c((frame + frame_size), size));
+        std::memcpy(frame, &size, sizeof(size));
+        std::memcpy((frame + sizeof(size)), &crc, sizeof(crc));
+        this->lsn++;
+        this->records++;
+        
+        /* Don't let a long run of commits with nothing to acknowledge them
+         pile up in memory; the OS can have them (they still get synced at
+         the next commit point). */
+        if(this->pending.size() >= (1 << 20)) this->write_pending();
+        this->logged = (this->bytes + this->pending.size());
+        this->record_lock.unlock();
+    }
+    
+    bool log_class::compact(const unsigned long long& base_lsn, const unsigned long long& offset, std::string& error)
+    {
+        std::string temp(this->path + ".tmp");
+        header_data header(make_header(base_lsn));
+        std::vector<char> buffer(1 << 20);
+        bool success(true);
+        
+        std::lock_guard<std::mutex> hold(this->record_lock);
+        if(this->fd < 0) return false;
+        this->write_pending();
+        
+        /* The new log is opened for appending from the start, so once it is
+         renamed into place it's already the descriptor to use. */
+        int in(::open(this->path.c_str(), O_RDONLY));
+        int out(::open(temp.c_str(), (O_WRONLY | O_CREAT | O_TRUNC | O_APPEND), 0644));
+        if((in < 0) || (out < 0)) success = false;
+        else success = write_all(out, (const char*)&header, sizeof(header));
+        for(unsigned long long x = offset; success && (x < this->bytes);)
+        {
+            ssize_t count(pread(in, buffer.data(), std::min<unsigned long long>(buffer.size(), (this->bytes - x)), x));
+            if((count < 0) && (errno == EINTR)) continue;
+            success = ((count > 0) && write_all(out, buffer.data(), count));
+            x += ((count > 0) ? count : 0);
+        }
+        success = (success && (fsync(out) == 0) && (rename(temp.c_str(), this->path.c_str()) == 0));
+        if(!success) error = ("can't compact log " + this->path + ": " + std::strerror(errno));
+        if(in >= 0) ::close(in);
+        if(!success)
+        {
+            /* The old log is still whole, and still the one in use. */
+            if(out >= 0) ::close(out);
+            unlink(temp.c_str());
+            return false;
+        }
+        
+        /* The thread that syncs must not be using the old descriptor. */
+        {
+            std::lock_guard<std::mutex> lock(this->sync_lock);
+            ::close(this->fd);
+            this->fd = out;
+            this->bytes = (sizeof(header) + (this->bytes - offset));
+            this->logged = this->bytes;
+            this->synced = this->written;
+        }
+        return true;
+    }
+    
+    void log_class::commit_point()
+    {
+        unsigned long long target(0);
+        {
+            std::lock_guard<std::mutex> hold(this->record_lock);
+            if(this->fd < 0) return;
+            this->write_pending();
+            target = this->written;
+        }
+        if(this->level == sync_always) this->sync_to(target);
+    }
+    
+    void log_class::append(const void* data, const std::size_t& size)
+    {
+        const char* p((const char*)data);
+        this->pending.insert(this->pending.end(), p, (p + size));
+    }
+    
+    void log_class::write_pending()
+    {
+        if(this->pending.empty() || (this->fd < 0)) return;
+        
+        /* If the log can't be written there is no safe way to go on: the
+         changes being acknowledged would not survive a crash. */
+        if(!write_all(this->fd, this->pending.data(), this->pending.size()))
+        {
+            std::string message("fatal: can't write the log: " + std::string(std::strerror(errno)) + "\n");
+            write_all(STDERR_FILENO, message.data(), message.size());
+            std::_Exit(1);
+        }
+        this->bytes += this->pending.size();
+        this->written += this->pending.size();
+        this->pending.clear();
+    }
+    
+    /** Makes the first [target] bytes ever written durable, unless a sync
+     since has already done it. */
+    void log_class::sync_to(const unsigned long long& target)
+    {
+        std::lock_guard<std::mutex> lock(this->sync_lock);
+        if(this->synced < target) this->sync();
+    }
+    
+    /** Syncs everything written so far.  The caller holds [sync_lock]. */
+    void log_class::sync()
+    {
+        unsigned long long end(this->written);
+        if(fdatasync(this->fd) != 0)
+        {
+            std::string message("fatal: can't sync the log: " + std::string(std::strerror(errno)) + "\n");
+            write_all(STDERR_FILENO, message.data(), message.size());
+            std::_Exit(1);
+        }
+        this->synced = end;
+        this->syncs++;
+    }
+    
+    void log_class::sync_loop()
+    {
+        std::unique_lock<std::mutex> lock(this->sync_lock);
+        while(!this->stopping)
+        {
+            this->stop_syncer.wait_for(lock, std::chrono::milliseconds(this->interval));
+            if(this->written > this->synced) this->sync();
+        }
+    }
+    
+    bool log_class::recover(const std::string& path, const unsigned long long& first_lsn, 
+            shard_store::value_store& s, recovery_data& result, std::string& error)
+    {
+        header_data header;
+        struct stat info;
+        
+        result = recovery_data();
+        result.next_lsn = std::max(result.next_lsn, first_lsn);
+        int fd(::open(path.c_str(), O_RDWR));
+        if(fd < 0)
+        {
+            if(errno == ENOENT) return true;
+            error = ("can't open log " + path + ": " + std::strerror(errno));
+            return false;
+        }
+        if(fstat(fd, &info) != 0)
+        {
+            error = ("can't read log " + path + ": " + std::strerror(errno));
+            ::close(fd);
+            return false;
+        }
+        if(info.st_size == 0)
+        {
+            ::close(fd);
+            return true;
+        }
+        
+        /* The log is mapped, so replaying it costs no system call per record. */
+        void* mapped(mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0));
+        if(mapped == MAP_FAILED)
+        {
+            error = ("can't map log " + path + ": " + std::strerror(errno));
+            ::close(fd);
+            return false;
+        }
+        madvise(mapped, info.st_size, MADV_SEQUENTIAL);
+        
+        const char* data((const char*)mapped);
+        const unsigned long long size(info.st_size);
+        unsigned long long offset(0), good(0);
+        bool success(false);
+        
+        if(size >= sizeof(header)) std::memcpy(&header, data, sizeof(header));
+        if((size < sizeof(header)) || 
+                (std::memcmp(header.magic, magic, sizeof(magic)) != 0) || 
+                (header.header_crc != header_checksum(header)))
+        {
+            error = (path + " is not a log");
+        }
+        else if(header.version != version)
+        {
+            error = (path + " is a log of version " + std::to_string(header.version) + 
+                    ", which this version can't read");
+        }
+        else if((first_lsn > 0) && (header.base_lsn > first_lsn))
+        {
+            error = (path + " starts at LSN " + std::to_string(header.base_lsn) + 
+                    "; the records from LSN " + std::to_string(first_lsn) + " on are missing");
+        }
+        else
+        {
+            result.next_lsn = std::max<unsigned long long>(header.base_lsn, result.next_lsn);
+            offset = good = sizeof(header);
+            success = true;
+            while((size - offset) >= frame_size)
+            {
+                std::uint32_t frame[2];
+                std::memcpy(frame, (data + offset), sizeof(frame));
+                if((frame[0] > max_record) || (frame[0] > (size - offset - frame_size))) break;
+                
+                const char* payload(data + offset + frame_size);
+                if(checksum::crc32c(payload, frame[0]) != frame[1]) break;
+                
+                unsigned long long record_lsn(0);
+                bool full(false);
+                if(!apply_record(payload, frame[0], first_lsn, s, record_lsn, full))
+                {
+                    /* That record is whole, so it must not be cut off with a torn tail. */
+                    if(full)
+                    {
+                        error = (path + ": no room for the keys of the record at LSN " + 
+                                std::to_string(record_lsn) + "; try more --shards");
+                        success = false;
+                    }
+                    break;
+                }
+                result.next_lsn = std::max((record_lsn + 1), result.next_lsn);
+                if(record_lsn >= first_lsn) result.records++;
+                offset += (frame_size + frame[0]);
+                good = offset;
+            }
+            
+            /* Whatever follows the last good record was being written when
+             the program stopped; it was never acknowledged, so it goes. */
+            result.torn_bytes = (size - good);
+            if(success && (result.torn_bytes > 0) && ((ftruncate(fd, good) != 0) || (fsync(fd) != 0)))
+            {
+                error = ("can't truncate log " + path + ": " + std::strerror(errno));
+                success = false;
+            }
+        }
+        munmap(mapped, info.st_size);
+        ::close(fd);
+        return success;
+    }
+}
@@ -0,0 +1,213 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2014 Jonathan Craig Whitlock
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+ */
+
+
+
+#ifndef WRITE_LOG_HPP_INCLUDED
+#define WRITE_LOG_HPP_INCLUDED
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+#include "shard_store.hpp"
+
+/**
+ * The write-ahead log.  Every change that is committed (a SET or UNSET
+ * outside of a transaction, or a whole transaction at COMMIT) is appended to
+ * it as one record, so that after a crash the stack can be rebuilt by
+ * replaying them.  It may be written by several threads: a record is
+ * begun and ended by one thread at a time, and commit points share syncs.
+ * The file is a header_data followed by records framed as:
+ * 
+ *   uint32 payload size, uint32 CRC-32C of the payload, payload
+ * 
+ * and each payload is: uint64 LSN, uint32 operation count, then for each
+ * operation a byte (set_op, unset_op or clear_op), then for set_op and
+ * unset_op a uint32 key size and the key, and for set_op the value as
+ * typed_value encodes it.  Keys are logged by name: ids are only stable
+ * while the program runs.
+ */
+namespace write_log
+{
+    const std::uint32_t version = 2;
+    
+    /** When a log write is made durable with fdatasync. */
+    enum durability_level
+    {
+        /* before any output that follows the commit is written, and whenever
+         the input runs dry; commits that arrive together share one sync. */
+        sync_always = 0,
+        
+        /* by a background thread, every [interval] milliseconds. */
+        sync_interval = 1,
+        
+        /* never; the OS writes it out when it wants to. */
+        sync_os = 2
+    };
+    
+    struct header_data
+    {
+        char magic[8];
+        std::uint32_t version;
+        std::uint32_t header_crc;
+        std::uint64_t base_lsn;
+    };
+    
+    /** What recovery found. */
+    struct recovery_data
+    {
+        unsigned long long records = 0;
+        unsigned long long next_lsn = 1;
+        
+        /* bytes at the end of the log that were not a whole, valid record,
+         and were cut off. */
+        unsigned long long torn_bytes = 0;
+    };
+    
+    class log_class
+    {
+    public:
+        static const unsigned char set_op = 1;
+        static const unsigned char unset_op = 2;
+        static const unsigned char clear_op = 3;
+        
+        explicit log_class() : path(), fd(-1), level(sync_always), interval(100), record_lock(), pending(), 
+                record_start(0), op_count(0), lsn(1), bytes(0), logged(0), records(0), written(0), synced(0), 
+                syncs(0), syncer(), sync_lock(), stop_syncer(), stopping(false)
+        {
+        }
+        
+        ~log_class()
+        {
+            this->close();
+        }
+        
+        /** Opens (or creates) the log at [path] for appending.  [next_lsn] is
+         the LSN the next record gets; recovery says what it is. */
+        bool open(const std::string& path, const unsigned long long& next_lsn, const durability_level& l,
+                const unsigned int& interval_ms, std::string& error);
+        
+        /** Makes everything durable and closes the log. */
+        void close();
+        
+        bool is_open() const
+        {
+            return (this->fd >= 0);
+        }
+        
+        /** Starts a record.  Operations are added to it, and it is finished
+         with end_record; a record with no operations is dropped.  No other
+         thread can log anything in between. */
+        void begin_record();
+        void log_set(const char*, const std::size_t&, const typed_value::value_class&);
+        void log_unset(const char*, const std::size_t&);
+        void log_clear();
+        void end_record();
+        
+        /** Drops every record before [base_lsn], which are in the first
+         [offset] bytes of the log (a checkpoint has made them redundant).
+         The records after them are copied to a new log that replaces this
+         one, so this only takes as long as copying those. */
+        bool compact(const unsigned long long& base_lsn, const unsigned long long& offset, std::string& error);
+        
+        /** Called whenever committed work is about to be acknowledged (output
+         is written, or the input has run dry): hands the records to the OS,
+         and syncs them if the durability level says to.  A sync covers
+         everything handed over so far, so threads that reach a commit point
+         while one is running share the next. */
+        void commit_point();
+        
+        unsigned long long next_lsn() const
+        {
+            return this->lsn;
+        }
+        
+        /** Returns the size of the log, counting records not written yet. */
+        unsigned long long size() const
+        {
+            return this->logged;
+        }
+        
+        unsigned long long record_count() const
+        {
+            return this->records;
+        }
+        
+        unsigned long long sync_count() const
+        {
+            return this->syncs;
+        }
+        
+        /** Replays the records at [path] from [first_lsn] on into [s] (the
+         ones before it are already in the snapshot [s] was loaded from; 0
+         means there is no such snapshot, and every record is replayed).  A
+         missing log is an empty one.  A record that is cut short or fails its
+         checksum ends the log: it and everything after it are truncated away. */
+        static bool recover(const std::string& path, const unsigned long long& first_lsn, 
+                shard_store::value_store& s, recovery_data& result, std::string& error);
+        
+    private:
+        std::string path;
+        int fd;
+        durability_level level;
+        unsigned int interval;
+        
+        /* Records not handed to the OS yet, and where the open one starts.
+         They (and the file) belong to whoever holds [record_lock]. */
+        std::mutex record_lock;
+        std::vector<char> pending;
+        std::size_t record_start;
+        std::uint32_t op_count;
+        
+        std::atomic<unsigned long long> lsn;
+        unsigned long long bytes;
+        std::atomic<unsigned long long> logged;
+        std::atomic<unsigned long long> records;
+        
+        /* How many bytes were ever handed to the OS, and how many of those
+         are known to be durable (only changed under [sync_lock]). */
+        std::atomic<unsigned long long> written;
+        unsigned long long synced;
+        std::atomic<unsigned long long> syncs;
+        std::thread syncer;
+        std::mutex sync_lock;
+        std::condition_variable stop_syncer;
+        bool stopping;
+        
+        void append(const void*, const std::size_t&);
+        void write_pending();
+        void sync_to(const unsigned long long&);
+        void sync();
+        void sync_loop();
+        
+    };
+    
+}
+
+#endif
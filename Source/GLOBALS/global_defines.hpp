@@ -20,6 +20,12 @@
 #define PGDOWN_KEY std::vector<int>({27, 91, 54, 126})
 #define DELETE_KEY std::vector<int>({27, 91, 51, 126})
 
+/* Set to 0 to compile out the index of which variables hold each value 
+ (used by KEYSEQUALTO).  It can also be turned off at startup with --no-key-index. */
+#ifndef KEY_INDEX_ENABLED
+#define KEY_INDEX_ENABLED 1
+#endif
+
 #define HCENTER 40
 #define VCENTER 8
 
@@ -25,22 +25,16 @@
 
 #ifndef GLOBAL_VARIABLES_HPP_INCLUDED
 #define GLOBAL_VARIABLES_HPP_INCLUDED
-#include <map>
 #include <string>
 
 #include "database_command.hpp"
-#include "variable_stack.hpp"
+#include "shard_store.hpp"
 
 namespace global
 {
-    /** used to quickly reference command names and data types. */
-    extern std::map<std::string, db_command::command_type> com_names;
-    
-    /** used to quickly reference command names and data types. */
-    extern std::map<db_command::command_type, std::string> com_types;
-    
-    /* The program's virtual stack. */
-    extern var_stack::stack_class<int> vStack;
+    /* The program's variables, and every key it has seen (by id).  The
+     sessions and the commands refer to keys through it. */
+    extern shard_store::value_store vStore;
 }
 
 
@@ -26,175 +26,228 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <unistd.h>
 
 #include "transaction_block.hpp"
 #include "database_command.hpp"
 #include "global_variables.hpp"
 #include "common.hpp"
-#include "variable_stack.hpp"
+#include "shard_store.hpp"
+#include "command_reader.hpp"
+#include "output_sink.hpp"
+#include "snapshot.hpp"
+#include "write_log.hpp"
+#include "checkpoint.hpp"
+#include "session.hpp"
+#include "server.hpp"
 
 using namespace std;
 
 namespace
 {
-    bool execute_command(const db_command::database_command_data&, 
-            std::vector<taction_block::transaction_block_class<int> >&);
-    db_command::database_command_data gcommand_input(std::istream&);
-    void command_term();
+    /** The settings given on the command line. */
+    struct options_data
+    {
+        output_sink::flush_policy policy = output_sink::pipelined;
+        bool ignore_case = false;
+        std::string load_path;
+        std::string log_path;
+        write_log::durability_level durability = write_log::sync_always;
+        unsigned int sync_interval = 100;
+        std::string checkpoint_path;
+        unsigned long long checkpoint_bytes = (64ULL << 20);
+        unsigned int checkpoint_seconds = 0;
+        std::vector<std::string> listen_tcp;
+        std::vector<std::string> listen_unix;
+        unsigned int threads = 1;
+        
+        /* 0 picks a number that suits [threads]. */
+        unsigned int shards = 0;
+    };
+    
+    bool command_term(const options_data&, write_log::log_class&);
+    bool apply_arguments(int, char**, options_data&);
     
     
     
-    inline bool execute_command(const db_command::database_command_data& c,
-            std::vector<taction_block::transaction_block_class<int> >& blocks)
+    /** Applies the command-line options.  Returns false if they are invalid. */
+    inline bool apply_arguments(int count, char **vec, options_data& options)
     {
-        bool success(false);
-        switch(blocks.size() > 0)
+        for(int x = 1; x < count; x++)
         {
-            case true:
-            {
-                switch(c.command)
-                {
-                    case db_command::commit:
-                    {
-                        for(typename std::vector<taction_block::transaction_block_class<int> >::iterator it = 
-                                blocks.begin(); ((it != blocks.end()) && (blocks.size() > 0));)
-                        {
-                            it->commit_changes();
-                            it = blocks.erase(it);
-                        }
-                        success = true;
-                    }
-                    break;
-                    
-                    case db_command::begin:
-                    {
-                        blocks.push_back(taction_block::transaction_block_class<int>(&global::vStack));
-                    }
-                    break;
-
-                    case db_command::rollback:
-                    {
-                        blocks.pop_back();
-                        success = true;
-                    }
-                    break;
-
-                    default:
-                    {
-                        blocks.back().add_command(c);
-                        blocks.back().preview_change((blocks.back().command_count() - 1));
-                        success = true;
-                    }
-                    break;
-                }
-            }
-            break;
-
-            case false:
-            {
-                switch(c.command)
-                {
-                    case db_command::rollback:
-                    {
-                        std::cout<< "NO TRANSACTIONS\n";
-                    }
-                    break;
-                    
-                    case db_command::begin:
-                    {
-                        blocks.push_back(taction_block::transaction_block_class<int>(&global::vStack));
-                    }
-                    break;
-
-                    default:
-                    {
-                        std::string temps(db_command::execute_command(c, &global::vStack));
-                        if(temps.size() > 0)
-                        {
-                            cout<< temps<< '\n';
-                        }
-                        success = true;
-                    }
-                    break;
-                }
-            }
-            break;
-
-            default:
+            std::string arg(vec[x]);
+            if((arg == "--rehash-step") && ((x + 1) < count) && common::string_is_int(vec[x + 1]) &&
+                    (std::string(vec[x + 1]).size() > 0))
             {
+                global::vStore.set_rehash_step(std::stoul(vec[++x]));
             }
-            break;
-        }
-        return success;
-    }
-    
-    inline db_command::database_command_data gcommand_input(std::istream& in)
-    {
-        bool finished(false);
-        db_command::database_command_data command;
-        std::string temps;
-        do
-        {
-            in>> temps;
-            if(temps == "clear")
+            else if(arg == "--no-key-index")
+            {
+                global::vStore.set_key_index(false);
+            }
+            else if((arg == "--flush") && ((x + 1) < count) && (std::string(vec[x + 1]) == "command"))
+            {
+                options.policy = output_sink::interactive;
+                x++;
+            }
+            else if((arg == "--flush") && ((x + 1) < count) && (std::string(vec[x + 1]) == "batch"))
+            {
+                options.policy = output_sink::pipelined;
+                x++;
+            }
+            else if((arg == "--flush") && ((x + 1) < count) && (std::string(vec[x + 1]) == "full"))
+            {
+                options.policy = output_sink::bulk;
+                x++;
+            }
+            else if(arg == "--persistent-store")
+            {
+                global::vStore.set_persistent(true);
+            }
+            else if(arg == "--ignore-case")
+            {
+                options.ignore_case = true;
+            }
+            else if((arg == "--load") && ((x + 1) < count))
+            {
+                options.load_path = vec[++x];
+            }
+            else if((arg == "--log") && ((x + 1) < count))
+            {
+                options.log_path = vec[++x];
+            }
+            else if((arg == "--durability") && ((x + 1) < count) && (std::string(vec[x + 1]) == "always"))
+            {
+                options.durability = write_log::sync_always;
+                x++;
+            }
+            else if((arg == "--durability") && ((x + 1) < count) && (std::string(vec[x + 1]) == "interval"))
+            {
+                options.durability = write_log::sync_interval;
+                x++;
+            }
+            else if((arg == "--durability") && ((x + 1) < count) && (std::string(vec[x + 1]) == "os"))
+            {
+                options.durability = write_log::sync_os;
+                x++;
+            }
+            else if((arg == "--sync-interval") && ((x + 1) < count) && common::string_is_int(vec[x + 1]) &&
+                    (std::string(vec[x + 1]).size() > 0) && (std::stoul(vec[x + 1]) > 0))
+            {
+                options.sync_interval = std::stoul(vec[++x]);
+            }
+            else if((arg == "--checkpoint") && ((x + 1) < count))
+            {
+                options.checkpoint_path = vec[++x];
+            }
+            else if((arg == "--checkpoint-bytes") && ((x + 1) < count) && common::string_is_int(vec[x + 1]) &&
+                    (std::string(vec[x + 1]).size() > 0))
             {
-                common::cls();
+                options.checkpoint_bytes = std::stoull(vec[++x]);
             }
-            else if(temps == "dumpstack")
+            else if((arg == "--checkpoint-seconds") && ((x + 1) < count) && common::string_is_int(vec[x + 1]) &&
+                    (std::string(vec[x + 1]).size() > 0))
             {
-                common::cls();
-                std::cout<< "Stack Begin: \n\n";
-                for(unsigned int x = 0; x < global::vStack.size(); x++)
-                {
-                    std::cout<< global::vStack[x].name<< " = "<< global::vStack[x].value<< "\n";
-                }
+                options.checkpoint_seconds = std::stoul(vec[++x]);
             }
-            else if(temps == "clearstack")
+            else if((arg == "--listen") && ((x + 1) < count))
             {
-                global::vStack.erase_all();
+                options.listen_tcp.push_back(vec[++x]);
+            }
+            else if((arg == "--listen-unix") && ((x + 1) < count))
+            {
+                options.listen_unix.push_back(vec[++x]);
+            }
+            else if((arg == "--threads") && ((x + 1) < count) && common::string_is_int(vec[x + 1]) &&
+                    (std::string(vec[x + 1]).size() > 0) && (std::stoul(vec[x + 1]) > 0) && 
+                    (std::stoul(vec[x + 1]) <= 1024))
+            {
+                options.threads = std::stoul(vec[++x]);
+            }
+            else if((arg == "--shards") && ((x + 1) < count) && common::string_is_int(vec[x + 1]) &&
+                    (std::string(vec[x + 1]).size() > 0) && (std::stoul(vec[x + 1]) > 0) && 
+                    (std::stoul(vec[x + 1]) <= 256))
+            {
+                options.shards = std::stoul(vec[++x]);
             }
             else
             {
-                switch(global::com_names.find(temps) != global::com_names.end())
-                {
-                    case true:
-                    {
-                        command.command = global::com_names.find(temps)->second;
-                        while(in.rdbuf()->in_avail() > 1)
-                        {
-                            command.args.push_back(std::string());
-                            in>> command.args.back();
-                        }
-                        finished = true;
-                    }
-                    break;
-
-                    case false:
-                    {
-                        std::cout<< "Not a command!\n";
-                    }
-                    break;
-
-                    default:
-                    {
-                    }
-                    break;
-                }
+                std::cout<< "usage: "<< vec[0]<< " [--rehash-step slots] [--no-key-index] "
+                        "[--flush command|batch|full] [--ignore-case] [--load snapshot] [--log file] "
+                        "[--durability always|interval|os] [--sync-interval ms] [--checkpoint snapshot] "
+                        "[--checkpoint-bytes bytes] [--checkpoint-seconds seconds] [--persistent-store] "
+                        "[--listen [host:]port]... [--listen-unix path]... [--threads n] [--shards n]\n";
+                return false;
             }
         }
-        while(!finished);
-        return command;
+        if((options.threads > 1) && options.listen_tcp.empty() && options.listen_unix.empty())
+        {
+            std::cout<< "--threads needs --listen or --listen-unix\n";
+            return false;
+        }
+        
+        /* Unless told otherwise, there are enough shards that threads seldom
+         want the same one at once. */
+        unsigned int shards(options.shards);
+        if(shards == 0)
+        {
+            shards = 1;
+            while((options.threads > 1) && (shards < (options.threads * 8)) && (shards < 256)) shards *= 2;
+        }
+        if(!global::vStore.set_shards(shards))
+        {
+            std::cout<< "--shards must be a power of two, up to 256\n";
+            return false;
+        }
+        if(!options.checkpoint_path.empty() && options.log_path.empty())
+        {
+            std::cout<< "--checkpoint needs --log\n";
+            return false;
+        }
+        return true;
     }
     
-    inline void command_term()
+    /** Runs the commands given on stdin, or serves them over the sockets
+     given on the command line. */
+    inline bool command_term(const options_data& options, write_log::log_class& log)
     {
-        std::vector<taction_block::transaction_block_class<int> > blocks;
-        db_command::database_command_data command;
-        do
+        checkpoint::checkpoint_class checkpoints(options.checkpoint_path, options.checkpoint_bytes, 
+                options.checkpoint_seconds);
+        session::shared_data shared;
+        std::string error;
+        bool success(true);
+        
+        shared.ignore_case = options.ignore_case;
+        shared.log = &log;
+        if(!options.checkpoint_path.empty()) shared.checkpoints = &checkpoints;
+        if(options.listen_tcp.empty() && options.listen_unix.empty())
+        {
+            session::session_class terminal(STDIN_FILENO, STDOUT_FILENO, options.policy, shared);
+            while(terminal.run());
+            terminal.output().flush();
+        }
+        else
         {
-            command = gcommand_input(std::cin);
-            if(command.command != db_command::end) execute_command(command, blocks);
-        }while(command.command != db_command::end);
+            /* Connections run transactions side by side, so commits are
+             checked against each other; with more than one thread, the
+             store has to lock its shards. */
+            global::vStore.set_versioned(true);
+            global::vStore.set_concurrent(options.threads > 1);
+            server::server_class listener(shared, options.policy, options.threads);
+            for(std::size_t x = 0; (success && (x < options.listen_tcp.size())); x++)
+            {
+                success = listener.listen_tcp(options.listen_tcp[x], error);
+            }
+            for(std::size_t x = 0; (success && (x < options.listen_unix.size())); x++)
+            {
+                success = listener.listen_unix(options.listen_unix[x], error);
+            }
+            success = (success && listener.run(error));
+            if(!success) std::cout<< error<< '\n';
+        }
+        checkpoints.finish(log);
+        log.close();
+        return success;
     }
     
     
@@ -202,7 +255,48 @@ namespace
 
 int main(int count, char **vec)
 {
+    options_data options;
+    write_log::log_class log;
+    
     cin.sync_with_stdio(false);
-    command_term();
-    return 0;
+    if(!apply_arguments(count, vec, options)) return 1;
+    
+    /* The last checkpoint, if there is one, is newer than any snapshot given
+     with --load.  Without a snapshot the log has to start at the first LSN. */
+    unsigned long long snapshot_lsn(1);
+    std::string snapshot_path(options.load_path);
+    if(!options.checkpoint_path.empty() && (access(options.checkpoint_path.c_str(), F_OK) == 0))
+    {
+        snapshot_path = options.checkpoint_path;
+    }
+    if(!snapshot_path.empty())
+    {
+        std::string error;
+        if(!snapshot::load(snapshot_path, global::vStore, snapshot_lsn, error))
+        {
+            std::cout<< error<< '\n';
+            return 1;
+        }
+    }
+    if(!options.log_path.empty())
+    {
+        /* The log holds what was committed since the snapshot (if any), so
+         it is replayed on top of it. */
+        std::string error;
+        write_log::recovery_data recovered;
+        if(!write_log::log_class::recover(options.log_path, snapshot_lsn, global::vStore, recovered, error) ||
+                !log.open(options.log_path, recovered.next_lsn, options.durability, options.sync_interval, error))
+        {
+            std::cout<< error<< '\n';
+            return 1;
+        }
+        if(recovered.torn_bytes > 0)
+        {
+            std::cerr<< "log: cut "<< recovered.torn_bytes<< " bytes of an unfinished record\n";
+        }
+
+        /* Keys the log set and then unset are given back before anything runs. */
+        global::vStore.compact_keys();
+    }
+    return (command_term(options, log) ? 0 : 1);
 }
\ No newline at end of file
@@ -0,0 +1,120 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2014 Jonathan Craig Whitlock
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+ */
+
+#ifndef BENCHMARK_HPP_INCLUDED
+#define BENCHMARK_HPP_INCLUDED
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+#include "shard_store.hpp"
+#include "typed_value.hpp"
+
+/**
+ * What the benchmarks that run the store in-process share: keys, a store
+ * set up the way the server sets it up, and a way to run a loop on some
+ * threads for a while and count what they did.
+ */
+namespace benchmark
+{
+    typedef shard_store::value_store store_type;
+    
+    /** A small, fast random number generator (xorshift), one per thread. */
+    struct random_data
+    {
+        explicit random_data(const std::uint64_t& seed) : state(seed | 1)
+        {
+        }
+        
+        std::uint64_t next()
+        {
+            this->state ^= (this->state << 13);
+            this->state ^= (this->state >> 7);
+            this->state ^= (this->state << 17);
+            return this->state;
+        }
+        
+        std::uint64_t state;
+    };
+    
+    /** Returns [n] key names. */
+    inline std::vector<std::string> make_keys(const std::size_t& n)
+    {
+        std::vector<std::string> keys;
+        keys.reserve(n);
+        for(std::size_t x = 0; x < n; x++) keys.push_back("key" + std::to_string(x));
+        return keys;
+    }
+    
+    /** Sets up an empty store like the server does for [threads] threads
+     (concurrent, with 8 shards a thread), and gives every key a value. */
+    inline void fill(store_type& store, const unsigned int& threads, const std::vector<std::string>& keys)
+    {
+        std::size_t shards(1);
+        while((threads > 1) && (shards < (threads * 8)) && (shards < store_type::max_shards)) shards *= 2;
+        store.set_shards(shards);
+        store.set_concurrent(true);
+        for(std::size_t x = 0; x < keys.size(); x++)
+        {
+            store.set(store.intern(keys[x].data(), keys[x].size()), 
+                    typed_value::value_class::integer((std::int64_t)(x % 64)));
+        }
+    }
+    
+    /** Returns the numbers of threads to try: the powers of two below
+     [most], and [most]. */
+    inline std::vector<unsigned int> thread_counts(const unsigned int& most)
+    {
+        std::vector<unsigned int> counts;
+        for(unsigned int x = 1; x < most; x *= 2) counts.push_back(x);
+        counts.push_back(most);
+        return counts;
+    }
+    
+    /** Runs [f] on [threads] threads at once for [seconds], and puts the
+     number of operations each did in [done].  [f] is called with the
+     thread's number and a flag that is set when time is up, and returns
+     the number of operations it did. */
+    template<class function_type>
+    void run_threads(const unsigned int& threads, const double& seconds, const function_type& f, 
+            std::vector<unsigned long long>& done)
+    {
+        std::vector<std::thread> running;
+        std::atomic<bool> stop(false);
+        done.assign(threads, 0);
+        for(unsigned int x = 0; x < threads; x++)
+        {
+            running.push_back(std::thread([&f, &stop, &done, x](){ done[x] = f(x, stop); }));
+        }
+        std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+        stop.store(true);
+        for(unsigned int x = 0; x < threads; x++) running[x].join();
+    }
+    
+}
+
+#endif
@@ -0,0 +1,133 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2014 Jonathan Craig Whitlock
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+ */
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+
+#include "database_client.hpp"
+
+/**
+ * Measures a server over the binary protocol.  Run as client_benchmark
+ * [host:port or socket path] [connections] [batches] [depth]: each
+ * connection sends [batches] batches of [depth] SETs, each followed by a
+ * GET of the same key, and waits for a batch's answers before it sends the
+ * next.  Prints the requests answered per second, and how many GETs did
+ * not return what was just set.
+ */
+namespace
+{
+    /** What one connection did. */
+    struct result_data
+    {
+        unsigned long long requests = 0;
+        unsigned long long wrong = 0;
+        std::string error;
+    };
+    
+    bool connect(db_client::client_class&, const std::string&, std::string&);
+    void run_connection(const std::string&, const unsigned int&, const unsigned int&, const unsigned int&, 
+            result_data&);
+    
+    
+    
+    /** A path (anything with a slash in it) is a Unix socket. */
+    inline bool connect(db_client::client_class& client, const std::string& address, std::string& error)
+    {
+        if(address.find('/') != std::string::npos) return client.connect_unix(address, error);
+        return client.connect_tcp(address, error);
+    }
+    
+    inline void run_connection(const std::string& address, const unsigned int& number, const unsigned int& batches, 
+            const unsigned int& depth, result_data& result)
+    {
+        db_client::client_class client;
+        wire::response_data r;
+        if(!connect(client, address, result.error)) return;
+        
+        /* Every connection has keys of its own, so what a GET returns is known. */
+        const std::string prefix("bench" + std::to_string(number) + "_");
+        for(unsigned int x = 0; x < batches; x++)
+        {
+            for(unsigned int y = 0; y < depth; y++)
+            {
+                std::string key(prefix + std::to_string(y % 10000));
+                client.set(key, (std::int32_t)(x + y));
+                client.get(key);
+            }
+            if(!client.flush(result.error)) return;
+            for(unsigned int y = 0; y < (2 * depth); y++)
+            {
+                if(!client.next_response(r, result.error)) return;
+                result.requests++;
+                if(((y % 2) == 1) && ((r.status != wire::status_value) || (r.value != (x + (y / 2))))) result.wrong++;
+            }
+        }
+    }
+    
+    
+}
+
+int main(int count, char **vec)
+{
+    if(count < 2)
+    {
+        std::cout<< "usage: client_benchmark [host:port or socket path] [connections] [batches] [depth]\n";
+        return 1;
+    }
+    
+    std::string address(vec[1]);
+    unsigned int connections((count > 2) ? std::strtoul(vec[2], nullptr, 10) : 4);
+    unsigned int batches((count > 3) ? std::strtoul(vec[3], nullptr, 10) : 1000);
+    unsigned int depth((count > 4) ? std::strtoul(vec[4], nullptr, 10) : 64);
+    std::vector<result_data> results(connections);
+    std::vector<std::thread> threads;
+    unsigned long long requests(0), wrong(0);
+    
+    std::chrono::steady_clock::time_point started(std::chrono::steady_clock::now());
+    for(unsigned int x = 0; x < connections; x++)
+    {
+        threads.push_back(std::thread(run_connection, std::cref(address), x, batches, depth, std::ref(results[x])));
+    }
+    for(std::size_t x = 0; x < threads.size(); x++) threads[x].join();
+    double seconds(std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count());
+    
+    for(std::size_t x = 0; x < results.size(); x++)
+    {
+        if(!results[x].error.empty())
+        {
+            std::cout<< "connection "<< x<< ": "<< results[x].error<< '\n';
+            return 1;
+        }
+        requests += results[x].requests;
+        wrong += results[x].wrong;
+    }
+    std::cout<< requests<< " requests in "<< seconds<< "s: "<< (unsigned long long)(requests / seconds)<< 
+            " requests/s, "<< wrong<< " wrong\n";
+    return ((wrong == 0) ? 0 : 1);
+}
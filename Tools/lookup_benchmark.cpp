@@ -0,0 +1,145 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2014 Jonathan Craig Whitlock
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+ */
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+
+#include "benchmark.hpp"
+#include "symbol_table.hpp"
+#include "variable_stack.hpp"
+#include "typed_value.hpp"
+
+/**
+ * Compares looking variables up by name in the symbol table and the stack
+ * with looking them up in a std::map from names to values (which is what
+ * the stack used to be).  Run as lookup_benchmark [keys] [lookups]: both
+ * are filled with [keys] keys, and then asked for [lookups] random ones,
+ * a tenth of them keys that aren't there.  Inserting into the stack also
+ * counts and orders the values, which the map doesn't do.
+ */
+namespace
+{
+    typedef typed_value::value_class value_type;
+    typedef std::chrono::steady_clock clock_type;
+    
+    /** What one kind of index did. */
+    struct result_data
+    {
+        double inserts = 0;
+        double lookups = 0;
+        unsigned long long found = 0;
+    };
+    
+    double per_second(const std::size_t&, const clock_type::time_point&);
+    result_data time_map(const std::vector<std::string>&, const std::vector<const std::string*>&);
+    result_data time_stack(const std::vector<std::string>&, const std::vector<const std::string*>&);
+    
+    
+    
+    inline double per_second(const std::size_t& n, const clock_type::time_point& started)
+    {
+        return (n / std::chrono::duration<double>(clock_type::now() - started).count());
+    }
+    
+    inline result_data time_map(const std::vector<std::string>& keys, const std::vector<const std::string*>& asked)
+    {
+        std::map<std::string, value_type> vars;
+        result_data result;
+        
+        clock_type::time_point started(clock_type::now());
+        for(std::size_t x = 0; x < keys.size(); x++) vars[keys[x]] = value_type::integer((std::int64_t)x);
+        result.inserts = per_second(keys.size(), started);
+        
+        started = clock_type::now();
+        for(std::size_t x = 0; x < asked.size(); x++) result.found += (vars.find(*asked[x]) != vars.end());
+        result.lookups = per_second(asked.size(), started);
+        return result;
+    }
+    
+    inline result_data time_stack(const std::vector<std::string>& keys, const std::vector<const std::string*>& asked)
+    {
+        symbols::symbol_table_class names;
+        var_stack::stack_class<value_type> vars;
+        result_data result;
+        
+        clock_type::time_point started(clock_type::now());
+        for(std::size_t x = 0; x < keys.size(); x++)
+        {
+            vars.set_var(names.intern(keys[x]), value_type::integer((std::int64_t)x));
+        }
+        result.inserts = per_second(keys.size(), started);
+        
+        started = clock_type::now();
+        for(std::size_t x = 0; x < asked.size(); x++)
+        {
+            symbols::id_type id(names.find(*asked[x]));
+            result.found += ((id != symbols::no_id) && (vars.find_value(id) != nullptr));
+        }
+        result.lookups = per_second(asked.size(), started);
+        return result;
+    }
+    
+    
+}
+
+int main(int count, char **vec)
+{
+    std::size_t key_count((count > 1) ? std::strtoull(vec[1], nullptr, 10) : 1000000);
+    std::size_t lookups((count > 2) ? std::strtoull(vec[2], nullptr, 10) : 4000000);
+    std::vector<std::string> keys(benchmark::make_keys(key_count)), missing(benchmark::make_keys(key_count / 10));
+    std::vector<const std::string*> asked;
+    benchmark::random_data random(1);
+    
+    if(keys.empty() || missing.empty())
+    {
+        std::cout<< "usage: lookup_benchmark [keys] [lookups] (at least 10 keys)\n";
+        return 1;
+    }
+    
+    /* Keys that aren't there are spelled differently, but are just as long. */
+    for(std::size_t x = 0; x < missing.size(); x++) missing[x][0] = 'K';
+    for(std::size_t x = 0; x < lookups; x++)
+    {
+        std::uint64_t r(random.next());
+        asked.push_back(((r % 10) == 0) ? &missing[((r >> 8) % missing.size())] : &keys[((r >> 8) % keys.size())]);
+    }
+    
+    result_data map(time_map(keys, asked)), stack(time_stack(keys, asked));
+    if(map.found != stack.found)
+    {
+        std::cout<< "the map found "<< map.found<< " keys, but the stack found "<< stack.found<< '\n';
+        return 1;
+    }
+    std::cout<< key_count<< " keys, "<< lookups<< " lookups ("<< stack.found<< " found)\n";
+    std::cout<< "           inserts/s  lookups/s\n";
+    std::cout<< "std::map   "<< (unsigned long long)map.inserts<< "  "<< (unsigned long long)map.lookups<< '\n';
+    std::cout<< "stack      "<< (unsigned long long)stack.inserts<< "  "<< (unsigned long long)stack.lookups<< '\n';
+    std::cout<< "lookups are "<< (stack.lookups / map.lookups)<< " times as fast\n";
+    return 0;
+}
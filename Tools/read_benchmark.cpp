@@ -0,0 +1,132 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2014 Jonathan Craig Whitlock
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+ */
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+
+#include "benchmark.hpp"
+#include "shard_store.hpp"
+#include "typed_value.hpp"
+
+/**
+ * Measures the lock-free read path under a read-heavy load.  Run as
+ * read_benchmark [readers] [seconds] [keys]: for each number of reader
+ * threads up to [readers] (the number of cores by default), a store is
+ * filled with [keys] keys, and one writer thread sets random ones the
+ * whole time, while every reader does 15 GETs for each NUMEQUALTO.  What
+ * readers get done should grow with their number, and not hold the
+ * writer back.
+ */
+namespace
+{
+    unsigned long long write(benchmark::store_type&, const std::vector<std::string>&, const std::atomic<bool>&);
+    unsigned long long read(benchmark::store_type&, const std::vector<std::string>&, const unsigned int&, 
+            const std::atomic<bool>&);
+    
+    
+    
+    inline unsigned long long write(benchmark::store_type& store, const std::vector<std::string>& keys, 
+            const std::atomic<bool>& stop)
+    {
+        benchmark::random_data random(keys.size());
+        unsigned long long done(0);
+        while(!stop.load(std::memory_order_relaxed))
+        {
+            for(unsigned int x = 0; x < 16; x++)
+            {
+                std::uint64_t r(random.next());
+                const std::string& key(keys[(r % keys.size())]);
+                store.set(store.intern(key.data(), key.size()), typed_value::value_class::integer((r >> 32) % 64));
+            }
+            done += 16;
+        }
+        return done;
+    }
+    
+    inline unsigned long long read(benchmark::store_type& store, const std::vector<std::string>& keys, 
+            const unsigned int& number, const std::atomic<bool>& stop)
+    {
+        benchmark::random_data random(number + 1);
+        var_stack::variable_data<typed_value::value_class> var;
+        unsigned long long done(0), found(0);
+        while(!stop.load(std::memory_order_relaxed))
+        {
+            for(unsigned int x = 0; x < 15; x++)
+            {
+                const std::string& key(keys[(random.next() % keys.size())]);
+                found += store.get(store.find(key.data(), key.size()), var);
+            }
+            found += store.count_equal(typed_value::value_class::integer(random.next() % 64));
+            done += 16;
+        }
+        
+        /* What was read is used, so none of it can be left out. */
+        return ((found == ~0ULL) ? 0 : done);
+    }
+    
+    
+}
+
+int main(int count, char **vec)
+{
+    unsigned int most((count > 1) ? std::strtoul(vec[1], nullptr, 10) : std::thread::hardware_concurrency());
+    double seconds((count > 2) ? std::strtod(vec[2], nullptr) : 1.0);
+    std::size_t key_count((count > 3) ? std::strtoull(vec[3], nullptr, 10) : 100000);
+    std::vector<std::string> keys(benchmark::make_keys(key_count));
+    std::vector<unsigned int> counts(benchmark::thread_counts((most == 0) ? 1 : most));
+    std::vector<unsigned long long> done;
+    double first(0);
+    
+    if(keys.empty())
+    {
+        std::cout<< "usage: read_benchmark [readers] [seconds] [keys]\n";
+        return 1;
+    }
+    std::cout<< "readers  reads/s  speedup  writes/s\n";
+    for(std::size_t x = 0; x < counts.size(); x++)
+    {
+        benchmark::store_type store;
+        unsigned long long reads(0);
+        
+        /* Thread 0 is the writer. */
+        benchmark::fill(store, (counts[x] + 1), keys);
+        benchmark::run_threads((counts[x] + 1), seconds, [&store, &keys](const unsigned int& n, 
+                const std::atomic<bool>& stop)
+        {
+            return ((n == 0) ? write(store, keys, stop) : read(store, keys, n, stop));
+        }, done);
+        for(std::size_t y = 1; y < done.size(); y++) reads += done[y];
+        
+        double rate(reads / seconds);
+        if(x == 0) first = rate;
+        std::cout<< counts[x]<< "  "<< (unsigned long long)rate<< "  "<< (rate / first)<< "  "<< 
+                (unsigned long long)(done[0] / seconds)<< '\n';
+    }
+    return 0;
+}
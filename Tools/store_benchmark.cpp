@@ -0,0 +1,110 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2014 Jonathan Craig Whitlock
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+ */
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+
+#include "benchmark.hpp"
+#include "shard_store.hpp"
+#include "typed_value.hpp"
+
+/**
+ * Measures how SET and GET scale with threads, on the sharded store
+ * itself (no connections or parsing).  Run as store_benchmark [threads]
+ * [seconds] [keys]: for each number of threads up to [threads] (the
+ * number of cores by default), a store is filled with [keys] keys, and
+ * every thread sets and gets random ones, half and half, for [seconds].
+ * Each operation looks its key up by name, the way a command does.
+ */
+namespace
+{
+    unsigned long long set_and_get(benchmark::store_type&, const std::vector<std::string>&, const unsigned int&, 
+            const std::atomic<bool>&);
+    
+    
+    
+    inline unsigned long long set_and_get(benchmark::store_type& store, const std::vector<std::string>& keys, 
+            const unsigned int& number, const std::atomic<bool>& stop)
+    {
+        benchmark::random_data random(number + 1);
+        var_stack::variable_data<typed_value::value_class> var;
+        unsigned long long done(0);
+        while(!stop.load(std::memory_order_relaxed))
+        {
+            for(unsigned int x = 0; x < 64; x++)
+            {
+                std::uint64_t r(random.next());
+                const std::string& key(keys[((r >> 1) % keys.size())]);
+                if((r & 1) == 0) 
+                {
+                    store.set(store.intern(key.data(), key.size()), typed_value::value_class::integer(done + x));
+                }
+                else store.get(store.find(key.data(), key.size()), var);
+            }
+            done += 64;
+        }
+        return done;
+    }
+    
+    
+}
+
+int main(int count, char **vec)
+{
+    unsigned int most((count > 1) ? std::strtoul(vec[1], nullptr, 10) : std::thread::hardware_concurrency());
+    double seconds((count > 2) ? std::strtod(vec[2], nullptr) : 1.0);
+    std::size_t key_count((count > 3) ? std::strtoull(vec[3], nullptr, 10) : 100000);
+    std::vector<std::string> keys(benchmark::make_keys(key_count));
+    std::vector<unsigned int> counts(benchmark::thread_counts((most == 0) ? 1 : most));
+    std::vector<unsigned long long> done;
+    double first(0);
+    
+    if(keys.empty())
+    {
+        std::cout<< "usage: store_benchmark [threads] [seconds] [keys]\n";
+        return 1;
+    }
+    std::cout<< "threads  SET+GET/s  speedup\n";
+    for(std::size_t x = 0; x < counts.size(); x++)
+    {
+        benchmark::store_type store;
+        unsigned long long total(0);
+        benchmark::fill(store, counts[x], keys);
+        benchmark::run_threads(counts[x], seconds, [&store, &keys](const unsigned int& n, const std::atomic<bool>& stop)
+        {
+            return set_and_get(store, keys, n, stop);
+        }, done);
+        for(std::size_t y = 0; y < done.size(); y++) total += done[y];
+        
+        double rate(total / seconds);
+        if(x == 0) first = rate;
+        std::cout<< counts[x]<< "  "<< (unsigned long long)rate<< "  "<< (rate / first)<< '\n';
+    }
+    return 0;
+}
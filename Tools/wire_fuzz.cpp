@@ -0,0 +1,174 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2014 Jonathan Craig Whitlock
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+ */
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <random>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+
+#include "wire_protocol.hpp"
+
+/**
+ * Checks the binary protocol's codec against random input: every request
+ * it encodes must decode to the same thing, no part of one may decode, and
+ * random bytes must never decode to anything that reaches past them.  Run
+ * as wire_fuzz [rounds] [seed]; it prints what failed first, if anything.
+ */
+namespace
+{
+    typedef std::mt19937_64 random_type;
+    
+    bool round_trip(random_type&, std::string&);
+    bool garbage(random_type&, std::string&);
+    bool response(random_type&, std::string&);
+    
+    
+    
+    /** Returns a random key: usually short, now and then long enough for a
+     varint of three bytes, and once in a while as long as a key may be. */
+    inline std::string random_key(random_type& random)
+    {
+        std::size_t size(random() % 300);
+        if((random() % 50) == 0) size = (random() % 70000);
+        if((random() % 100000) == 0) size = wire::max_key;
+        
+        std::string key(size, '\0');
+        for(std::size_t x = 0; x < size; x++) key[x] = (char)random();
+        return key;
+    }
+    
+    inline bool round_trip(random_type& random, std::string& error)
+    {
+        std::string key(random_key(random)), buffer;
+        std::int32_t value((std::int32_t)random());
+        std::uint32_t id((std::uint32_t)random());
+        unsigned char opcode((unsigned char)random());
+        wire::request_data r;
+        
+        wire::encode_request(buffer, opcode, key.data(), key.size(), value, id);
+        for(std::size_t x = 0; x < buffer.size(); x += (1 + (random() % 7)))
+        {
+            if(wire::decode_request(buffer.data(), x, r) != 0)
+            {
+                error = ("the first " + std::to_string(x) + " bytes of a request decoded");
+                return false;
+            }
+        }
+        
+        /* A copy of exactly the request's size, so reading past it shows up
+         under a sanitizer. */
+        std::vector<char> exact(buffer.begin(), buffer.end());
+        if(wire::decode_request(exact.data(), exact.size(), r) != buffer.size())
+        {
+            error = "a whole request did not decode";
+            return false;
+        }
+        if((r.opcode != opcode) || (std::string(r.key, r.key_size) != key) || (r.value != value) || (r.id != id))
+        {
+            error = "a request decoded to something else";
+            return false;
+        }
+        
+        if((random() % 10000) == 0)
+        {
+            buffer.clear();
+            key.resize(wire::max_key + 1);
+            wire::encode_request(buffer, opcode, key.data(), key.size(), value, id);
+            if(wire::decode_request(buffer.data(), buffer.size(), r) != wire::malformed)
+            {
+                error = "a key longer than max_key was not malformed";
+                return false;
+            }
+        }
+        return true;
+    }
+    
+    inline bool garbage(random_type& random, std::string& error)
+    {
+        std::vector<char> junk(1 + (random() % 40));
+        wire::request_data r;
+        for(std::size_t x = 0; x < junk.size(); x++) junk[x] = (char)random();
+        
+        /* Small lengths, so some of it is whole requests. */
+        if((junk.size() > 1) && ((random() % 2) == 0)) junk[1] = (char)(random() % 32);
+        
+        std::size_t used(wire::decode_request(junk.data(), junk.size(), r));
+        if((used == 0) || (used == wire::malformed)) return true;
+        if((used > junk.size()) || (r.key < junk.data()) || ((r.key + r.key_size + 8) != (junk.data() + used)))
+        {
+            error = "random bytes decoded to a request outside of them";
+            return false;
+        }
+        for(std::size_t x = 0; x < used; x++)
+        {
+            if(wire::decode_request(junk.data(), x, r) != 0)
+            {
+                error = "part of a request made of random bytes decoded";
+                return false;
+            }
+        }
+        return true;
+    }
+    
+    inline bool response(random_type& random, std::string& error)
+    {
+        char buffer[wire::response_size];
+        std::uint32_t id((std::uint32_t)random());
+        wire::status_type status((wire::status_type)(random() % (wire::status_text + 1)));
+        std::int64_t value((std::int64_t)random());
+        wire::response_data r;
+        
+        wire::encode_response(buffer, id, status, value);
+        wire::decode_response(buffer, r);
+        if((r.id != id) || (r.status != status) || (r.value != value))
+        {
+            error = "a response decoded to something else";
+            return false;
+        }
+        return true;
+    }
+    
+    
+}
+
+int main(int count, char **vec)
+{
+    unsigned long long rounds((count > 1) ? std::strtoull(vec[1], nullptr, 10) : 200000);
+    random_type random((count > 2) ? std::strtoull(vec[2], nullptr, 10) : 1);
+    std::string error;
+    
+    for(unsigned long long x = 0; x < rounds; x++)
+    {
+        if(!round_trip(random, error) || !garbage(random, error) || !response(random, error))
+        {
+            std::cout<< "round "<< x<< ": "<< error<< '\n';
+            return 1;
+        }
+    }
+    std::cout<< rounds<< " rounds ok\n";
+    return 0;
+}